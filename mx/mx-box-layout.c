@@ -112,6 +112,10 @@ struct _MxBoxLayoutPrivate
   MxOrientation orientation;
 
   MxFocusable *last_focus;
+
+  /* the children's allocations, for culling in paint and pick */
+  GArray       *extents;
+  guint         extents_valid : 1;
 };
 
 void _mx_box_layout_finish_animation (MxBoxLayout *box);
@@ -280,6 +284,17 @@ scrollable_get_adjustments (MxScrollable  *scrollable,
     }
 }
 
+/* The adjustments that have been set or created so far, without creating
+ * any */
+void
+_mx_box_layout_peek_adjustments (MxBoxLayout   *box,
+                                 MxAdjustment **hadjustment,
+                                 MxAdjustment **vadjustment)
+{
+  *hadjustment = box->priv->hadjustment;
+  *vadjustment = box->priv->vadjustment;
+}
+
 
 
 static void
@@ -305,6 +320,8 @@ mx_box_container_actor_added (ClutterContainer *container,
 {
   MxBoxLayoutPrivate *priv = MX_BOX_LAYOUT (container)->priv;
 
+  priv->extents_valid = FALSE;
+
   if (priv->enable_animations)
     {
       _mx_box_layout_start_animation (MX_BOX_LAYOUT (container));
@@ -327,6 +344,9 @@ mx_box_container_actor_removed (ClutterContainer *container,
 
   g_object_ref (actor);
 
+  priv->extents_valid = FALSE;
+  g_array_set_size (priv->extents, 0);
+
   if ((ClutterActor *)priv->last_focus == actor)
     priv->last_focus = NULL;
 
@@ -697,6 +717,8 @@ mx_box_layout_finalize (GObject *object)
       priv->start_allocations = NULL;
     }
 
+  g_array_free (priv->extents, TRUE);
+
   G_OBJECT_CLASS (mx_box_layout_parent_class)->finalize (object);
 }
 
@@ -878,6 +900,9 @@ mx_box_layout_allocate (ClutterActor          *actor,
   CLUTTER_ACTOR_CLASS (mx_box_layout_parent_class)->allocate (actor, box,
                                                               flags);
 
+  priv->extents_valid = FALSE;
+  g_array_set_size (priv->extents, 0);
+
   if (clutter_actor_get_n_children (actor) == 0)
     return;
 
@@ -1174,11 +1199,16 @@ mx_box_layout_allocate (ClutterActor          *actor,
         }
 
 next:
+      _mx_child_extents_add (priv->extents, child, priv->orientation);
+
       if (priv->orientation == MX_ORIENTATION_VERTICAL)
         position += (old_child_box.y2 - old_child_box.y1) + priv->spacing;
       else
         position += (old_child_box.x2 - old_child_box.x1) + priv->spacing;
     }
+
+  _mx_child_extents_finish (priv->extents);
+  priv->extents_valid = TRUE;
 }
 
 static void
@@ -1257,6 +1287,14 @@ mx_box_layout_paint (ClutterActor *actor)
   box_b.y2 = (box_b.y2 - box_b.y1) + y;
   box_b.y1 = y;
 
+  /* the children are in order along the orientation, so the visible ones
+   * can be found without looking at all of them */
+  if (priv->extents_valid)
+    {
+      _mx_child_extents_paint (priv->extents, &box_b, priv->orientation);
+      return;
+    }
+
   clutter_actor_iter_init (&iter, actor);
   while (clutter_actor_iter_next (&iter, &child))
     {
@@ -1307,6 +1345,12 @@ mx_box_layout_pick (ClutterActor       *actor,
   box_b.y2 = (box_b.y2 - box_b.y1) + y;
   box_b.y1 = y;
 
+  if (priv->extents_valid)
+    {
+      _mx_child_extents_paint (priv->extents, &box_b, priv->orientation);
+      return;
+    }
+
   clutter_actor_iter_init (&iter, actor);
   while (clutter_actor_iter_next (&iter, &child))
     {
@@ -1428,6 +1472,8 @@ mx_box_layout_init (MxBoxLayout *self)
                                                          (GDestroyNotify)
                                                          mx_box_layout_free_allocation);
 
+  self->priv->extents = g_array_new (FALSE, FALSE, sizeof (MxChildExtent));
+
   g_signal_connect (self, "style-changed",
                     G_CALLBACK (mx_box_layout_style_changed), NULL);
 
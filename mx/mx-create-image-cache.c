@@ -19,455 +19,661 @@
  * Boston, MA 02111-1307, USA.
  *
  */
-#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <dirent.h>
 #include <string.h>
-#include <assert.h>
-#include <stdint.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "mx-texture-cache-index.h"
 
-#ifndef PATH_MAX
-#define PATH_MAX 1024
-#endif
-
-struct imgcache_element {
-  char  filename[256];
-  int   width, height;
-  int   posX, posY;
-  void *ptr;
-};
+/*
+ * Images are packed in to as many atlas pages as needed with a bottom-left
+ * skyline packer. Each image is surrounded by its edge pixels repeated
+ * @extrude times, so that filtering at the edges of a sub-texture doesn't
+ * sample its neighbours, and then separated from the next by @padding
+ * transparent pixels.
+ *
+ * The pages are written as raw, premultiplied RGBA so that they can be
+ * uploaded as they are.
+ */
 
-GList *images;
+typedef struct
+{
+  gchar     *filename;
+  GdkPixbuf *pixbuf;
+  gint       width, height;
 
-int totalarea = 0;
+  gint       page;
+  gint       x, y;
+} AtlasImage;
 
+typedef struct
+{
+  gint x, y;
+  gint width;
+} SkylineNode;
 
-int sizes[] = { 0, 256, 384, 512, 640, 768, 896, 1024, 1280, 1536, 1792,  2048, -1};
+typedef struct
+{
+  GArray *skyline;
+  gint    width, height;        /* the area actually used */
+} AtlasPage;
 
+static gint page_size = 2048;
+static gint padding = 1;
+static gint extrude = 1;
+static gchar *output_dir = NULL;
+static gboolean verbose = FALSE;
 
-static gint sort_by_size(gconstpointer a,
-                         gconstpointer b)
+static GOptionEntry entries[] =
 {
-  const struct imgcache_element *A=a, *B=b;
-  if (A->height > B->height)
-    return -1;
-  if (A->height < B->height)
-    return 1;
-  if (A->width > B->width)
-    return -1;
-  if (A->width < B->width)
-    return 1;
-  return 0;
+  { "page-size", 's', 0, G_OPTION_ARG_INT, &page_size,
+    "Maximum width and height of an atlas page", "PIXELS" },
+  { "padding", 'p', 0, G_OPTION_ARG_INT, &padding,
+    "Transparent pixels between images", "PIXELS" },
+  { "extrude", 'e', 0, G_OPTION_ARG_INT, &extrude,
+    "Times to repeat the edge pixels of each image", "PIXELS" },
+  { "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir,
+    "Directory to write the atlas pages to", "DIR" },
+  { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+    "Describe the atlas pages as they are written", NULL },
+  { NULL }
+};
 
-}
-static void do_one_file(char *filename)
+static GList *images = NULL;
+static GPtrArray *pages = NULL;
+
+static gint
+sort_by_size (gconstpointer a,
+              gconstpointer b)
 {
-  GdkPixbuf *image;
-  struct imgcache_element *element;
+  const AtlasImage *A = a, *B = b;
 
-  if (strlen(filename) >= 256)
-    return;
+  if (A->height != B->height)
+    return B->height - A->height;
 
-  image = gdk_pixbuf_new_from_file(filename, NULL);
-  if (!image)
-    return;
+  return B->width - A->width;
+}
 
-  /* we don't want to do files > 256x256 */
+/* the size an image takes up on a page */
+static inline gint
+cell_size (gint size)
+{
+  return size + 2 * extrude + padding;
+}
 
-  if (gdk_pixbuf_get_width(image) > 256) {
-      gdk_pixbuf_unref(image);
+static void
+do_one_file (const gchar *filename)
+{
+  GError *error = NULL;
+  GdkPixbuf *pixbuf;
+  AtlasImage *image;
+
+  /* not every file in the directory has to be an image */
+  pixbuf = gdk_pixbuf_new_from_file (filename, &error);
+  if (!pixbuf)
+    {
+      if (verbose)
+        printf ("Skipping %s: %s\n", filename, error->message);
+      g_error_free (error);
       return;
     }
-  if (gdk_pixbuf_get_height(image) > 256) {
-      gdk_pixbuf_unref(image);
+
+  /* images that can't go on a page are left to be loaded on their own */
+  if (cell_size (gdk_pixbuf_get_width (pixbuf)) > page_size ||
+      cell_size (gdk_pixbuf_get_height (pixbuf)) > page_size)
+    {
+      fprintf (stderr, "Not caching %s: %ix%i is too big for a %ix%i page\n",
+               filename, gdk_pixbuf_get_width (pixbuf),
+               gdk_pixbuf_get_height (pixbuf), page_size, page_size);
+      g_object_unref (pixbuf);
       return;
     }
-  element = malloc(sizeof(struct imgcache_element));
-  if (!element) {
-      gdk_pixbuf_unref(image);
+
+  if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    {
+      fprintf (stderr, "Not caching %s: %i bits per sample isn't supported\n",
+               filename, gdk_pixbuf_get_bits_per_sample (pixbuf));
+      g_object_unref (pixbuf);
       return;
     }
 
-  memset(element, 0, sizeof(struct imgcache_element));
-  element->width = gdk_pixbuf_get_width(image);
-  element->height = gdk_pixbuf_get_height(image);
-  element->posX = -1;
-  element->posY = -1;
-  element->ptr = image;
-  totalarea += element->width * element->height;
-  strncpy(element->filename, filename, 256);
+  if (!gdk_pixbuf_get_has_alpha (pixbuf))
+    {
+      GdkPixbuf *tmp = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
 
-  if (element->width > sizes[0])
-    sizes[0] = element->width;
-
-  images = g_list_append(images, element);
-}
-
-static int get_effective_Y(int X1,
-                           int X2)
-{
-  int Y = 0;
-  GList *item;
-  struct imgcache_element *element;
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX == -1)
-        continue;
-      if (element->posX >= X2)
-        continue;
-      if (element->posX + element->width <= X1)
-        continue;
-      /* at this point we know the element overlaps our range */
-      if (element->posY + element->height > Y)
-        Y = element->posY + element->height;
+      g_object_unref (pixbuf);
+      pixbuf = tmp;
     }
-  return Y;
 
+  image = g_slice_new0 (AtlasImage);
+  image->filename = g_strdup (filename);
+  image->pixbuf = pixbuf;
+  image->width = gdk_pixbuf_get_width (pixbuf);
+  image->height = gdk_pixbuf_get_height (pixbuf);
+  image->page = -1;
+
+  images = g_list_prepend (images, image);
 }
 
-static inline uint32_t get_pixel(struct imgcache_element *element,
-                                 int                      X,
-                                 int                      Y)
+static AtlasPage *
+atlas_page_new (void)
 {
-  GdkPixbuf *buf;
-  unsigned char *p;
-  buf = element->ptr;
+  AtlasPage *page = g_slice_new0 (AtlasPage);
+  SkylineNode node = { 0, 0, page_size };
 
-  p = gdk_pixbuf_get_pixels(buf);
-  p += Y * gdk_pixbuf_get_rowstride(buf);
-  p += X * 4;
+  page->skyline = g_array_new (FALSE, FALSE, sizeof (SkylineNode));
+  g_array_append_val (page->skyline, node);
 
-  return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+  return page;
 }
 
-static int can_scooch(struct imgcache_element *one,
-                      struct imgcache_element *two)
+/* Checks whether a rectangle fits on the skyline starting at node @index,
+ * and if so at what height it would rest */
+static gboolean
+skyline_fits (AtlasPage *page,
+              guint      index,
+              gint       width,
+              gint       height,
+              gint      *y)
 {
-  int i,x,y;
+  SkylineNode *node = &g_array_index (page->skyline, SkylineNode, index);
+  gint width_left = width;
 
-  if (!one)
-    return 0;
-  if (!two)
-    return 0;
+  if (node->x + width > page_size)
+    return FALSE;
 
-  if (one->posY != two->posY)
-    return 0;
-  if (one->height != two->height)
-    return 0;
-  if (one->posX + one->width != two->posX)
-    return 0;
+  *y = node->y;
+  while (width_left > 0)
+    {
+      if (index >= page->skyline->len)
+        return FALSE;
 
+      node = &g_array_index (page->skyline, SkylineNode, index);
+      *y = MAX (*y, node->y);
 
-  i = 0;
+      if (*y + height > page_size)
+        return FALSE;
 
-  while (i < one->width && i < two->width) {
-      i ++;
-      for (y = 0; y < one->height; y++) {
-          for (x = 0; x < i; x++ ) {
-              int p1, p2;
-
-              p1 = get_pixel(one, one->width - i + x,y);
-              p2 = get_pixel(two, x, y);
-              if ( p1 != p2)
-                return i-1;
-            }
-        }
+      width_left -= node->width;
+      index++;
     }
-  return i;
-}
-static int do_placement(int maxX)
-{
-  int maxY;
-  int X, Y, baseY;
-  int tempY, tempX, biggestX = -1;
-  struct imgcache_element *element, *element2, *prev = NULL;
-  GList *item, *item2;
-  int workdone = 1;
-
-  maxY = 0;
-
-  X = 0;
-  Y = 0;
 
+  return TRUE;
+}
 
-  while (workdone) {
-      workdone = 0;
-
-      X = 0;
-      item = g_list_first(images);
-      while (item) {
-          int sc;
-          element = item->data;
-          item = g_list_next(item);
-
-          if (element->posX != -1)               /* already placed */
-            continue;
-
-          /* first, check if we fit */
-          if (X + element->width > maxX)
-            continue;
+/* Finds the lowest position for a rectangle, preferring the narrowest
+ * node between equally low ones */
+static gboolean
+skyline_find (AtlasPage *page,
+              gint       width,
+              gint       height,
+              guint     *best_index,
+              gint      *best_y)
+{
+  gint best_bottom = G_MAXINT, best_width = G_MAXINT;
+  guint i;
 
-          tempY = get_effective_Y(X, X + element->width);
+  for (i = 0; i < page->skyline->len; i++)
+    {
+      SkylineNode *node = &g_array_index (page->skyline, SkylineNode, i);
+      gint y;
 
-          element->posX = X;
-          element->posY = tempY;
-          workdone ++;
+      if (!skyline_fits (page, i, width, height, &y))
+        continue;
 
+      if (y + height < best_bottom ||
+          (y + height == best_bottom && node->width < best_width))
+        {
+          best_bottom = y + height;
+          best_width = node->width;
+          *best_index = i;
+          *best_y = y;
+        }
+    }
 
-          sc = can_scooch(prev, element);
+  return best_bottom != G_MAXINT;
+}
 
-          element->posX -= sc;
+static void
+skyline_add (AtlasPage *page,
+             guint      index,
+             gint       width,
+             gint       height,
+             gint       y)
+{
+  SkylineNode node;
+  guint i;
+
+  node.x = g_array_index (page->skyline, SkylineNode, index).x;
+  node.y = y + height;
+  node.width = width;
+  g_array_insert_val (page->skyline, index, node);
+
+  /* shrink or remove the nodes the new one covers */
+  for (i = index + 1; i < page->skyline->len; i++)
+    {
+      SkylineNode *prev = &g_array_index (page->skyline, SkylineNode, i - 1);
+      SkylineNode *cur = &g_array_index (page->skyline, SkylineNode, i);
+      gint shrink;
+
+      if (cur->x >= prev->x + prev->width)
+        break;
 
-          if (element->posY + element->height > maxY)
-            maxY = element->posY + element->height;
+      shrink = prev->x + prev->width - cur->x;
+      cur->x += shrink;
+      cur->width -= shrink;
 
-          prev = element;
+      if (cur->width > 0)
+        break;
 
+      g_array_remove_index (page->skyline, i);
+      i--;
+    }
 
-          /* shortcut .. find other icons that fit us without expanding vertically*/
+  /* merge neighbours at the same height */
+  for (i = 0; i + 1 < page->skyline->len; i++)
+    {
+      SkylineNode *cur = &g_array_index (page->skyline, SkylineNode, i);
+      SkylineNode *next = &g_array_index (page->skyline, SkylineNode, i + 1);
+
+      if (cur->y == next->y)
+        {
+          cur->width += next->width;
+          g_array_remove_index (page->skyline, i + 1);
+          i--;
+        }
+    }
+}
 
-          tempX = X;
-          tempY += element->height;
-repeat:
-          biggestX = -1;
-          item2 = item;
-          baseY = element->posY + element->height;
-          while (item2 && !sc) {
-              element2 = item2->data;
-              item2 = g_list_next(item2);
-              if (element2->posX != -1)
-                continue;
-              if (tempX + element2->width > X + element->width)
-                continue;
-              if (element2->height > maxY - baseY)
-                continue;
+static void
+pack_images (void)
+{
+  GList *l;
+
+  pages = g_ptr_array_new ();
+  images = g_list_sort (images, sort_by_size);
+
+  for (l = images; l; l = l->next)
+    {
+      AtlasImage *image = l->data;
+      gint width, height, y = 0;
+      guint p, index = 0;
+      AtlasPage *page = NULL;
+
+      width = cell_size (image->width);
+      height = cell_size (image->height);
+
+      /* take the first page with room, or start a new one */
+      for (p = 0; p < pages->len; p++)
+        {
+          if (skyline_find (g_ptr_array_index (pages, p), width, height,
+                            &index, &y))
+            {
+              page = g_ptr_array_index (pages, p);
+              break;
+            }
+        }
 
-              tempY = get_effective_Y(tempX, tempX+element2->width);
+      if (!page)
+        {
+          page = atlas_page_new ();
+          g_ptr_array_add (pages, page);
+          skyline_find (page, width, height, &index, &y);
+        }
 
-              if (element2->height > maxY - tempY)
-                continue;
-              element2->posX = tempX;
-              element2->posY = tempY;
+      image->page = p;
+      image->x = g_array_index (page->skyline, SkylineNode, index).x + extrude;
+      image->y = y + extrude;
 
-              if (element2->posX + element2->width > biggestX && element2->width != element->width)
-                biggestX = element2->posX + element2->width;
-              if (element2->width == element->width)
-                biggestX = -1;
-              workdone++;
-              prev = NULL;
-            }
-          if (biggestX > 0) {
-              tempX = biggestX;
-              goto repeat;
-            }
-          X = element->posX +  element->width;
-        }
-    }
+      skyline_add (page, index, width, height, y);
 
-  X = 0;
-  Y = 0;
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX + element->width > X)
-        X = element->posX + element->width;
-      if (element->posY + element->height > Y)
-        Y = element->posY + element->height;
+      /* the trailing padding isn't needed at the edges of the page */
+      page->width = MAX (page->width, image->x + image->width + extrude);
+      page->height = MAX (page->height, image->y + image->height + extrude);
     }
 
-  /* penalties for getting too big for a texture */
-  if (X > 2048)
-    X *= 4;
-  if (Y > 2048)
-    Y *= 4;
-  return X * Y;
+  if (verbose)
+    printf ("Packed %u images in to %u pages\n",
+            g_list_length (images), pages->len);
 }
 
-static void clear_placement(void)
+/* Copies @image, with its extruded edges, on to a premultiplied page */
+static void
+blit_image (AtlasImage *image,
+            guchar     *data,
+            gint        stride)
 {
-  struct imgcache_element *element;
-  GList *item;
-
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      element->posX = -1;
-      element->posY = -1;
+  const guchar *pixels = gdk_pixbuf_get_pixels (image->pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride (image->pixbuf);
+  gint x, y;
+
+  for (y = -extrude; y < image->height + extrude; y++)
+    {
+      const guchar *src_row;
+      guchar *dst;
+      gint sy = CLAMP (y, 0, image->height - 1);
+
+      src_row = pixels + sy * rowstride;
+      dst = data + (image->y + y) * stride + (image->x - extrude) * 4;
+
+      for (x = -extrude; x < image->width + extrude; x++)
+        {
+          const guchar *src = src_row + CLAMP (x, 0, image->width - 1) * 4;
+          guint a = src[3];
+
+          dst[0] = (src[0] * a + 127) / 255;
+          dst[1] = (src[1] * a + 127) / 255;
+          dst[2] = (src[2] * a + 127) / 255;
+          dst[3] = a;
+          dst += 4;
+        }
     }
 }
 
-static void optimal_placement(void)
+static gchar *
+write_page (guint        index,
+            const gchar *prefix)
 {
-  int bestX = -1;
-  int best_score = INT_MAX;
-  int score;
-  int i;
-  int minX;
-  i = 0;
-
-  /* skip X values that would lead to a too large Y dimension */
-  minX = totalarea / 2048;
-
-  if (minX > 1000)
-    minX = 0;
-  while (sizes[i] > 0) {
-      if (sizes[i] < minX) {
-          i++;
-          continue;
-        }
-      score = do_placement(sizes[i]);
-      if (score < best_score) {
-          bestX = sizes[i];
-          best_score = score;
-        }
-      clear_placement();
-      i++;
-    }
+  AtlasPage *page = g_ptr_array_index (pages, index);
+  GError *error = NULL;
+  gchar *filename;
+  guchar *data;
+  gsize size;
+  GList *l;
 
-  do_placement(bestX);
-  printf("Best score is %i, %0.1f %% waste\n", best_score, (100.0*best_score / totalarea) -100.0);
-}
+  size = (gsize) page->width * page->height * 4;
+  data = g_malloc0 (size);
 
-static int make_final_image(char *filename)
-{
-  int maxX = 0, maxY = 0;
-  struct imgcache_element *element;
-  GList *item;
-  GdkPixbuf *final;
-
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX + element->width > maxX)
-        maxX = element->posX + element->width;
-      if (element->posY + element->height > maxY)
-        maxY = element->posY + element->height;
-    }
+  for (l = images; l; l = l->next)
+    {
+      AtlasImage *image = l->data;
 
-  printf("Final image is %ix%i\n", maxX, maxY);
+      if (image->page == (gint) index)
+        blit_image (image, data, page->width * 4);
+    }
 
-  if (!maxX)
-    return 0;
-  if (!maxY)
-    return 0;
-  final = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, maxX, maxY);
-  assert(final != NULL);
+  filename = g_strdup_printf ("%s-%u.rgba", prefix, index);
 
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX == -1)
-        continue;
-      gdk_pixbuf_copy_area(element->ptr, 0, 0, element->width, element->height, final, element->posX, element->posY);
+  if (!g_file_set_contents (filename, (gchar *) data, size, &error))
+    {
+      fprintf (stderr, "Cannot write atlas page: %s\n", error->message);
+      g_error_free (error);
+      g_free (filename);
+      filename = NULL;
     }
+  else if (verbose)
+    printf ("Page %u is %ix%i\n", index, page->width, page->height);
 
-  gdk_pixbuf_save(final, filename, "png", NULL, NULL);
-  return 1;
+  g_free (data);
+
+  return filename;
 }
 
-static void makecache(char *directory,
-                      int   recurse)
+static void
+makecache (const gchar *directory,
+           gboolean     recurse)
 {
   GDir *dir;
   GError *error = NULL;
+  const gchar *name;
 
   dir = g_dir_open (directory, 0, &error);
-  if (!dir) {
-      printf("Error opening %s: %s\n", directory, error->message);
+  if (!dir)
+    {
+      printf ("Error opening %s: %s\n", directory, error->message);
       g_clear_error (&error);
       return;
     }
 
-  while (TRUE) {
-      const char *name = g_dir_read_name (dir);
-      char *fullpath = g_build_filename (directory, name, NULL);
+  while ((name = g_dir_read_name (dir)))
+    {
+      gchar *fullpath;
 
-      if (!name)
-        break;
       if (name[0] == '.')
         continue;
-      if (recurse && g_file_test (fullpath, G_FILE_TEST_IS_DIR)) {
-          makecache(fullpath, recurse);
-        }
 
-      if (recurse && g_file_test (fullpath, G_FILE_TEST_IS_REGULAR)) {
-          do_one_file(fullpath);
-        }
+      fullpath = g_build_filename (directory, name, NULL);
+
+      if (recurse && g_file_test (fullpath, G_FILE_TEST_IS_DIR))
+        makecache (fullpath, recurse);
+
+      if (recurse && g_file_test (fullpath, G_FILE_TEST_IS_REGULAR))
+        do_one_file (fullpath);
 
       g_free (fullpath);
-  }
+    }
 
   g_dir_close (dir);
+}
+
+static guint32
+add_string (GString     *strings,
+            const gchar *string)
+{
+  guint32 offset = strings->len;
+
+  g_string_append_len (strings, string, strlen (string) + 1);
+
+  return GUINT32_TO_LE (offset);
+}
+
+static gchar *
+filename_to_uri (const gchar *filename)
+{
+  gchar *cwd, *path, *uri;
+
+  if (g_path_is_absolute (filename))
+    return g_filename_to_uri (filename, NULL, NULL);
 
-  images = g_list_sort(images, sort_by_size);
+  cwd = g_get_current_dir ();
+  path = g_build_filename (cwd, filename, NULL);
+  uri = g_filename_to_uri (path, NULL, NULL);
+  g_free (path);
+  g_free (cwd);
+
+  return uri;
 }
 
-static void write_cache_file(char *directory,
-                             char *pngfile)
+/* writes the atlas index described in mx-texture-cache-index.h */
+static gboolean
+write_cache_file (const gchar  *directory,
+                  gchar       **page_files)
 {
+  MxTextureCacheIndexHeader header;
+  GArray *index_pages, *entries;
+  guint32 *buckets;
+  guint32 n_buckets, offset, i;
+  GString *strings;
+  gboolean success;
+  gchar *filename;
+  GList *l;
   FILE *file;
-  char *filename = NULL;
-  struct imgcache_element element;
-  struct imgcache_element *elm;
-  GList *item;
 
-  memset(&element, 0, sizeof(element));
+  index_pages = g_array_new (FALSE, TRUE, sizeof (MxTextureCacheIndexPage));
+  entries = g_array_new (FALSE, TRUE, sizeof (MxTextureCacheIndexEntry));
+  strings = g_string_new (NULL);
+
+  for (i = 0; i < pages->len; i++)
+    {
+      AtlasPage *page = g_ptr_array_index (pages, i);
+      MxTextureCacheIndexPage index_page;
+
+      memset (&index_page, 0, sizeof (index_page));
+      index_page.filename = add_string (strings, page_files[i]);
+      index_page.format =
+        GUINT32_TO_LE (MX_TEXTURE_CACHE_INDEX_PAGE_RGBA_PREMULTIPLIED);
+      index_page.width = GUINT32_TO_LE (page->width);
+      index_page.height = GUINT32_TO_LE (page->height);
+      g_array_append_val (index_pages, index_page);
+    }
+
+  for (l = images; l; l = l->next)
+    {
+      AtlasImage *image = l->data;
+      MxTextureCacheIndexEntry entry;
+      gchar *uri;
 
-  strcpy(&element.filename[0], pngfile);
+      uri = filename_to_uri (image->filename);
+      if (!uri)
+        continue;
 
-  filename = g_strdup_printf("%s/mx.cache", directory);
+      memset (&entry, 0, sizeof (entry));
+      entry.hash = g_str_hash (uri);
+      entry.uri = add_string (strings, uri);
+      entry.page = GUINT32_TO_LE (image->page);
+      entry.x = GUINT32_TO_LE (image->x);
+      entry.y = GUINT32_TO_LE (image->y);
+      entry.width = GUINT32_TO_LE (image->width);
+      entry.height = GUINT32_TO_LE (image->height);
+      g_array_append_val (entries, entry);
+
+      g_free (uri);
+    }
 
-  file = fopen(filename, "w");
-  if (!file) {
-      fprintf(stderr, "Cannot write cache file: %s\n", filename);
-      g_free (filename);
-      return;
+  /* chain the entries in to the hash buckets */
+  n_buckets = MAX (entries->len, 1);
+  buckets = g_new (guint32, n_buckets);
+  for (i = 0; i < n_buckets; i++)
+    buckets[i] = GUINT32_TO_LE (MX_TEXTURE_CACHE_INDEX_NONE);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      MxTextureCacheIndexEntry *entry;
+      guint32 bucket;
+
+      entry = &g_array_index (entries, MxTextureCacheIndexEntry, i);
+      bucket = entry->hash % n_buckets;
+
+      entry->next = buckets[bucket];
+      entry->hash = GUINT32_TO_LE (entry->hash);
+      buckets[bucket] = GUINT32_TO_LE (i);
     }
-  fwrite(&element, 1, sizeof(element), file);
-
-  item = g_list_first(images);
-  while (item) {
-      elm = item->data;
-      item = g_list_next(item);
-      elm->ptr = NULL;
-      fwrite(elm, 1, sizeof(element), file);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, MX_TEXTURE_CACHE_INDEX_MAGIC, sizeof (header.magic));
+  header.version = GUINT32_TO_LE (MX_TEXTURE_CACHE_INDEX_VERSION);
+
+  offset = sizeof (header);
+  header.n_pages = GUINT32_TO_LE (index_pages->len);
+  header.pages_offset = GUINT32_TO_LE (offset);
+  offset += index_pages->len * sizeof (MxTextureCacheIndexPage);
+  header.n_entries = GUINT32_TO_LE (entries->len);
+  header.entries_offset = GUINT32_TO_LE (offset);
+  offset += entries->len * sizeof (MxTextureCacheIndexEntry);
+  header.n_buckets = GUINT32_TO_LE (n_buckets);
+  header.buckets_offset = GUINT32_TO_LE (offset);
+  offset += n_buckets * sizeof (guint32);
+  header.strings_size = GUINT32_TO_LE (strings->len);
+  header.strings_offset = GUINT32_TO_LE (offset);
+
+  filename = g_build_filename (directory, "mx.cache", NULL);
+
+  file = fopen (filename, "wb");
+  if (file)
+    {
+      success =
+        (fwrite (&header, sizeof (header), 1, file) == 1 &&
+         fwrite (index_pages->data, sizeof (MxTextureCacheIndexPage),
+                 index_pages->len, file) == index_pages->len &&
+         fwrite (entries->data, sizeof (MxTextureCacheIndexEntry),
+                 entries->len, file) == entries->len &&
+         fwrite (buckets, sizeof (guint32), n_buckets, file) == n_buckets &&
+         fwrite (strings->str, 1, strings->len, file) == strings->len);
+
+      if (fclose (file) != 0)
+        success = FALSE;
+
+      /* don't leave a truncated index for the library to find */
+      if (!success)
+        {
+          fprintf (stderr, "Cannot write cache file: %s\n", filename);
+          g_unlink (filename);
+        }
+    }
+  else
+    {
+      fprintf (stderr, "Cannot write cache file: %s\n", filename);
+      success = FALSE;
     }
+
   g_free (filename);
-  fclose(file);
+  g_free (buckets);
+  g_string_free (strings, TRUE);
+  g_array_free (entries, TRUE);
+  g_array_free (index_pages, TRUE);
 
+  return success;
 }
 
-int main(int    argc,
-         char **argv)
+int
+main (int    argc,
+      char **argv)
 {
-  char *image_file = NULL;
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar **page_files;
+  gchar *prefix;
+  guint i;
+  gboolean success = TRUE;
+
+  context = g_option_context_new ("DIRECTORY - create a texture atlas cache");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  if (argc <= 1 || page_size <= 0 || padding < 0 || extrude < 0)
+    {
+      gchar *help = g_option_context_get_help (context, TRUE, NULL);
 
-  if (argc <= 1) {
-      printf("Usage:\n\t\tmakecache <directory>\n");
+      printf ("%s", help);
+      g_free (help);
       return EXIT_FAILURE;
     }
-  g_type_init();
-  makecache(argv[1], 1);
-  optimal_placement();
-  image_file = g_strdup_printf("/var/cache/mx/%08x.png", g_str_hash(argv[1]));
-  if (make_final_image(image_file))
-    write_cache_file(argv[1], image_file);
-  g_free (image_file);
-  return EXIT_SUCCESS;
+
+  g_option_context_free (context);
+
+#if !GLIB_CHECK_VERSION (2, 35, 1)
+  g_type_init ();
+#endif
+
+  makecache (argv[1], TRUE);
+
+  if (!images)
+    {
+      printf ("No images found in %s\n", argv[1]);
+      return EXIT_SUCCESS;
+    }
+
+  pack_images ();
+
+  prefix = g_strdup_printf ("%s/%08x", output_dir ? output_dir : "/var/cache/mx",
+                            g_str_hash (argv[1]));
+  page_files = g_new0 (gchar *, pages->len + 1);
+
+  for (i = 0; i < pages->len; i++)
+    {
+      page_files[i] = write_page (i, prefix);
+      if (!page_files[i])
+        {
+          success = FALSE;
+          break;
+        }
+    }
+
+  if (success)
+    success = write_cache_file (argv[1], page_files);
+
+  g_strfreev (page_files);
+  g_free (prefix);
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
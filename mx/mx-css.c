@@ -19,6 +19,7 @@
  */
 #include "mx-css.h"
 #include <clutter/clutter.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <unistd.h>
@@ -31,6 +32,48 @@ struct _MxStyleSheet
   GList *selectors;
   GList *styles;
   GList *filenames;
+
+  /* The selector index files each selector under the most specific part of
+   * its right-most simple selector (id, then class, then type, then the first
+   * pseudo-class). Selectors with none of those go in the universal list.
+   * Matching a node then only has to consider the buckets the node can fall
+   * in to, rather than every selector in the sheet.
+   */
+  gboolean    index_valid;
+  GHashTable *id_index;
+  GHashTable *class_index;
+  GHashTable *type_index;
+  GList      *pseudo_class_index[MX_PSEUDO_CLASS_MAX_ATOMS + 1];
+  GList      *universal_index;
+
+  /* The property sets currently in use, keyed on the sequence of rulesets
+   * they were built from, so that equal match results are shared. */
+  GHashTable *properties;
+
+  /* compiled style sheets whose strings are referenced by the selectors
+   * and values */
+  GList *blobs;
+};
+
+typedef struct
+{
+  GQuark             name;
+  MxStyleSheetValue *value;
+} MxStyleSheetProperty;
+
+/* The computed result of matching a node against the sheet. It is immutable
+ * once built and holds the declarations in order of their interned names. */
+struct _MxStyleSheetProperties
+{
+  gint                  ref_count;
+  MxStyleSheet         *sheet;
+
+  guint                 hash;
+  guint                 n_styles;
+  GHashTable          **styles;
+
+  guint                 n_properties;
+  MxStyleSheetProperty *properties;
 };
 
 typedef struct _MxSelector MxSelector;
@@ -40,6 +83,14 @@ struct _MxSelector
   gchar *id;
   gchar *class;
   gchar *pseudo_class;
+
+  /* interned versions of the above, used for matching */
+  GQuark  type_quark;
+  GQuark  id_quark;
+  GQuark  class_quark;
+  guint64 pseudo_classes;
+  gint    n_pseudo_classes;
+
   MxSelector *parent;
   MxSelector *ancestor;
   GHashTable *style;
@@ -47,20 +98,35 @@ struct _MxSelector
   guint line;
   guint position;
   gint priority;
+
+  /* the strings point in to a compiled style sheet rather than being owned
+   * by the selector */
+  gboolean borrowed;
 };
 
 
 /* MxStyleSheetValue */
 
 static MxStyleSheetValue *
-mx_style_sheet_value_new ()
+mx_style_sheet_value_new (gchar       *string,
+                          const gchar *source)
 {
-  return g_slice_new0 (MxStyleSheetValue);
+  MxStyleSheetValue *value = g_slice_new0 (MxStyleSheetValue);
+
+  value->string = string;
+  value->source = source;
+
+  return value;
 }
 
 static void
 mx_style_sheet_value_free (MxStyleSheetValue *value)
 {
+  if (value->cached_type != G_TYPE_INVALID)
+    g_value_unset (&value->cached_value);
+
+  if (!value->borrowed)
+    g_free (value->string);
   g_slice_free (MxStyleSheetValue, value);
 }
 
@@ -202,9 +268,18 @@ css_parse_style (GScanner *scanner, GHashTable *table)
 
       token = css_parse_key_value (scanner, &key, &value);
       if (token != G_TOKEN_NONE)
-        return token;
+        {
+          g_free (key);
+          g_free (value);
+          return token;
+        }
 
-      g_hash_table_insert (table, key, value);
+      /* the declarations are shared by every match of the ruleset, so that
+       * values only need to be converted from strings once */
+      g_hash_table_insert (table, GUINT_TO_POINTER (g_quark_from_string (key)),
+                           mx_style_sheet_value_new (value,
+                                                     scanner->input_name));
+      g_free (key);
 
       token = g_scanner_peek_next_token (scanner);
     }
@@ -218,6 +293,19 @@ css_parse_style (GScanner *scanner, GHashTable *table)
 }
 
 
+static void
+mx_selector_intern (MxSelector *selector)
+{
+  if (selector->type && selector->type[0] != '*')
+    selector->type_quark = g_quark_from_string (selector->type);
+
+  selector->id_quark = g_quark_from_string (selector->id);
+  selector->class_quark = g_quark_from_string (selector->class);
+  selector->pseudo_classes =
+    _mx_stylable_pseudo_class_to_mask (selector->pseudo_class,
+                                       &selector->n_pseudo_classes);
+}
+
 static GTokenType
 css_parse_simple_selector (GScanner      *scanner,
                            MxSelector    *selector)
@@ -285,11 +373,15 @@ css_parse_simple_selector (GScanner      *scanner,
 
           /* unhandled */
         default:
+          mx_selector_intern (selector);
           return G_TOKEN_NONE;
           break;
         }
       token = g_scanner_peek_next_token (scanner);
     }
+
+  mx_selector_intern (selector);
+
   return G_TOKEN_NONE;
 }
 
@@ -374,12 +466,16 @@ mx_selector_free (MxSelector *selector)
   if (!selector)
     return;
 
-  g_free (selector->type);
-  g_free (selector->id);
-  g_free (selector->class);
-  g_free (selector->pseudo_class);
+  if (!selector->borrowed)
+    {
+      g_free (selector->type);
+      g_free (selector->id);
+      g_free (selector->class);
+      g_free (selector->pseudo_class);
+    }
 
   mx_selector_free (selector->parent);
+  mx_selector_free (selector->ancestor);
 
   g_slice_free (MxSelector, selector);
 }
@@ -495,8 +591,8 @@ css_parse_block (GScanner *scanner, GList **selectors, GList **styles)
     return token;
 
 
-  /* create a hash table for the properties */
-  table = g_hash_table_new_full (g_str_hash, g_direct_equal, g_free,
+  /* create a hash table for the properties, keyed on their interned names */
+  table = g_hash_table_new_full (NULL, NULL, NULL,
                                  (GDestroyNotify) mx_style_sheet_value_free);
 
   token = css_parse_style (scanner, table);
@@ -620,6 +716,46 @@ list_contains (const gchar *needle,
   return FALSE;
 }
 
+static gboolean
+css_node_matches_pseudo_classes (MxSelector *selector,
+                                 MxStylable *stylable)
+{
+  const gchar *pseudo_class;
+  gchar *needle;
+
+  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+
+  /* if no pseudo class is supplied on the node, return instantly */
+  if (!pseudo_class)
+    return FALSE;
+
+  for (needle = selector->pseudo_class;
+       needle; needle = strchr (needle, ':'))
+    {
+      gint needle_len;
+      gchar *next;
+
+      /* move beyond ':' */
+      if (needle[0] == ':')
+        needle++;
+
+      /* calculate the length of this needle */
+      next = strchr (needle, ':');
+      if (next)
+        needle_len = next - needle;
+      else
+        needle_len = strlen (needle);
+
+      /* if the pseudo-class from the selector does not appear in the
+       * list of pseudo-classes from the node, then this is not a
+       * match */
+      if (!list_contains (needle, needle_len, pseudo_class, ':'))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gint
 css_node_matches_selector (MxSelector *selector,
                            MxStylable *stylable)
@@ -627,9 +763,6 @@ css_node_matches_selector (MxSelector *selector,
   gint score;
   gint a, b, c;
 
-  const gchar *type = "*";
-  const gchar *class, *pseudo_class;
-  const gchar *id;
   ClutterActor *actor;
   MxStylable *parent;
 
@@ -637,13 +770,8 @@ css_node_matches_selector (MxSelector *selector,
   b = 0;
   c = 0;
 
-  /* get properties for this stylable */
-  id = clutter_actor_get_name (CLUTTER_ACTOR (stylable));
-  class = mx_stylable_get_style_class (stylable);
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
-
   /* check type */
-  if (selector->type == NULL || selector->type[0] == '*')
+  if (!selector->type_quark)
     {
       /* NULL or universal selector match, but are ignored for score */
     }
@@ -654,13 +782,12 @@ css_node_matches_selector (MxSelector *selector,
       gint depth;
 
       type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-      type = g_type_name (type_id);
       matched = FALSE;
 
       depth = 10;
-      while (type)
+      while (type_id)
         {
-          if (!strcmp (selector->type, type))
+          if (selector->type_quark == g_type_qname (type_id))
             {
               matched = depth;
               break;
@@ -668,7 +795,6 @@ css_node_matches_selector (MxSelector *selector,
           else
             {
               type_id = g_type_parent (type_id);
-              type = g_type_name (type_id);
               if (depth > 1)
                 depth--;
             }
@@ -681,63 +807,46 @@ css_node_matches_selector (MxSelector *selector,
     }
 
   /* check id */
-  if (selector->id)
+  if (selector->id_quark)
     {
-      if (!id || strcmp (selector->id, id))
+      const gchar *id = clutter_actor_get_name (CLUTTER_ACTOR (stylable));
+
+      if (!id || g_quark_try_string (id) != selector->id_quark)
         return -1;
       else
         a += 10;
     }
 
   /* check pseudo_class */
-  if (selector->pseudo_class)
+  if (selector->n_pseudo_classes)
     {
-      gchar *needle;
-      gint n_matches;
+      guint64 pseudo_classes;
 
-      /* if no pseudo class is supplied on the node, return instantly */
-      if (!pseudo_class)
-        return -1;
+      pseudo_classes = _mx_stylable_get_style_pseudo_class_mask (stylable);
 
       /* check that each pseudo-class from the selector appears in the
-       * pseudo-classes from the node, i.e. the selector pseudo-class list
-       * is a subset of the node's pseudo-class list */
-      n_matches = 0;
-      for (needle = selector->pseudo_class;
-           needle; needle = strchr (needle, ':'))
-        {
-          gint needle_len;
-          gchar *next;
-
-          /* move beyond ':' */
-          if (needle[0] == ':')
-            needle++;
-
-          /* calculate the length of this needle */
-          next = strchr (needle, ':');
-          if (next)
-            needle_len = next - needle;
-          else
-            needle_len = strlen (needle);
+       * pseudo-classes from the node, i.e. the selector pseudo-class set
+       * is a subset of the node's pseudo-class set */
+      if ((selector->pseudo_classes & pseudo_classes)
+          != selector->pseudo_classes)
+        return -1;
 
-          /* if the pseudo-class from the selector does not appear in the
-           * list of pseudo-classes from the node, then this is not a
-           * match */
-          if (!list_contains (needle, needle_len, pseudo_class, ':'))
-            return -1;
-          else
-            n_matches++;
-        }
+      /* pseudo-classes that could not be interned have to be compared as
+       * strings */
+      if (G_UNLIKELY (selector->pseudo_classes & MX_PSEUDO_CLASS_OVERFLOW)
+          && !css_node_matches_pseudo_classes (selector, stylable))
+        return -1;
 
       /* increase the 'b' score by the number of pseudo-classes in the
        * selector */
-      b = b + (10 * n_matches);
+      b = b + (10 * selector->n_pseudo_classes);
     }
 
   /* check class */
-  if (selector->class)
+  if (selector->class_quark)
     {
-      if (!class || strcmp (selector->class, class))
+      if (_mx_stylable_get_style_class_quark (stylable)
+          != selector->class_quark)
         return -1;
       else
         b += 10;
@@ -838,24 +947,187 @@ compare_selector_matches (SelectorMatch *a,
     return 0;
 }
 
-struct _css_table_copy_data
+static void
+css_table_copy (gpointer    key,
+                gpointer    value,
+                GHashTable *table)
 {
-  GHashTable *table;
-  const gchar *filename;
-};
+  g_hash_table_insert (table, key, value);
+}
+
+static guint
+mx_style_sheet_properties_hash (gconstpointer data)
+{
+  const MxStyleSheetProperties *properties = data;
+
+  return properties->hash;
+}
+
+static gboolean
+mx_style_sheet_properties_equal (gconstpointer a,
+                                 gconstpointer b)
+{
+  const MxStyleSheetProperties *properties_a = a;
+  const MxStyleSheetProperties *properties_b = b;
+
+  return (properties_a->n_styles == properties_b->n_styles &&
+          !memcmp (properties_a->styles, properties_b->styles,
+                   properties_a->n_styles * sizeof (GHashTable *)));
+}
+
+static gint
+mx_style_sheet_property_compare (const MxStyleSheetProperty *a,
+                                 const MxStyleSheetProperty *b)
+{
+  return (a->name < b->name) ? -1 : (a->name > b->name);
+}
 
 static void
-css_table_copy (gpointer                    *key,
-                gpointer                    *value,
-                struct _css_table_copy_data *data)
+mx_style_sheet_properties_fill (MxStyleSheetProperties *properties)
+{
+  GHashTableIter iter;
+  GHashTable *merged;
+  gpointer name, value;
+  guint i;
+
+  /* merge the rulesets, later (more specific) ones take precedence */
+  merged = g_hash_table_new (NULL, NULL);
+  for (i = 0; i < properties->n_styles; i++)
+    g_hash_table_foreach (properties->styles[i], (GHFunc) css_table_copy,
+                          merged);
+
+  properties->n_properties = g_hash_table_size (merged);
+  properties->properties = g_new (MxStyleSheetProperty,
+                                  properties->n_properties);
+
+  i = 0;
+  g_hash_table_iter_init (&iter, merged);
+  while (g_hash_table_iter_next (&iter, &name, &value))
+    {
+      properties->properties[i].name = GPOINTER_TO_UINT (name);
+      properties->properties[i].value = value;
+      i++;
+    }
+
+  qsort (properties->properties, properties->n_properties,
+         sizeof (MxStyleSheetProperty),
+         (GCompareFunc) mx_style_sheet_property_compare);
+
+  g_hash_table_destroy (merged);
+}
+
+/* Returns the property set for the given sequence of matched selectors,
+ * sharing an existing set built from the same rulesets if there is one */
+static MxStyleSheetProperties *
+mx_style_sheet_properties_get (MxStyleSheet *sheet,
+                               GList        *matching_selectors)
+{
+  MxStyleSheetProperties template, *properties;
+  GHashTable *last_style;
+  GList *l;
+  guint i;
+
+  template.styles = g_newa (GHashTable *, g_list_length (matching_selectors));
+  template.n_styles = 0;
+  template.hash = 0;
+
+  last_style = NULL;
+  for (l = matching_selectors; l; l = l->next)
+    {
+      SelectorMatch *match = l->data;
+
+      /* selectors from the same ruleset add the same declarations */
+      if (match->selector->style == last_style)
+        continue;
+
+      last_style = match->selector->style;
+      template.styles[template.n_styles++] = last_style;
+      template.hash = (template.hash * 31) + GPOINTER_TO_UINT (last_style);
+    }
+
+  if (!sheet->properties)
+    sheet->properties = g_hash_table_new (mx_style_sheet_properties_hash,
+                                          mx_style_sheet_properties_equal);
+
+  properties = g_hash_table_lookup (sheet->properties, &template);
+  if (properties)
+    return mx_style_sheet_properties_ref (properties);
+
+  properties = g_slice_new (MxStyleSheetProperties);
+  properties->ref_count = 1;
+  properties->sheet = sheet;
+  properties->hash = template.hash;
+  properties->n_styles = template.n_styles;
+  properties->styles = g_memdup (template.styles,
+                                 template.n_styles * sizeof (GHashTable *));
+
+  mx_style_sheet_properties_fill (properties);
+
+  g_hash_table_insert (sheet->properties, properties, properties);
+
+  return properties;
+}
+
+MxStyleSheetProperties *
+mx_style_sheet_properties_ref (MxStyleSheetProperties *properties)
+{
+  properties->ref_count ++;
+
+  return properties;
+}
+
+void
+mx_style_sheet_properties_unref (MxStyleSheetProperties *properties)
 {
-  MxStyleSheetValue *css_value;
+  if (--properties->ref_count > 0)
+    return;
+
+  if (properties->sheet)
+    g_hash_table_remove (properties->sheet->properties, properties);
 
-  css_value = mx_style_sheet_value_new ();
-  css_value->source = data->filename;
-  css_value->string = (gchar*) value;
+  g_free (properties->styles);
+  g_free (properties->properties);
+  g_slice_free (MxStyleSheetProperties, properties);
+}
 
-  g_hash_table_insert (data->table, key, css_value);
+/* the memory used by the set itself, not by the values it points to, which
+ * belong to the style sheet */
+gsize
+mx_style_sheet_properties_size (MxStyleSheetProperties *properties)
+{
+  return sizeof (MxStyleSheetProperties) +
+    properties->n_styles * sizeof (GHashTable *) +
+    properties->n_properties * sizeof (MxStyleSheetProperty);
+}
+
+MxStyleSheetValue *
+mx_style_sheet_properties_lookup (MxStyleSheetProperties *properties,
+                                  const gchar            *name)
+{
+  GQuark quark;
+  gint low, high;
+
+  /* a name that has never been interned can't be in the style sheet */
+  quark = g_quark_try_string (name);
+  if (!quark)
+    return NULL;
+
+  low = 0;
+  high = (gint) properties->n_properties - 1;
+  while (low <= high)
+    {
+      gint middle = (low + high) / 2;
+      GQuark middle_name = properties->properties[middle].name;
+
+      if (middle_name == quark)
+        return properties->properties[middle].value;
+      else if (middle_name < quark)
+        low = middle + 1;
+      else
+        high = middle - 1;
+    }
+
+  return NULL;
 }
 
 static void
@@ -864,14 +1136,208 @@ free_selector_match (SelectorMatch *data)
   g_slice_free (SelectorMatch, data);
 }
 
-GHashTable *
+/* returns the index of the next atom after @nth in @mask, or -1 */
+static gint
+css_pseudo_class_next_atom (guint64 mask,
+                            gint    nth)
+{
+  while (++nth <= MX_PSEUDO_CLASS_MAX_ATOMS)
+    {
+      if (mask & ((guint64) 1 << nth))
+        return nth;
+    }
+
+  return -1;
+}
+
+static void
+mx_style_sheet_index_add (GHashTable *index,
+                          GQuark      key,
+                          MxSelector *selector)
+{
+  GList *bucket;
+
+  bucket = g_hash_table_lookup (index, GUINT_TO_POINTER (key));
+  bucket = g_list_prepend (bucket, selector);
+  g_hash_table_insert (index, GUINT_TO_POINTER (key), bucket);
+}
+
+static void
+mx_style_sheet_index_free_bucket (gpointer key,
+                                  GList    *bucket,
+                                  gpointer  user_data)
+{
+  g_list_free (bucket);
+}
+
+static void
+mx_style_sheet_index_clear (MxStyleSheet *sheet)
+{
+  GHashTable **indexes[] = { &sheet->id_index, &sheet->class_index,
+                             &sheet->type_index };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (indexes); i++)
+    {
+      if (*indexes[i])
+        {
+          g_hash_table_foreach (*indexes[i],
+                                (GHFunc) mx_style_sheet_index_free_bucket,
+                                NULL);
+          g_hash_table_destroy (*indexes[i]);
+          *indexes[i] = NULL;
+        }
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (sheet->pseudo_class_index); i++)
+    {
+      g_list_free (sheet->pseudo_class_index[i]);
+      sheet->pseudo_class_index[i] = NULL;
+    }
+
+  g_list_free (sheet->universal_index);
+  sheet->universal_index = NULL;
+
+  sheet->index_valid = FALSE;
+}
+
+static void
+mx_style_sheet_index_build (MxStyleSheet *sheet)
+{
+  GList *l;
+
+  mx_style_sheet_index_clear (sheet);
+
+  sheet->id_index = g_hash_table_new (NULL, NULL);
+  sheet->class_index = g_hash_table_new (NULL, NULL);
+  sheet->type_index = g_hash_table_new (NULL, NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    {
+      MxSelector *selector = l->data;
+
+      if (selector->id_quark)
+        mx_style_sheet_index_add (sheet->id_index, selector->id_quark,
+                                  selector);
+      else if (selector->class_quark)
+        mx_style_sheet_index_add (sheet->class_index, selector->class_quark,
+                                  selector);
+      else if (selector->type_quark)
+        mx_style_sheet_index_add (sheet->type_index, selector->type_quark,
+                                  selector);
+      else if (selector->pseudo_classes)
+        {
+          /* file the selector under the first of its pseudo-class atoms,
+           * all the others have to be present on the node as well for a
+           * match */
+          gint atom = css_pseudo_class_next_atom (selector->pseudo_classes,
+                                                 -1);
+
+          sheet->pseudo_class_index[atom] =
+            g_list_prepend (sheet->pseudo_class_index[atom], selector);
+        }
+      else
+        sheet->universal_index = g_list_prepend (sheet->universal_index,
+                                                 selector);
+    }
+
+  sheet->index_valid = TRUE;
+
+  MX_NOTE (CSS, "Indexed %d selectors: %d ids, %d classes, %d types, "
+           "%d universal",
+           g_list_length (sheet->selectors),
+           g_hash_table_size (sheet->id_index),
+           g_hash_table_size (sheet->class_index),
+           g_hash_table_size (sheet->type_index),
+           g_list_length (sheet->universal_index));
+}
+
+static void
+mx_style_sheet_match_bucket (GList       *bucket,
+                             MxStylable  *node,
+                             GList      **matching_selectors)
+{
+  GList *l;
+
+  for (l = bucket; l; l = l->next)
+    {
+      gint score;
+
+      score = css_node_matches_selector (l->data, node);
+
+      if (score >= 0)
+        {
+          SelectorMatch *selector_match = g_slice_new (SelectorMatch);
+          selector_match->selector = l->data;
+          selector_match->score = score;
+          *matching_selectors = g_list_prepend (*matching_selectors,
+                                                selector_match);
+        }
+    }
+}
+
+static GList *
+mx_style_sheet_find_matches (MxStyleSheet *sheet,
+                             MxStylable   *node)
+{
+  GList *matching_selectors = NULL;
+  const gchar *id;
+  guint64 pseudo_classes;
+  GQuark class;
+  GList *bucket;
+  GType type_id;
+  gint atom;
+
+  if (!sheet->index_valid)
+    mx_style_sheet_index_build (sheet);
+
+  id = clutter_actor_get_name (CLUTTER_ACTOR (node));
+  class = _mx_stylable_get_style_class_quark (node);
+  pseudo_classes = _mx_stylable_get_style_pseudo_class_mask (node);
+
+  if (id)
+    {
+      bucket = g_hash_table_lookup (sheet->id_index,
+                                    GUINT_TO_POINTER (g_quark_try_string (id)));
+      mx_style_sheet_match_bucket (bucket, node, &matching_selectors);
+    }
+
+  if (class)
+    {
+      bucket = g_hash_table_lookup (sheet->class_index,
+                                    GUINT_TO_POINTER (class));
+      mx_style_sheet_match_bucket (bucket, node, &matching_selectors);
+    }
+
+  /* type selectors also match sub-types, so try the whole type chain */
+  for (type_id = G_OBJECT_TYPE (node);
+       type_id;
+       type_id = g_type_parent (type_id))
+    {
+      bucket = g_hash_table_lookup (sheet->type_index,
+                                    GUINT_TO_POINTER (g_type_qname (type_id)));
+      mx_style_sheet_match_bucket (bucket, node, &matching_selectors);
+    }
+
+  for (atom = css_pseudo_class_next_atom (pseudo_classes, -1);
+       atom != -1;
+       atom = css_pseudo_class_next_atom (pseudo_classes, atom))
+    mx_style_sheet_match_bucket (sheet->pseudo_class_index[atom], node,
+                                 &matching_selectors);
+
+  mx_style_sheet_match_bucket (sheet->universal_index, node,
+                               &matching_selectors);
+
+  return matching_selectors;
+}
+
+MxStyleSheetProperties *
 mx_style_sheet_get_properties (MxStyleSheet *sheet,
                                MxStylable   *node)
 {
   GTimer *timer = NULL;
-  GList *l, *matching_selectors = NULL;
-  SelectorMatch *selector_match = NULL;
-  GHashTable *result;
+  GList *l, *matching_selectors;
+  MxStyleSheetProperties *result;
 
   if (_mx_debug (MX_DEBUG_CSS))
     {
@@ -893,45 +1359,25 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
       g_print ("\x1b[22m");
     }
 
-  /* find matching selectors */
-  for (l = sheet->selectors; l; l = l->next)
-    {
-      gint score;
-
-      score = css_node_matches_selector (l->data, node);
-
-      if (score >= 0)
-        {
-          selector_match = g_slice_new (SelectorMatch);
-          selector_match->selector = l->data;
-          selector_match->score = score;
-          matching_selectors = g_list_prepend (matching_selectors,
-                                               selector_match);
-        }
-    }
+  /* find matching selectors, only looking at those that could apply */
+  matching_selectors = mx_style_sheet_find_matches (sheet, node);
 
   /* score the selectors by their score */
   matching_selectors = g_list_sort (matching_selectors,
                                     (GCompareFunc) compare_selector_matches);
 
-  /* get properties from selector's styles */
-  result = g_hash_table_new_full (g_str_hash,
-                                  g_str_equal,
-                                  NULL,
-                                  (GDestroyNotify)mx_style_sheet_value_free);
-  for (l = matching_selectors; l; l = l->next)
-    {
-      SelectorMatch *match = l->data;
-      struct _css_table_copy_data copy_data;
-
-      copy_data.filename = match->selector->filename;
-      copy_data.table = result;
+  /* get properties from selector's styles, the values are owned by the
+   * style sheet */
+  result = mx_style_sheet_properties_get (sheet, matching_selectors);
 
-      g_hash_table_foreach (match->selector->style, (GHFunc) css_table_copy,
-                            &copy_data);
+  if (_mx_debug (MX_DEBUG_CSS))
+    {
+      for (l = matching_selectors; l; l = l->next)
+        {
+          SelectorMatch *match = l->data;
 
-      if (_mx_debug (MX_DEBUG_CSS))
-        print_selector (match->selector, match->score);
+          print_selector (match->selector, match->score);
+        }
     }
 
   g_list_foreach (matching_selectors, (GFunc) free_selector_match, NULL);
@@ -954,9 +1400,26 @@ mx_style_sheet_new ()
   return g_new0 (MxStyleSheet, 1);
 }
 
+static void
+mx_style_sheet_properties_detach (gpointer                key,
+                                  MxStyleSheetProperties *properties,
+                                  gpointer                user_data)
+{
+  properties->sheet = NULL;
+}
+
 void
 mx_style_sheet_destroy (MxStyleSheet *sheet)
 {
+  mx_style_sheet_index_clear (sheet);
+
+  if (sheet->properties)
+    {
+      g_hash_table_foreach (sheet->properties,
+                            (GHFunc) mx_style_sheet_properties_detach, NULL);
+      g_hash_table_destroy (sheet->properties);
+    }
+
   g_list_foreach (sheet->selectors, (GFunc) mx_selector_free, NULL);
   g_list_free (sheet->selectors);
 
@@ -966,6 +1429,9 @@ mx_style_sheet_destroy (MxStyleSheet *sheet)
   g_list_foreach (sheet->filenames, (GFunc) g_free, NULL);
   g_list_free (sheet->filenames);
 
+  g_list_foreach (sheet->blobs, (GFunc) g_bytes_unref, NULL);
+  g_list_free (sheet->blobs);
+
   g_free (sheet);
 }
 
@@ -984,6 +1450,7 @@ mx_style_sheet_add_from_file (MxStyleSheet *sheet,
   input_name = g_strdup (filename);
   result = css_parse_file (sheet, input_name, NULL, g_list_length (sheet->filenames));
   sheet->filenames = g_list_prepend (sheet->filenames, input_name);
+  sheet->index_valid = FALSE;
 
   return result;
 }
@@ -1005,6 +1472,603 @@ mx_style_sheet_add_from_data (MxStyleSheet  *sheet,
   input_name = g_strdup (id);
   result = css_parse_file (sheet, input_name, data, g_list_length (sheet->filenames));
   sheet->filenames = g_list_prepend (sheet->filenames, input_name);
+  sheet->index_valid = FALSE;
 
   return result;
 }
+
+
+/* Compiled style sheets
+ *
+ * A compiled style sheet is the result of parsing a CSS file, written out so
+ * that it can be loaded again without running the tokenizer. It is laid out
+ * so that it can be used straight from a mapped file or resource: selectors
+ * and declarations only refer to the string table by offset, and the strings
+ * are used in place rather than copied.
+ *
+ * All the fields are 32-bit little-endian integers.
+ *
+ *   header       MxStyleSheetCompiledHeader
+ *   selectors    n_selectors * MxStyleSheetCompiledSelector
+ *   rulesets     n_rulesets * MxStyleSheetCompiledRuleset
+ *   declarations n_declarations * MxStyleSheetCompiledDeclaration
+ *   strings      strings_size bytes of nul-terminated strings
+ *
+ * Selectors are stored in the order of the sheet's selector list, with the
+ * parent and ancestor selectors they refer to following them. A selector
+ * only ever refers to selectors after it, which keeps the chains acyclic.
+ */
+
+#define MX_STYLE_SHEET_COMPILED_MAGIC   "MxCSS\r\n\032"
+#define MX_STYLE_SHEET_COMPILED_VERSION 2
+#define MX_STYLE_SHEET_COMPILED_NONE    0xffffffff
+
+/* the selector appears in the sheet's selector list */
+#define MX_STYLE_SHEET_COMPILED_TOPLEVEL (1 << 0)
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  gchar   source_checksum[64];      /* SHA-256, in hex, without a nul */
+
+  guint32 n_selectors;
+  guint32 selectors_offset;
+  guint32 n_rulesets;
+  guint32 rulesets_offset;
+  guint32 n_declarations;
+  guint32 declarations_offset;
+  guint32 strings_size;
+  guint32 strings_offset;
+} MxStyleSheetCompiledHeader;
+
+typedef struct
+{
+  guint32 type;
+  guint32 id;
+  guint32 class;
+  guint32 pseudo_class;
+
+  guint32 parent;
+  guint32 ancestor;
+  guint32 ruleset;
+  guint32 flags;
+
+  guint32 line;
+  guint32 position;
+} MxStyleSheetCompiledSelector;
+
+typedef struct
+{
+  guint32 first_declaration;
+  guint32 n_declarations;
+} MxStyleSheetCompiledRuleset;
+
+typedef struct
+{
+  guint32 name;
+  guint32 value;
+} MxStyleSheetCompiledDeclaration;
+
+typedef struct
+{
+  GArray     *selectors;
+  GArray     *rulesets;
+  GArray     *declarations;
+  GString    *strings;
+
+  GHashTable *string_offsets;
+  GHashTable *ruleset_indices;
+} MxStyleSheetCompiler;
+
+static guint32
+css_compile_string (MxStyleSheetCompiler *compiler,
+                    const gchar          *string)
+{
+  gpointer offset;
+
+  if (!string)
+    return MX_STYLE_SHEET_COMPILED_NONE;
+
+  if (g_hash_table_lookup_extended (compiler->string_offsets, string,
+                                    NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (compiler->strings->len);
+  g_string_append_len (compiler->strings, string, strlen (string) + 1);
+  g_hash_table_insert (compiler->string_offsets, (gpointer) string, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static void
+css_compile_declaration (gpointer              key,
+                         MxStyleSheetValue    *value,
+                         MxStyleSheetCompiler *compiler)
+{
+  MxStyleSheetCompiledDeclaration declaration;
+
+  declaration.name =
+    GUINT32_TO_LE (css_compile_string (compiler,
+                                       g_quark_to_string (GPOINTER_TO_UINT (key))));
+  declaration.value =
+    GUINT32_TO_LE (css_compile_string (compiler, value->string));
+
+  g_array_append_val (compiler->declarations, declaration);
+}
+
+static guint32
+css_compile_ruleset (MxStyleSheetCompiler *compiler,
+                     GHashTable           *style)
+{
+  MxStyleSheetCompiledRuleset ruleset;
+  gpointer index;
+
+  if (!style)
+    return MX_STYLE_SHEET_COMPILED_NONE;
+
+  if (g_hash_table_lookup_extended (compiler->ruleset_indices, style,
+                                    NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  ruleset.first_declaration = GUINT32_TO_LE (compiler->declarations->len);
+  ruleset.n_declarations = GUINT32_TO_LE (g_hash_table_size (style));
+
+  g_hash_table_foreach (style, (GHFunc) css_compile_declaration, compiler);
+
+  index = GUINT_TO_POINTER (compiler->rulesets->len);
+  g_array_append_val (compiler->rulesets, ruleset);
+  g_hash_table_insert (compiler->ruleset_indices, style, index);
+
+  return GPOINTER_TO_UINT (index);
+}
+
+static guint32
+css_compile_selector (MxStyleSheetCompiler *compiler,
+                      MxSelector           *selector,
+                      guint32               flags)
+{
+  MxStyleSheetCompiledSelector compiled;
+  guint32 index;
+
+  if (!selector)
+    return MX_STYLE_SHEET_COMPILED_NONE;
+
+  /* reserve the slot first, so that the parent and ancestor come after it */
+  index = compiler->selectors->len;
+  g_array_set_size (compiler->selectors, index + 1);
+
+  compiled.type = css_compile_string (compiler, selector->type);
+  compiled.id = css_compile_string (compiler, selector->id);
+  compiled.class = css_compile_string (compiler, selector->class);
+  compiled.pseudo_class = css_compile_string (compiler,
+                                              selector->pseudo_class);
+  compiled.parent = css_compile_selector (compiler, selector->parent, 0);
+  compiled.ancestor = css_compile_selector (compiler, selector->ancestor, 0);
+  compiled.ruleset = css_compile_ruleset (compiler, selector->style);
+  compiled.flags = flags;
+  compiled.line = selector->line;
+  compiled.position = selector->position;
+
+  compiled.type = GUINT32_TO_LE (compiled.type);
+  compiled.id = GUINT32_TO_LE (compiled.id);
+  compiled.class = GUINT32_TO_LE (compiled.class);
+  compiled.pseudo_class = GUINT32_TO_LE (compiled.pseudo_class);
+  compiled.parent = GUINT32_TO_LE (compiled.parent);
+  compiled.ancestor = GUINT32_TO_LE (compiled.ancestor);
+  compiled.ruleset = GUINT32_TO_LE (compiled.ruleset);
+  compiled.flags = GUINT32_TO_LE (compiled.flags);
+  compiled.line = GUINT32_TO_LE (compiled.line);
+  compiled.position = GUINT32_TO_LE (compiled.position);
+
+  g_array_index (compiler->selectors, MxStyleSheetCompiledSelector, index) =
+    compiled;
+
+  return index;
+}
+
+/*
+ * mx_style_sheet_compile:
+ * @sheet: a #MxStyleSheet
+ * @source_checksum: the SHA-256 checksum of the source the sheet was parsed
+ *   from, as returned by g_compute_checksum_for_data(), or %NULL
+ *
+ * Writes out the selectors and rulesets of @sheet in the compiled format, to
+ * be loaded later with mx_style_sheet_add_from_compiled(). @source_checksum
+ * is stored in the header so that a loader can check that the compiled sheet
+ * is up to date with its source.
+ *
+ * Returns: the compiled style sheet
+ */
+GBytes *
+mx_style_sheet_compile (MxStyleSheet *sheet,
+                        const gchar  *source_checksum)
+{
+  MxStyleSheetCompiledHeader header;
+  MxStyleSheetCompiler compiler;
+  GByteArray *data;
+  GList *l;
+  gsize offset;
+
+  g_return_val_if_fail (sheet != NULL, NULL);
+  g_return_val_if_fail (source_checksum == NULL ||
+                        strlen (source_checksum) ==
+                        sizeof (header.source_checksum), NULL);
+
+  compiler.selectors =
+    g_array_new (FALSE, FALSE, sizeof (MxStyleSheetCompiledSelector));
+  compiler.rulesets =
+    g_array_new (FALSE, FALSE, sizeof (MxStyleSheetCompiledRuleset));
+  compiler.declarations =
+    g_array_new (FALSE, FALSE, sizeof (MxStyleSheetCompiledDeclaration));
+  compiler.strings = g_string_new (NULL);
+  compiler.string_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  compiler.ruleset_indices = g_hash_table_new (NULL, NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    css_compile_selector (&compiler, l->data,
+                          MX_STYLE_SHEET_COMPILED_TOPLEVEL);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, MX_STYLE_SHEET_COMPILED_MAGIC, sizeof (header.magic));
+
+  offset = sizeof (header);
+  header.version = GUINT32_TO_LE (MX_STYLE_SHEET_COMPILED_VERSION);
+  if (source_checksum)
+    memcpy (header.source_checksum, source_checksum,
+            sizeof (header.source_checksum));
+
+  header.n_selectors = GUINT32_TO_LE (compiler.selectors->len);
+  header.selectors_offset = GUINT32_TO_LE (offset);
+  offset += compiler.selectors->len * sizeof (MxStyleSheetCompiledSelector);
+
+  header.n_rulesets = GUINT32_TO_LE (compiler.rulesets->len);
+  header.rulesets_offset = GUINT32_TO_LE (offset);
+  offset += compiler.rulesets->len * sizeof (MxStyleSheetCompiledRuleset);
+
+  header.n_declarations = GUINT32_TO_LE (compiler.declarations->len);
+  header.declarations_offset = GUINT32_TO_LE (offset);
+  offset += compiler.declarations->len *
+    sizeof (MxStyleSheetCompiledDeclaration);
+
+  header.strings_size = GUINT32_TO_LE (compiler.strings->len);
+  header.strings_offset = GUINT32_TO_LE (offset);
+  offset += compiler.strings->len;
+
+  data = g_byte_array_sized_new (offset);
+  g_byte_array_append (data, (guint8 *) &header, sizeof (header));
+  g_byte_array_append (data, (guint8 *) compiler.selectors->data,
+                       compiler.selectors->len *
+                       sizeof (MxStyleSheetCompiledSelector));
+  g_byte_array_append (data, (guint8 *) compiler.rulesets->data,
+                       compiler.rulesets->len *
+                       sizeof (MxStyleSheetCompiledRuleset));
+  g_byte_array_append (data, (guint8 *) compiler.declarations->data,
+                       compiler.declarations->len *
+                       sizeof (MxStyleSheetCompiledDeclaration));
+  g_byte_array_append (data, (guint8 *) compiler.strings->str,
+                       compiler.strings->len);
+
+  g_hash_table_destroy (compiler.ruleset_indices);
+  g_hash_table_destroy (compiler.string_offsets);
+  g_string_free (compiler.strings, TRUE);
+  g_array_free (compiler.declarations, TRUE);
+  g_array_free (compiler.rulesets, TRUE);
+  g_array_free (compiler.selectors, TRUE);
+
+  return g_byte_array_free_to_bytes (data);
+}
+
+/*
+ * mx_style_sheet_data_is_compiled:
+ * @data: the contents of a style sheet
+ * @length: the length of @data
+ *
+ * Returns: %TRUE if @data starts like a compiled style sheet
+ */
+gboolean
+mx_style_sheet_data_is_compiled (gconstpointer data,
+                                 gsize         length)
+{
+  return (length >= sizeof (MxStyleSheetCompiledHeader) &&
+          memcmp (data, MX_STYLE_SHEET_COMPILED_MAGIC, 8) == 0);
+}
+
+static gboolean
+css_compiled_range_is_valid (gsize   length,
+                             guint32 offset,
+                             guint32 n_items,
+                             gsize   item_size)
+{
+  return (offset <= length &&
+          n_items <= (length - offset) / item_size);
+}
+
+static const gchar *
+css_compiled_get_string (const gchar *strings,
+                         guint32      strings_size,
+                         guint32      offset,
+                         gboolean    *valid)
+{
+  offset = GUINT32_FROM_LE (offset);
+
+  if (offset == MX_STYLE_SHEET_COMPILED_NONE)
+    return NULL;
+
+  if (offset >= strings_size)
+    {
+      *valid = FALSE;
+      return NULL;
+    }
+
+  return strings + offset;
+}
+
+/*
+ * mx_style_sheet_add_from_compiled:
+ * @sheet: a #MxStyleSheet
+ * @id: identifier of the style sheet, used to resolve urls
+ * @bytes: a compiled style sheet
+ * @source_checksum: the expected SHA-256 checksum of the source, or %NULL to
+ *   skip the check
+ * @error: a #GError or %NULL
+ *
+ * Adds the selectors and rulesets of a style sheet written by
+ * mx_style_sheet_compile(). The data is checked completely before anything
+ * is added to @sheet, so a truncated or out of date compiled sheet leaves
+ * @sheet untouched and the caller can fall back to the CSS source.
+ *
+ * Returns: %TRUE if the compiled style sheet was added
+ */
+gboolean
+mx_style_sheet_add_from_compiled (MxStyleSheet  *sheet,
+                                  const gchar   *id,
+                                  GBytes        *bytes,
+                                  const gchar   *source_checksum,
+                                  GError       **error)
+{
+  const MxStyleSheetCompiledHeader *header;
+  const MxStyleSheetCompiledSelector *compiled_selectors;
+  const MxStyleSheetCompiledRuleset *compiled_rulesets;
+  const MxStyleSheetCompiledDeclaration *declarations;
+  guint32 n_selectors, n_rulesets, n_declarations, strings_size;
+  const gchar *data, *strings;
+  MxSelector **selectors;
+  GHashTable **rulesets;
+  GList *toplevel = NULL;
+  gboolean *referenced;
+  gboolean valid;
+  gchar *input_name;
+  gint priority;
+  gsize length;
+  guint32 i, j;
+
+  g_return_val_if_fail (sheet != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  data = g_bytes_get_data (bytes, &length);
+
+  if (!mx_style_sheet_data_is_compiled (data, length))
+    return FALSE;
+
+  /* the records are read in place, so they need to be aligned */
+  if (GPOINTER_TO_SIZE (data) % sizeof (guint32))
+    bytes = g_bytes_new (data, length);
+  else
+    g_bytes_ref (bytes);
+
+  data = g_bytes_get_data (bytes, &length);
+  header = (const MxStyleSheetCompiledHeader *) data;
+
+  n_selectors = GUINT32_FROM_LE (header->n_selectors);
+  n_rulesets = GUINT32_FROM_LE (header->n_rulesets);
+  n_declarations = GUINT32_FROM_LE (header->n_declarations);
+  strings_size = GUINT32_FROM_LE (header->strings_size);
+
+  if (GUINT32_FROM_LE (header->version) != MX_STYLE_SHEET_COMPILED_VERSION ||
+      (source_checksum &&
+       (strlen (source_checksum) != sizeof (header->source_checksum) ||
+        memcmp (header->source_checksum, source_checksum,
+                sizeof (header->source_checksum)) != 0)) ||
+      !css_compiled_range_is_valid (length,
+                                    GUINT32_FROM_LE (header->selectors_offset),
+                                    n_selectors,
+                                    sizeof (MxStyleSheetCompiledSelector)) ||
+      !css_compiled_range_is_valid (length,
+                                    GUINT32_FROM_LE (header->rulesets_offset),
+                                    n_rulesets,
+                                    sizeof (MxStyleSheetCompiledRuleset)) ||
+      !css_compiled_range_is_valid (length,
+                                    GUINT32_FROM_LE (header->declarations_offset),
+                                    n_declarations,
+                                    sizeof (MxStyleSheetCompiledDeclaration)) ||
+      !css_compiled_range_is_valid (length,
+                                    GUINT32_FROM_LE (header->strings_offset),
+                                    strings_size, 1) ||
+      (GUINT32_FROM_LE (header->selectors_offset) |
+       GUINT32_FROM_LE (header->rulesets_offset) |
+       GUINT32_FROM_LE (header->declarations_offset)) % sizeof (guint32))
+    {
+      g_bytes_unref (bytes);
+      return FALSE;
+    }
+
+  compiled_selectors = (const MxStyleSheetCompiledSelector *)
+    (data + GUINT32_FROM_LE (header->selectors_offset));
+  compiled_rulesets = (const MxStyleSheetCompiledRuleset *)
+    (data + GUINT32_FROM_LE (header->rulesets_offset));
+  declarations = (const MxStyleSheetCompiledDeclaration *)
+    (data + GUINT32_FROM_LE (header->declarations_offset));
+  strings = data + GUINT32_FROM_LE (header->strings_offset);
+
+  /* every string has to be terminated within the string table */
+  valid = (strings_size == 0 || strings[strings_size - 1] == '\0');
+
+  /* check the rulesets stay within the declarations and that the selectors
+   * form chains, where each non top-level selector is used exactly once */
+  for (i = 0; valid && i < n_rulesets; i++)
+    valid = css_compiled_range_is_valid (n_declarations,
+                                         GUINT32_FROM_LE (compiled_rulesets[i].first_declaration),
+                                         GUINT32_FROM_LE (compiled_rulesets[i].n_declarations),
+                                         1);
+
+  referenced = g_new0 (gboolean, n_selectors);
+  for (i = 0; valid && i < n_selectors; i++)
+    {
+      const MxStyleSheetCompiledSelector *compiled = &compiled_selectors[i];
+      guint32 links[2], ruleset;
+
+      links[0] = GUINT32_FROM_LE (compiled->parent);
+      links[1] = GUINT32_FROM_LE (compiled->ancestor);
+      ruleset = GUINT32_FROM_LE (compiled->ruleset);
+
+      for (j = 0; valid && j < G_N_ELEMENTS (links); j++)
+        {
+          if (links[j] == MX_STYLE_SHEET_COMPILED_NONE)
+            continue;
+
+          if (links[j] <= i || links[j] >= n_selectors ||
+              referenced[links[j]] ||
+              (GUINT32_FROM_LE (compiled_selectors[links[j]].flags) &
+               MX_STYLE_SHEET_COMPILED_TOPLEVEL))
+            valid = FALSE;
+          else
+            referenced[links[j]] = TRUE;
+        }
+
+      if (ruleset != MX_STYLE_SHEET_COMPILED_NONE && ruleset >= n_rulesets)
+        valid = FALSE;
+
+      css_compiled_get_string (strings, strings_size, compiled->type, &valid);
+      css_compiled_get_string (strings, strings_size, compiled->id, &valid);
+      css_compiled_get_string (strings, strings_size, compiled->class, &valid);
+      css_compiled_get_string (strings, strings_size, compiled->pseudo_class,
+                               &valid);
+    }
+
+  for (i = 0; valid && i < n_selectors; i++)
+    {
+      if (!referenced[i] &&
+          !(GUINT32_FROM_LE (compiled_selectors[i].flags) &
+            MX_STYLE_SHEET_COMPILED_TOPLEVEL))
+        valid = FALSE;
+    }
+
+  for (i = 0; valid && i < n_declarations; i++)
+    {
+      if (!css_compiled_get_string (strings, strings_size,
+                                    declarations[i].name, &valid) ||
+          !css_compiled_get_string (strings, strings_size,
+                                    declarations[i].value, &valid))
+        valid = FALSE;
+    }
+
+  g_free (referenced);
+
+  if (!valid)
+    {
+      g_bytes_unref (bytes);
+      return FALSE;
+    }
+
+  /* the data is good, build the rulesets and selectors */
+  input_name = g_strdup (id);
+  priority = g_list_length (sheet->filenames);
+
+  rulesets = g_new (GHashTable *, n_rulesets);
+  for (i = 0; i < n_rulesets; i++)
+    {
+      guint32 first, n;
+
+      rulesets[i] =
+        g_hash_table_new_full (NULL, NULL, NULL,
+                               (GDestroyNotify) mx_style_sheet_value_free);
+
+      first = GUINT32_FROM_LE (compiled_rulesets[i].first_declaration);
+      n = GUINT32_FROM_LE (compiled_rulesets[i].n_declarations);
+
+      for (j = first; j < first + n; j++)
+        {
+          MxStyleSheetValue *value;
+          const gchar *name;
+
+          name = css_compiled_get_string (strings, strings_size,
+                                          declarations[j].name, &valid);
+          value = mx_style_sheet_value_new ((gchar *)
+                                            css_compiled_get_string (strings,
+                                                                     strings_size,
+                                                                     declarations[j].value,
+                                                                     &valid),
+                                            input_name);
+          value->borrowed = TRUE;
+
+          g_hash_table_insert (rulesets[i],
+                               GUINT_TO_POINTER (g_quark_from_string (name)),
+                               value);
+        }
+
+      sheet->styles = g_list_append (sheet->styles, rulesets[i]);
+    }
+
+  selectors = g_new (MxSelector *, n_selectors);
+  for (i = 0; i < n_selectors; i++)
+    {
+      const MxStyleSheetCompiledSelector *compiled = &compiled_selectors[i];
+
+      selectors[i] = mx_selector_new (input_name, priority,
+                                      GUINT32_FROM_LE (compiled->line),
+                                      GUINT32_FROM_LE (compiled->position));
+      selectors[i]->borrowed = TRUE;
+      selectors[i]->type = (gchar *)
+        css_compiled_get_string (strings, strings_size, compiled->type,
+                                 &valid);
+      selectors[i]->id = (gchar *)
+        css_compiled_get_string (strings, strings_size, compiled->id, &valid);
+      selectors[i]->class = (gchar *)
+        css_compiled_get_string (strings, strings_size, compiled->class,
+                                 &valid);
+      selectors[i]->pseudo_class = (gchar *)
+        css_compiled_get_string (strings, strings_size, compiled->pseudo_class,
+                                 &valid);
+
+      mx_selector_intern (selectors[i]);
+    }
+
+  /* link the chains up, now that all the selectors exist */
+  for (i = 0; i < n_selectors; i++)
+    {
+      const MxStyleSheetCompiledSelector *compiled = &compiled_selectors[i];
+      guint32 link;
+
+      link = GUINT32_FROM_LE (compiled->parent);
+      if (link != MX_STYLE_SHEET_COMPILED_NONE)
+        selectors[i]->parent = selectors[link];
+
+      link = GUINT32_FROM_LE (compiled->ancestor);
+      if (link != MX_STYLE_SHEET_COMPILED_NONE)
+        selectors[i]->ancestor = selectors[link];
+
+      link = GUINT32_FROM_LE (compiled->ruleset);
+      if (link != MX_STYLE_SHEET_COMPILED_NONE)
+        selectors[i]->style = rulesets[link];
+
+      if (GUINT32_FROM_LE (compiled->flags) & MX_STYLE_SHEET_COMPILED_TOPLEVEL)
+        toplevel = g_list_prepend (toplevel, selectors[i]);
+    }
+
+  sheet->selectors = g_list_concat (sheet->selectors,
+                                    g_list_reverse (toplevel));
+
+  g_free (selectors);
+  g_free (rulesets);
+
+  sheet->filenames = g_list_prepend (sheet->filenames, input_name);
+  sheet->blobs = g_list_prepend (sheet->blobs, bytes);
+  sheet->index_valid = FALSE;
+
+  MX_NOTE (CSS, "Loaded %u compiled selectors from '%s'", n_selectors, id);
+
+  return TRUE;
+}
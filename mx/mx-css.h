@@ -22,16 +22,25 @@
 #ifndef MX_CSS_H
 #define MX_CSS_H
 
-#include <glib.h>
+#include <glib-object.h>
 #include "mx-stylable.h"
 
 typedef struct _MxStyleSheetValue MxStyleSheetValue;
 typedef struct _MxStyleSheet MxStyleSheet;
+typedef struct _MxStyleSheetProperties MxStyleSheetProperties;
 
 struct _MxStyleSheetValue
 {
-  const gchar *string;
+  gchar       *string;
   const gchar *source;
+
+  /* TRUE if @string belongs to a compiled style sheet */
+  gboolean     borrowed;
+
+  /* the value converted to the type of the last property it was requested
+   * for, or G_TYPE_INVALID if it has not been converted yet */
+  GType        cached_type;
+  GValue       cached_value;
 };
 
 MxStyleSheet*  mx_style_sheet_new            ();
@@ -43,7 +52,24 @@ gboolean       mx_style_sheet_add_from_data  (MxStyleSheet  *sheet,
                                               const gchar   *id,
                                               const gchar   *data,
                                               GError       **error);
-GHashTable*    mx_style_sheet_get_properties (MxStyleSheet *sheet,
+gboolean       mx_style_sheet_add_from_compiled (MxStyleSheet  *sheet,
+                                                 const gchar   *id,
+                                                 GBytes        *bytes,
+                                                 const gchar   *source_checksum,
+                                                 GError       **error);
+GBytes*        mx_style_sheet_compile           (MxStyleSheet  *sheet,
+                                                 const gchar   *source_checksum);
+gboolean       mx_style_sheet_data_is_compiled  (gconstpointer  data,
+                                                 gsize          length);
+MxStyleSheetProperties*
+               mx_style_sheet_get_properties (MxStyleSheet *sheet,
                                               MxStylable   *node);
 
+MxStyleSheetProperties*
+                   mx_style_sheet_properties_ref    (MxStyleSheetProperties *properties);
+void               mx_style_sheet_properties_unref  (MxStyleSheetProperties *properties);
+gsize              mx_style_sheet_properties_size   (MxStyleSheetProperties *properties);
+MxStyleSheetValue* mx_style_sheet_properties_lookup (MxStyleSheetProperties *properties,
+                                                     const gchar            *name);
+
 #endif /* MX_CSS_H */
@@ -197,6 +197,10 @@ struct _MxGridPrivate
   MxAdjustment *vadjustment;
 
   MxFocusable  *last_focus;
+
+  /* the children's allocations, for culling in paint and pick */
+  GArray       *extents;
+  gboolean      extents_valid;
 };
 
 enum
@@ -341,6 +345,17 @@ scrollable_get_adjustments (MxScrollable  *scrollable,
     }
 }
 
+/* The adjustments that have been set or created so far, without creating
+ * any */
+void
+_mx_grid_peek_adjustments (MxGrid        *grid,
+                           MxAdjustment **hadjustment,
+                           MxAdjustment **vadjustment)
+{
+  *hadjustment = grid->priv->hadjustment;
+  *vadjustment = grid->priv->vadjustment;
+}
+
 static void
 scrollable_interface_init (MxScrollableIface *iface)
 {
@@ -701,6 +716,8 @@ mx_grid_init (MxGrid *self)
                              g_direct_equal,
                              NULL,
                              mx_grid_free_actor_data);
+
+  priv->extents = g_array_new (FALSE, FALSE, sizeof (MxChildExtent));
 }
 
 static void
@@ -710,6 +727,7 @@ mx_grid_finalize (GObject *object)
   MxGridPrivate *priv = self->priv;
 
   g_hash_table_destroy (priv->hash_table);
+  g_array_free (priv->extents, TRUE);
 
   G_OBJECT_CLASS (mx_grid_parent_class)->finalize (object);
 }
@@ -1083,6 +1101,8 @@ mx_grid_actor_added (ClutterContainer *container,
   data = g_slice_alloc0 (sizeof (MxGridActorData));
 
   g_hash_table_insert (priv->hash_table, actor, data);
+
+  priv->extents_valid = FALSE;
 }
 
 static void
@@ -1093,6 +1113,18 @@ mx_grid_actor_removed (ClutterContainer *container,
   MxGridPrivate *priv = layout->priv;
 
   g_hash_table_remove (priv->hash_table, actor);
+
+  priv->extents_valid = FALSE;
+  g_array_set_size (priv->extents, 0);
+}
+
+static MxOrientation
+mx_grid_get_lines_axis (MxGridPrivate *priv)
+{
+  if (priv->orientation == MX_ORIENTATION_VERTICAL)
+    return MX_ORIENTATION_HORIZONTAL;
+  else
+    return MX_ORIENTATION_VERTICAL;
 }
 
 static void
@@ -1123,6 +1155,15 @@ mx_grid_paint (ClutterActor *actor)
   grid_b.y2 = (grid_b.y2 - grid_b.y1) + y;
   grid_b.y1 = y;
 
+  /* lines of children are stacked along the axis across the orientation,
+   * so the visible ones can be found without looking at all of them */
+  if (priv->extents_valid)
+    {
+      _mx_child_extents_paint (priv->extents, &grid_b,
+                               mx_grid_get_lines_axis (priv));
+      return;
+    }
+
   clutter_actor_iter_init (&iter, actor);
   while (clutter_actor_iter_next (&iter, &child))
     {
@@ -1175,6 +1216,13 @@ mx_grid_pick (ClutterActor       *actor,
   grid_b.y2 = (grid_b.y2 - grid_b.y1) + y;
   grid_b.y1 = y;
 
+  if (priv->extents_valid)
+    {
+      _mx_child_extents_paint (priv->extents, &grid_b,
+                               mx_grid_get_lines_axis (priv));
+      return;
+    }
+
   clutter_actor_iter_init (&iter, actor);
   while (clutter_actor_iter_next (&iter, &child))
     {
@@ -1398,6 +1446,12 @@ mx_grid_do_allocate (ClutterActor          *self,
   if (min_height)
     *min_height = 0;
 
+  if (!calculate_extents_only)
+    {
+      priv->extents_valid = FALSE;
+      g_array_set_size (priv->extents, 0);
+    }
+
   current_a = current_b = next_b = 0;
 
   if (priv->orientation == MX_ORIENTATION_VERTICAL)
@@ -1571,9 +1625,13 @@ mx_grid_do_allocate (ClutterActor          *self,
 
         /* update the allocation */
         if (!calculate_extents_only)
-          clutter_actor_allocate (CLUTTER_ACTOR (child),
-                                  &child_box,
-                                  flags);
+          {
+            clutter_actor_allocate (CLUTTER_ACTOR (child),
+                                    &child_box,
+                                    flags);
+            _mx_child_extents_add (priv->extents, child,
+                                   mx_grid_get_lines_axis (priv));
+          }
 
         /* update extents */
         if (actual_width && (child_box.x2 + padding.right) > *actual_width)
@@ -1604,6 +1662,12 @@ mx_grid_do_allocate (ClutterActor          *self,
           }
       }
     }
+
+  if (!calculate_extents_only)
+    {
+      _mx_child_extents_finish (priv->extents);
+      priv->extents_valid = TRUE;
+    }
 }
 
 static void
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 #include "mx-icon-theme.h"
 #include "mx-marshal.h"
 #include "mx-texture-cache.h"
@@ -58,6 +60,115 @@ typedef struct
   gint         threshold;
 } MxIconData;
 
+/* Each theme is indexed the first time an icon is looked up in it. For every
+ * search path the theme is in, the index either maps the icon-theme.cache
+ * written by gtk-update-icon-cache, or lists each of the theme's directories
+ * once, so that finding an icon doesn't need to test for files on disk.
+ */
+
+typedef enum
+{
+  MX_ICON_PNG,
+  MX_ICON_SVG,
+  MX_ICON_XPM,
+
+  MX_ICON_N_EXTENSIONS
+} MxIconExtension;
+
+static const gchar *mx_icon_extensions[MX_ICON_N_EXTENSIONS] =
+  { ".png", ".svg", ".xpm" };
+
+#define ICON_CACHE_MAJOR_VERSION 1
+#define ICON_CACHE_NONE          0xffffffff
+
+/* flags of the images in icon-theme.cache */
+#define ICON_CACHE_HAS_XPM 1
+#define ICON_CACHE_HAS_SVG 2
+#define ICON_CACHE_HAS_PNG 4
+
+/* Theme directories without an up-to-date icon-theme.cache have their index
+ * saved in the user's cache directory instead, so that other processes and
+ * later runs don't need to read every directory again. A file is named after
+ * the theme directory and the directories listed in the theme, and holds an
+ * MxIconThemeCacheHeader, the modification times in microseconds of the
+ * theme directory and of each listed directory as 64-bit integers, the path
+ * of the theme directory and then an icon cache in gtk's format. It's only
+ * used while none of the modification times have changed.
+ */
+#define ICON_THEME_CACHE_MAGIC   "MxIcons\n"
+#define ICON_THEME_CACHE_VERSION 2
+
+/* Directories can change again within the modification time granularity of
+ * the file system, unnoticed, so a scan isn't saved if any of them changed
+ * less than this many microseconds ago */
+#define ICON_THEME_CACHE_SETTLE_TIME (2 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  gchar        magic[8];
+  guint32      version;
+  guint32      n_dirs;
+  guint32      mtimes_offset;
+  guint32      path_offset;
+  guint32      cache_offset;
+  guint32      cache_size;
+} MxIconThemeCacheHeader;
+
+typedef struct
+{
+  gchar       *name;
+  MxIconType   type;
+  gint         size;
+  gint         min_size;
+  gint         max_size;
+  gint         threshold;
+} MxIconThemeDir;
+
+typedef struct
+{
+  guint16      dir;
+  guint16      root;
+  guint16      extension;
+} MxIconThemeFile;
+
+typedef struct
+{
+  gchar       *path;
+
+  /* icon-theme.cache, if there's an up-to-date one */
+  GMappedFile *cache;
+  const gchar *cache_data;
+  gsize        cache_length;
+  gint        *cache_dirs;
+  guint        n_cache_dirs;
+
+  /* otherwise, icon names to GArrays of MxIconThemeFile */
+  GHashTable  *icons;
+} MxIconThemeRoot;
+
+typedef struct
+{
+  GArray      *dirs;
+  GPtrArray   *roots;
+} MxIconThemeIndex;
+
+/* Scalable and threshold icons are drawn at the size they're looked up at,
+ * in a thread, and kept in the texture cache against their path and size */
+#define ICON_LOAD_THREADS 2
+
+typedef struct
+{
+  MxIconTheme *theme;
+  gchar       *key;
+  gchar       *path;
+  gint         size;
+
+  /* the ClutterTextures waiting for the icon, as weak pointers */
+  GSList      *textures;
+
+  GdkPixbuf   *pixbuf;
+} MxIconThemeLoad;
+
 struct _MxIconThemePrivate
 {
   guint       override_theme : 1;
@@ -65,6 +176,10 @@ struct _MxIconThemePrivate
   GList      *search_paths;
   GHashTable *icon_hash;
   GHashTable *theme_path_hash;
+  GHashTable *theme_index_hash;
+
+  GHashTable  *loads;
+  GThreadPool *load_pool;
 
   gchar      *theme;
   GKeyFile   *theme_file;
@@ -132,8 +247,14 @@ mx_icon_theme_finalize (GObject *object)
   mx_icon_theme_set_search_paths (self, NULL);
   g_hash_table_unref (priv->icon_hash);
   g_hash_table_unref (priv->theme_path_hash);
+  g_hash_table_unref (priv->theme_index_hash);
   g_free (priv->theme);
 
+  /* every load holds a reference, so none are left by now */
+  if (priv->load_pool)
+    g_thread_pool_free (priv->load_pool, TRUE, TRUE);
+  g_hash_table_unref (priv->loads);
+
   if (priv->theme_file)
     g_key_file_free (priv->theme_file);
 
@@ -219,6 +340,54 @@ mx_icon_theme_icon_hash_free (gpointer data)
     }
 }
 
+static void
+mx_icon_theme_dir_clear (MxIconThemeDir *dir)
+{
+  g_free (dir->name);
+}
+
+static void
+mx_icon_theme_root_free (MxIconThemeRoot *root)
+{
+  g_free (root->path);
+
+  if (root->cache)
+    g_mapped_file_unref (root->cache);
+  g_free (root->cache_dirs);
+
+  if (root->icons)
+    g_hash_table_unref (root->icons);
+
+  g_free (root);
+}
+
+static void
+mx_icon_theme_index_free (MxIconThemeIndex *index)
+{
+  guint i;
+
+  for (i = 0; i < index->dirs->len; i++)
+    mx_icon_theme_dir_clear (&g_array_index (index->dirs, MxIconThemeDir, i));
+  g_array_free (index->dirs, TRUE);
+
+  g_ptr_array_free (index->roots, TRUE);
+
+  g_free (index);
+}
+
+static void
+mx_icon_theme_load_free (MxIconThemeLoad *load)
+{
+  g_free (load->key);
+  g_free (load->path);
+  g_slist_free (load->textures);
+
+  if (load->pixbuf)
+    g_object_unref (load->pixbuf);
+
+  g_slice_free (MxIconThemeLoad, load);
+}
+
 static MxIconData *
 mx_icon_theme_icon_data_new (gint         size,
                              const gchar *path,
@@ -383,6 +552,13 @@ mx_icon_theme_init (MxIconTheme *self)
                                                  NULL,
                                                  g_free);
 
+  priv->theme_index_hash =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                           (GDestroyNotify)mx_icon_theme_index_free);
+
+  priv->loads = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                       (GDestroyNotify)mx_icon_theme_load_free);
+
   priv->hicolor_file = mx_icon_theme_load_theme (self, "hicolor");
   if (!priv->hicolor_file)
     g_warning ("Error loading fallback icon theme");
@@ -504,12 +680,15 @@ mx_icon_theme_set_theme_name (MxIconTheme *theme,
 
   if (priv->theme_file)
     {
+      g_hash_table_remove (priv->theme_index_hash, priv->theme_file);
       g_hash_table_remove (priv->theme_path_hash, priv->theme_file);
       g_key_file_free (priv->theme_file);
     }
 
   while (priv->theme_fallbacks)
     {
+      g_hash_table_remove (priv->theme_index_hash,
+                           priv->theme_fallbacks->data);
       g_hash_table_remove (priv->theme_path_hash, priv->theme_fallbacks->data);
       g_key_file_free ((GKeyFile *)priv->theme_fallbacks->data);
       priv->theme_fallbacks = g_list_delete_link (priv->theme_fallbacks,
@@ -568,28 +747,565 @@ mx_icon_theme_collect_dirs (GString     *string,
   g_dir_close (dir);
 }
 
-static GList *
-mx_icon_theme_theme_load_icon (MxIconTheme *self,
-                               GKeyFile    *theme_file,
-                               const gchar *icon,
-                               GIcon       *store_icon,
-                               gboolean     store_fail)
+/* icon-theme.cache is big-endian and its offsets aren't trusted, so every
+ * read is checked against the size of the file */
+static gboolean
+mx_icon_theme_root_read_uint16 (MxIconThemeRoot *root,
+                                guint32          offset,
+                                guint16         *value)
+{
+  guint16 data;
+
+  if ((gsize)offset + sizeof (data) > root->cache_length)
+    return FALSE;
+
+  memcpy (&data, root->cache_data + offset, sizeof (data));
+  *value = GUINT16_FROM_BE (data);
+
+  return TRUE;
+}
+
+static gboolean
+mx_icon_theme_root_read_uint32 (MxIconThemeRoot *root,
+                                guint32          offset,
+                                guint32         *value)
+{
+  guint32 data;
+
+  if ((gsize)offset + sizeof (data) > root->cache_length)
+    return FALSE;
+
+  memcpy (&data, root->cache_data + offset, sizeof (data));
+  *value = GUINT32_FROM_BE (data);
+
+  return TRUE;
+}
+
+static const gchar *
+mx_icon_theme_root_read_string (MxIconThemeRoot *root,
+                                guint32          offset)
+{
+  if (offset >= root->cache_length ||
+      !memchr (root->cache_data + offset, '\0', root->cache_length - offset))
+    return NULL;
+
+  return root->cache_data + offset;
+}
+
+/* Uses an icon cache in gtk's format, found @length bytes at @offset in
+ * @file, for lookups in @root. Takes the reference on @file. */
+static gboolean
+mx_icon_theme_root_set_cache (MxIconThemeRoot *root,
+                              GMappedFile     *file,
+                              gsize            offset,
+                              gsize            length,
+                              GHashTable      *dir_names)
+{
+  guint i;
+  guint16 major;
+  guint32 dir_list, n_dirs;
+
+  root->cache = file;
+  root->cache_data = g_mapped_file_get_contents (file) + offset;
+  root->cache_length = length;
+
+  if (!mx_icon_theme_root_read_uint16 (root, 0, &major) ||
+      major != ICON_CACHE_MAJOR_VERSION ||
+      !mx_icon_theme_root_read_uint32 (root, 8, &dir_list) ||
+      !mx_icon_theme_root_read_uint32 (root, dir_list, &n_dirs) ||
+      n_dirs > root->cache_length / 4)
+    {
+      g_mapped_file_unref (root->cache);
+      root->cache = NULL;
+      return FALSE;
+    }
+
+  /* Map the directories of the cache to those of the theme */
+  root->n_cache_dirs = n_dirs;
+  root->cache_dirs = g_new (gint, n_dirs);
+  for (i = 0; i < n_dirs; i++)
+    {
+      guint32 dir_offset;
+      const gchar *name;
+      gpointer dir;
+
+      root->cache_dirs[i] = -1;
+
+      if (mx_icon_theme_root_read_uint32 (root, dir_list + 4 + i * 4,
+                                          &dir_offset) &&
+          (name = mx_icon_theme_root_read_string (root, dir_offset)) &&
+          g_hash_table_lookup_extended (dir_names, name, NULL, &dir))
+        root->cache_dirs[i] = GPOINTER_TO_INT (dir);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+mx_icon_theme_root_load_cache (MxIconThemeRoot *root,
+                               GHashTable      *dir_names)
+{
+  gchar *filename;
+  GMappedFile *file;
+  GStatBuf cache_info, dir_info;
+
+  filename = g_build_filename (root->path, "icon-theme.cache", NULL);
+
+  /* As gtk does, ignore the cache if the theme has changed since */
+  if (g_stat (filename, &cache_info) ||
+      g_stat (root->path, &dir_info) ||
+      cache_info.st_mtime < dir_info.st_mtime)
+    {
+      g_free (filename);
+      return FALSE;
+    }
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  if (!file)
+    return FALSE;
+
+  return mx_icon_theme_root_set_cache (root, file, 0,
+                                       g_mapped_file_get_length (file),
+                                       dir_names);
+}
+
+/* returns when a directory was last modified, in microseconds, or 0 */
+static guint64
+mx_icon_theme_get_mtime (const gchar *path)
+{
+  guint64 mtime;
+  GFileInfo *info;
+  GFile *file;
+
+  file = g_file_new_for_path (path);
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  g_object_unref (file);
+
+  if (!info)
+    return 0;
+
+  mtime = g_file_info_get_attribute_uint64 (info,
+                                            G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+    G_USEC_PER_SEC +
+    g_file_info_get_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  g_object_unref (info);
+
+  return mtime;
+}
+
+/* The modification times of the theme directory and of each of the
+ * directories listed in it, or 0 for those that don't exist */
+static guint64 *
+mx_icon_theme_root_get_mtimes (MxIconThemeRoot *root,
+                               GArray          *dirs)
+{
+  guint i;
+  guint64 *mtimes;
+
+  mtimes = g_new0 (guint64, dirs->len + 1);
+
+  mtimes[0] = mx_icon_theme_get_mtime (root->path);
+
+  for (i = 0; i < dirs->len; i++)
+    {
+      MxIconThemeDir *dir = &g_array_index (dirs, MxIconThemeDir, i);
+      gchar *path = g_build_filename (root->path, dir->name, NULL);
+
+      mtimes[i + 1] = mx_icon_theme_get_mtime (path);
+
+      g_free (path);
+    }
+
+  return mtimes;
+}
+
+/* whether the directories haven't changed for long enough that a change
+ * made after they were read would show up in their modification times */
+static gboolean
+mx_icon_theme_root_mtimes_settled (guint64 *mtimes,
+                                   GArray  *dirs)
+{
+  guint i;
+  gint64 now;
+
+  now = g_get_real_time ();
+
+  for (i = 0; i < dirs->len + 1; i++)
+    if ((gint64) mtimes[i] > now - ICON_THEME_CACHE_SETTLE_TIME)
+      return FALSE;
+
+  return TRUE;
+}
+
+static gchar *
+mx_icon_theme_root_get_cache_path (MxIconThemeRoot *root,
+                                   GArray          *dirs)
+{
+  guint i;
+  GString *key;
+  gchar *checksum, *basename, *path;
+
+  key = g_string_new (root->path);
+  for (i = 0; i < dirs->len; i++)
+    {
+      g_string_append_c (key, '\n');
+      g_string_append (key, g_array_index (dirs, MxIconThemeDir, i).name);
+    }
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, key->str,
+                                            key->len);
+  basename = g_strconcat (checksum, ".cache", NULL);
+
+  path = g_build_filename (g_get_user_cache_dir (), "mx", "icon-themes",
+                           basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_string_free (key, TRUE);
+
+  return path;
+}
+
+static gboolean
+mx_icon_theme_root_load_mx_cache (MxIconThemeRoot *root,
+                                  GArray          *dirs,
+                                  const guint64   *mtimes,
+                                  GHashTable      *dir_names)
+{
+  MxIconThemeCacheHeader header;
+  const gchar *contents, *path;
+  GMappedFile *file;
+  gchar *filename;
+  gsize length;
+  gsize mtimes_size;
+
+  filename = mx_icon_theme_root_get_cache_path (root, dirs);
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  if (!file)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  mtimes_size = (dirs->len + 1) * sizeof (guint64);
+
+  if (length < sizeof (header))
+    goto invalid;
+
+  memcpy (&header, contents, sizeof (header));
+
+  if (memcmp (header.magic, ICON_THEME_CACHE_MAGIC, sizeof (header.magic)) ||
+      header.version != ICON_THEME_CACHE_VERSION ||
+      header.n_dirs != dirs->len ||
+      header.mtimes_offset > length ||
+      length - header.mtimes_offset < mtimes_size ||
+      header.path_offset >= length ||
+      header.cache_offset > length ||
+      length - header.cache_offset < header.cache_size)
+    goto invalid;
+
+  /* Make sure this is the cache of the same directory */
+  path = contents + header.path_offset;
+  if (!memchr (path, '\0', length - header.path_offset) ||
+      !g_str_equal (path, root->path))
+    goto invalid;
+
+  /* and that nothing has been added to or removed from the theme since */
+  if (memcmp (mtimes, contents + header.mtimes_offset, mtimes_size))
+    goto invalid;
+
+  return mx_icon_theme_root_set_cache (root, file, header.cache_offset,
+                                       header.cache_size, dir_names);
+
+invalid:
+  g_mapped_file_unref (file);
+  return FALSE;
+}
+
+static void
+mx_icon_theme_root_scan (MxIconThemeRoot *root,
+                         GArray          *dirs)
+{
+  guint i;
+
+  root->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)g_array_unref);
+
+  for (i = 0; i < dirs->len; i++)
+    {
+      GDir *dir;
+      gchar *path;
+      const gchar *file;
+
+      MxIconThemeDir *theme_dir = &g_array_index (dirs, MxIconThemeDir, i);
+
+      path = g_build_filename (root->path, theme_dir->name, NULL);
+      dir = g_dir_open (path, 0, NULL);
+      g_free (path);
+
+      if (!dir)
+        continue;
+
+      while ((file = g_dir_read_name (dir)))
+        {
+          gint ext;
+          gchar *name;
+          GArray *files;
+          MxIconThemeFile icon_file;
+
+          const gchar *suffix = strrchr (file, '.');
+
+          if (!suffix)
+            continue;
+
+          for (ext = 0; ext < MX_ICON_N_EXTENSIONS; ext++)
+            if (g_str_equal (suffix, mx_icon_extensions[ext]))
+              break;
+
+          if (ext == MX_ICON_N_EXTENSIONS)
+            continue;
+
+          name = g_strndup (file, suffix - file);
+          files = g_hash_table_lookup (root->icons, name);
+          if (!files)
+            {
+              files = g_array_sized_new (FALSE, FALSE,
+                                         sizeof (MxIconThemeFile), 1);
+              g_hash_table_insert (root->icons, name, files);
+            }
+          else
+            g_free (name);
+
+          /* Only keep one file per directory, preferring png, then svg
+           * and then xpm */
+          if (files->len)
+            {
+              MxIconThemeFile *last =
+                &g_array_index (files, MxIconThemeFile, files->len - 1);
+
+              if (last->dir == i)
+                {
+                  last->extension = MIN (last->extension, ext);
+                  continue;
+                }
+            }
+
+          icon_file.dir = i;
+          icon_file.root = 0;
+          icon_file.extension = ext;
+          g_array_append_val (files, icon_file);
+        }
+
+      g_dir_close (dir);
+    }
+}
+
+/* The hash function gtk-update-icon-cache uses for icon names */
+static guint32
+mx_icon_theme_cache_hash (const gchar *icon)
+{
+  const signed char *p = (const signed char *)icon;
+  guint32 hash = *p;
+
+  if (hash)
+    for (p += 1; *p != '\0'; p++)
+      hash = (hash << 5) - hash + *p;
+
+  return hash;
+}
+
+static void
+mx_icon_theme_cache_append_uint16 (GByteArray *cache,
+                                   guint16     value)
+{
+  value = GUINT16_TO_BE (value);
+  g_byte_array_append (cache, (const guint8 *)&value, sizeof (value));
+}
+
+static void
+mx_icon_theme_cache_append_uint32 (GByteArray *cache,
+                                   guint32     value)
+{
+  value = GUINT32_TO_BE (value);
+  g_byte_array_append (cache, (const guint8 *)&value, sizeof (value));
+}
+
+static guint32
+mx_icon_theme_cache_get_uint32 (GByteArray *cache,
+                                guint32     offset)
+{
+  guint32 value;
+
+  memcpy (&value, cache->data + offset, sizeof (value));
+
+  return GUINT32_FROM_BE (value);
+}
+
+static void
+mx_icon_theme_cache_set_uint32 (GByteArray *cache,
+                                guint32     offset,
+                                guint32     value)
+{
+  value = GUINT32_TO_BE (value);
+  memcpy (cache->data + offset, &value, sizeof (value));
+}
+
+static void
+mx_icon_theme_cache_append_string (GByteArray  *cache,
+                                   const gchar *string)
+{
+  static const guint8 padding[4] = { 0, };
+
+  g_byte_array_append (cache, (const guint8 *)string, strlen (string) + 1);
+  g_byte_array_append (cache, padding, (4 - cache->len % 4) % 4);
+}
+
+/* Writes the scanned index of @root to the user's cache directory, as it
+ * was when the directories had @mtimes */
+static void
+mx_icon_theme_root_save_cache (MxIconThemeRoot *root,
+                               GArray          *dirs,
+                               const guint64   *mtimes)
 {
+  static const guint16 flags[MX_ICON_N_EXTENSIONS] =
+    { ICON_CACHE_HAS_PNG, ICON_CACHE_HAS_SVG, ICON_CACHE_HAS_XPM };
+  static const guint8 padding[8] = { 0, };
+
+  MxIconThemeCacheHeader header;
+  GByteArray *cache, *contents;
+  guint32 dir_list, hash, n_buckets;
+  gchar *filename, *dirname;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  cache = g_byte_array_new ();
+
+  /* gtk's header, the offsets are filled in below */
+  mx_icon_theme_cache_append_uint16 (cache, ICON_CACHE_MAJOR_VERSION);
+  mx_icon_theme_cache_append_uint16 (cache, 0);
+  mx_icon_theme_cache_append_uint32 (cache, 0);
+  mx_icon_theme_cache_append_uint32 (cache, 0);
+
+  dir_list = cache->len;
+  mx_icon_theme_cache_set_uint32 (cache, 8, dir_list);
+  mx_icon_theme_cache_append_uint32 (cache, dirs->len);
+  for (i = 0; i < dirs->len; i++)
+    mx_icon_theme_cache_append_uint32 (cache, 0);
+
+  hash = cache->len;
+  n_buckets = g_hash_table_size (root->icons) / 2 + 1;
+  mx_icon_theme_cache_set_uint32 (cache, 4, hash);
+  mx_icon_theme_cache_append_uint32 (cache, n_buckets);
+  for (i = 0; i < n_buckets; i++)
+    mx_icon_theme_cache_append_uint32 (cache, ICON_CACHE_NONE);
+
+  for (i = 0; i < dirs->len; i++)
+    {
+      mx_icon_theme_cache_set_uint32 (cache, dir_list + 4 + i * 4,
+                                      cache->len);
+      mx_icon_theme_cache_append_string (cache,
+                                         g_array_index (dirs, MxIconThemeDir,
+                                                        i).name);
+    }
+
+  /* Each icon is followed by its list of images and then its name */
+  g_hash_table_iter_init (&iter, root->icons);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const gchar *name = key;
+      GArray *files = value;
+      guint32 icon = cache->len;
+      guint32 bucket, chain;
+
+      /* add the icon to the start of its bucket's chain */
+      bucket = hash + 4 + (mx_icon_theme_cache_hash (name) % n_buckets) * 4;
+      chain = mx_icon_theme_cache_get_uint32 (cache, bucket);
+      mx_icon_theme_cache_set_uint32 (cache, bucket, icon);
+
+      mx_icon_theme_cache_append_uint32 (cache, chain);
+
+      mx_icon_theme_cache_append_uint32 (cache, icon + 16 + files->len * 8);
+      mx_icon_theme_cache_append_uint32 (cache, icon + 12);
+
+      mx_icon_theme_cache_append_uint32 (cache, files->len);
+      for (i = 0; i < files->len; i++)
+        {
+          MxIconThemeFile *file = &g_array_index (files, MxIconThemeFile, i);
+
+          mx_icon_theme_cache_append_uint16 (cache, file->dir);
+          mx_icon_theme_cache_append_uint16 (cache, flags[file->extension]);
+          mx_icon_theme_cache_append_uint32 (cache, 0);
+        }
+
+      mx_icon_theme_cache_append_string (cache, name);
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, ICON_THEME_CACHE_MAGIC, sizeof (header.magic));
+  header.version = ICON_THEME_CACHE_VERSION;
+  header.n_dirs = dirs->len;
+  header.mtimes_offset = sizeof (header);
+  header.path_offset = header.mtimes_offset +
+    (dirs->len + 1) * sizeof (guint64);
+  header.cache_offset = header.path_offset + strlen (root->path) + 1;
+  header.cache_offset += (8 - header.cache_offset % 8) % 8;
+  header.cache_size = cache->len;
+
+  contents = g_byte_array_sized_new (header.cache_offset + cache->len);
+  g_byte_array_append (contents, (const guint8 *)&header, sizeof (header));
+  g_byte_array_append (contents, (const guint8 *)mtimes,
+                       (dirs->len + 1) * sizeof (guint64));
+  g_byte_array_append (contents, (const guint8 *)root->path,
+                       strlen (root->path) + 1);
+  g_byte_array_append (contents, padding,
+                       header.cache_offset - contents->len);
+  g_byte_array_append (contents, cache->data, cache->len);
+
+  filename = mx_icon_theme_root_get_cache_path (root, dirs);
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  /* this replaces any old file atomically, so readers only ever see a
+   * complete cache */
+  g_file_set_contents (filename, (const gchar *)contents->data,
+                       contents->len, NULL);
+
+  g_free (dirname);
+  g_free (filename);
+  g_byte_array_free (contents, TRUE);
+  g_byte_array_free (cache, TRUE);
+}
+
+static MxIconThemeIndex *
+mx_icon_theme_index_new (MxIconTheme *self,
+                         GKeyFile    *theme_file)
+{
+  gint i;
+  GList *p;
   gchar *dirs;
+  gchar **names;
   const gchar *theme;
+  GHashTable *dir_names;
+  MxIconThemeIndex *index;
 
-  GList *data = NULL;
   MxIconThemePrivate *priv = self->priv;
 
+  theme = g_hash_table_lookup (priv->theme_path_hash, theme_file);
+
   dirs = g_key_file_get_string (theme_file,
                                 "Icon Theme",
                                 "Directories",
                                 NULL);
-  theme = g_hash_table_lookup (priv->theme_path_hash, theme_file);
-
   if (!dirs)
     {
-      GList *p;
       GString *string;
 
       /* Icon theme hasn't specified directories, so recurse and
@@ -607,137 +1323,328 @@ mx_icon_theme_theme_load_icon (MxIconTheme *self,
           g_free (path);
         }
 
-      /* Chop off the trailing comma */
-      g_string_truncate (string, string->len - 1);
-
-      dirs = string->str;
-      g_string_free (string, FALSE);
+      dirs = g_string_free (string, FALSE);
     }
 
-  if (dirs)
-    {
-      gint i;
-      gint dirs_len = strlen (dirs);
+  index = g_new0 (MxIconThemeIndex, 1);
+  index->dirs = g_array_new (FALSE, FALSE, sizeof (MxIconThemeDir));
+  index->roots =
+    g_ptr_array_new_with_free_func ((GDestroyNotify)mx_icon_theme_root_free);
 
-      g_strdelimit (dirs, ",", '\0');
+  dir_names = g_hash_table_new (g_str_hash, g_str_equal);
 
-      i = 0;
-      while (i < dirs_len)
-        {
-          GList *p;
-          MxIconType type;
-          gchar *type_string;
-          gint size, min, max, threshold;
+  names = g_strsplit (dirs, ",", -1);
+  g_free (dirs);
 
-          const gchar *dir = dirs + i;
-          i += strlen (dir) + 1;
+  for (i = 0; names[i] && index->dirs->len < G_MAXUINT16; i++)
+    {
+      MxIconThemeDir dir;
+      gchar *type_string;
+
+      const gchar *name = names[i];
 
-          size = g_key_file_get_integer (theme_file,
-                                         dir,
+      if (!*name || g_hash_table_lookup_extended (dir_names, name, NULL, NULL))
+        continue;
+
+      dir.size = g_key_file_get_integer (theme_file,
+                                         name,
                                          "Size",
                                          NULL);
-          if (!size)
-            {
-              /* Try to get size from dir name */
-              size = atoi (dir);
-              if (!size)
-                continue;
-            }
+      if (!dir.size)
+        {
+          /* Try to get size from dir name */
+          dir.size = atoi (name);
+          if (!dir.size)
+            continue;
+        }
 
-          type_string = g_key_file_get_string (theme_file,
-                                               dir,
-                                               "Type",
-                                               NULL);
+      type_string = g_key_file_get_string (theme_file,
+                                           name,
+                                           "Type",
+                                           NULL);
 
-          type = MX_FIXED;
-          min = max = threshold = 0;
-          if (type_string)
+      dir.type = MX_FIXED;
+      dir.min_size = dir.max_size = dir.threshold = 0;
+      if (type_string)
+        {
+          if (g_str_equal (type_string, "Scalable"))
             {
-              if (g_str_equal (type_string, "Scalable"))
-                {
-                  type = MX_SCALABLE;
-                  min = g_key_file_get_integer (theme_file,
-                                                dir,
-                                                "MinSize",
-                                                NULL);
-                  if (!min)
-                    min = size;
-
-                  max = g_key_file_get_integer (theme_file,
-                                                dir,
-                                                "MaxSize",
-                                                NULL);
-                  if (!max)
-                    max = size;
-                }
-              else if (g_str_equal (type_string, "Threshold"))
-                {
-                  type = MX_THRESHOLD;
-                  threshold = g_key_file_get_integer (theme_file,
-                                                      dir,
+              dir.type = MX_SCALABLE;
+              dir.min_size = g_key_file_get_integer (theme_file,
+                                                     name,
+                                                     "MinSize",
+                                                     NULL);
+              if (!dir.min_size)
+                dir.min_size = dir.size;
+
+              dir.max_size = g_key_file_get_integer (theme_file,
+                                                     name,
+                                                     "MaxSize",
+                                                     NULL);
+              if (!dir.max_size)
+                dir.max_size = dir.size;
+            }
+          else if (g_str_equal (type_string, "Threshold"))
+            {
+              dir.type = MX_THRESHOLD;
+              dir.threshold = g_key_file_get_integer (theme_file,
+                                                      name,
                                                       "Threshold",
                                                       NULL);
-                  if (!threshold)
-                    threshold = 2;
+              if (!dir.threshold)
+                dir.threshold = 2;
 
-                  min = size - threshold;
-                  max = size + threshold;
-                }
-              g_free (type_string);
+              dir.min_size = dir.size - dir.threshold;
+              dir.max_size = dir.size + dir.threshold;
             }
+          g_free (type_string);
+        }
+
+      dir.name = g_strdup (name);
+      g_hash_table_insert (dir_names, dir.name,
+                           GINT_TO_POINTER (index->dirs->len));
+      g_array_append_val (index->dirs, dir);
+    }
+
+  g_strfreev (names);
 
-          for (p = priv->search_paths; p; p = p->next)
+  /* Index the theme in each of the search paths it's in */
+  for (p = priv->search_paths;
+       p && index->roots->len < G_MAXUINT16;
+       p = p->next)
+    {
+      MxIconThemeRoot *root;
+      const gchar *search_path = p->data;
+      gchar *path = g_build_filename (search_path, theme, NULL);
+
+      if (!g_file_test (path, G_FILE_TEST_IS_DIR))
+        {
+          g_free (path);
+          continue;
+        }
+
+      root = g_new0 (MxIconThemeRoot, 1);
+      root->path = path;
+
+      if (!mx_icon_theme_root_load_cache (root, dir_names))
+        {
+          /* Find when the directories last changed before reading them, so
+           * that changes made while scanning invalidate what's saved */
+          guint64 *mtimes = mx_icon_theme_root_get_mtimes (root, index->dirs);
+
+          if (!mx_icon_theme_root_load_mx_cache (root, index->dirs, mtimes,
+                                                 dir_names))
             {
-              gchar *file;
-
-              MxIconData *icon_data = NULL;
-              const gchar *search_path = p->data;
-              gchar *path = g_build_filename (search_path,
-                                              theme,
-                                              dir,
-                                              NULL);
-
-              /* Try png first, then svg and xpm */
-              file = g_strconcat (path, G_DIR_SEPARATOR_S, icon, ".png", NULL);
-              if (!g_file_test (file, G_FILE_TEST_EXISTS |
-                                      G_FILE_TEST_IS_REGULAR))
-                {
-                  g_free (file);
-                  file = g_strconcat (path, G_DIR_SEPARATOR_S, icon, ".svg",
-                                      NULL);
-                  if (!g_file_test (file, G_FILE_TEST_EXISTS |
-                                          G_FILE_TEST_IS_REGULAR))
-                    {
-                      g_free (file);
-                      file = g_strconcat (path, G_DIR_SEPARATOR_S, icon, ".xpm",
-                                          NULL);
-                      if (!g_file_test (file, G_FILE_TEST_EXISTS |
-                                              G_FILE_TEST_IS_REGULAR))
-                        {
-                          g_free (file);
-                          file = NULL;
-                        }
-                    }
-                }
+              mx_icon_theme_root_scan (root, index->dirs);
 
-              if (file)
-                {
-                  icon_data = mx_icon_theme_icon_data_new (size,
-                                                           file,
-                                                           type,
-                                                           min,
-                                                           max,
-                                                           threshold);
-                  g_free (file);
-
-                  data = g_list_prepend (data, icon_data);
-                }
-              g_free (path);
+              if (mx_icon_theme_root_mtimes_settled (mtimes, index->dirs))
+                mx_icon_theme_root_save_cache (root, index->dirs, mtimes);
             }
+
+          g_free (mtimes);
+        }
+
+      g_ptr_array_add (index->roots, root);
+    }
+
+  g_hash_table_unref (dir_names);
+
+  return index;
+}
+
+static MxIconThemeIndex *
+mx_icon_theme_get_index (MxIconTheme *self,
+                         GKeyFile    *theme_file)
+{
+  MxIconThemeIndex *index;
+  MxIconThemePrivate *priv = self->priv;
+
+  index = g_hash_table_lookup (priv->theme_index_hash, theme_file);
+  if (!index)
+    {
+      index = mx_icon_theme_index_new (self, theme_file);
+      g_hash_table_insert (priv->theme_index_hash, theme_file, index);
+    }
+
+  return index;
+}
+
+static void
+mx_icon_theme_root_lookup_cache (MxIconThemeRoot *root,
+                                 guint16          root_index,
+                                 const gchar     *icon,
+                                 GArray          *files)
+{
+  gsize chain_length;
+  guint32 hash_offset, n_buckets, offset, bucket;
+
+  if (!mx_icon_theme_root_read_uint32 (root, 4, &hash_offset) ||
+      !mx_icon_theme_root_read_uint32 (root, hash_offset, &n_buckets) ||
+      !n_buckets)
+    return;
+
+  bucket = mx_icon_theme_cache_hash (icon) % n_buckets;
+  if (!mx_icon_theme_root_read_uint32 (root, hash_offset + 4 + bucket * 4,
+                                       &offset))
+    return;
+
+  /* Follow the chain of icons in the bucket, making sure that a broken
+   * cache can't send us round in circles */
+  for (chain_length = 0;
+       offset != ICON_CACHE_NONE && chain_length < root->cache_length / 12;
+       chain_length++)
+    {
+      guint32 chain, name, image_list, n_images, i;
+      const gchar *name_string;
+
+      if (!mx_icon_theme_root_read_uint32 (root, offset, &chain) ||
+          !mx_icon_theme_root_read_uint32 (root, offset + 4, &name) ||
+          !(name_string = mx_icon_theme_root_read_string (root, name)))
+        return;
+
+      if (!g_str_equal (name_string, icon))
+        {
+          offset = chain;
+          continue;
+        }
+
+      if (!mx_icon_theme_root_read_uint32 (root, offset + 8, &image_list) ||
+          !mx_icon_theme_root_read_uint32 (root, image_list, &n_images))
+        return;
+
+      for (i = 0; i < n_images; i++)
+        {
+          guint16 dir, flags;
+          MxIconThemeFile file;
+
+          if (!mx_icon_theme_root_read_uint16 (root, image_list + 4 + i * 8,
+                                               &dir) ||
+              !mx_icon_theme_root_read_uint16 (root, image_list + 6 + i * 8,
+                                               &flags))
+            return;
+
+          if (dir >= root->n_cache_dirs || root->cache_dirs[dir] < 0)
+            continue;
+
+          if (flags & ICON_CACHE_HAS_PNG)
+            file.extension = MX_ICON_PNG;
+          else if (flags & ICON_CACHE_HAS_SVG)
+            file.extension = MX_ICON_SVG;
+          else if (flags & ICON_CACHE_HAS_XPM)
+            file.extension = MX_ICON_XPM;
+          else
+            continue;
+
+          file.dir = root->cache_dirs[dir];
+          file.root = root_index;
+          g_array_append_val (files, file);
+        }
+
+      return;
+    }
+}
+
+static gint
+mx_icon_theme_file_compare (gconstpointer a,
+                            gconstpointer b)
+{
+  const MxIconThemeFile *file_a = a;
+  const MxIconThemeFile *file_b = b;
+
+  if (file_a->dir != file_b->dir)
+    return (file_a->dir < file_b->dir) ? -1 : 1;
+
+  if (file_a->root != file_b->root)
+    return (file_a->root < file_b->root) ? -1 : 1;
+
+  return 0;
+}
+
+/* Finds the files of an icon, in the order of the theme's directories and
+ * then of the search paths */
+static GArray *
+mx_icon_theme_index_lookup (MxIconThemeIndex *index,
+                            const gchar      *icon)
+{
+  guint i, j;
+  GArray *files;
+
+  files = g_array_new (FALSE, FALSE, sizeof (MxIconThemeFile));
+
+  for (i = 0; i < index->roots->len; i++)
+    {
+      GArray *root_files;
+      MxIconThemeRoot *root = g_ptr_array_index (index->roots, i);
+
+      if (root->cache)
+        {
+          mx_icon_theme_root_lookup_cache (root, i, icon, files);
+          continue;
+        }
+
+      root_files = g_hash_table_lookup (root->icons, icon);
+      if (!root_files)
+        continue;
+
+      for (j = 0; j < root_files->len; j++)
+        {
+          MxIconThemeFile file =
+            g_array_index (root_files, MxIconThemeFile, j);
+
+          file.root = i;
+          g_array_append_val (files, file);
         }
-      g_free (dirs);
     }
 
+  g_array_sort (files, mx_icon_theme_file_compare);
+
+  return files;
+}
+
+static GList *
+mx_icon_theme_theme_load_icon (MxIconTheme *self,
+                               GKeyFile    *theme_file,
+                               const gchar *icon,
+                               GIcon       *store_icon,
+                               gboolean     store_fail)
+{
+  guint i;
+  GArray *files;
+  MxIconThemeIndex *index;
+
+  GList *data = NULL;
+  MxIconThemePrivate *priv = self->priv;
+
+  index = mx_icon_theme_get_index (self, theme_file);
+  files = mx_icon_theme_index_lookup (index, icon);
+
+  for (i = 0; i < files->len; i++)
+    {
+      gchar *path;
+      MxIconData *icon_data;
+
+      MxIconThemeFile *file = &g_array_index (files, MxIconThemeFile, i);
+      MxIconThemeRoot *root = g_ptr_array_index (index->roots, file->root);
+      MxIconThemeDir *dir =
+        &g_array_index (index->dirs, MxIconThemeDir, file->dir);
+
+      path = g_strconcat (root->path, G_DIR_SEPARATOR_S,
+                          dir->name, G_DIR_SEPARATOR_S,
+                          icon, mx_icon_extensions[file->extension],
+                          NULL);
+      icon_data = mx_icon_theme_icon_data_new (dir->size,
+                                               path,
+                                               dir->type,
+                                               dir->min_size,
+                                               dir->max_size,
+                                               dir->threshold);
+      g_free (path);
+
+      data = g_list_prepend (data, icon_data);
+    }
+
+  g_array_free (files, TRUE);
+
   if (data || store_fail)
     {
       data = g_list_reverse (data);
@@ -917,13 +1824,159 @@ mx_icon_theme_lookup_internal (MxIconTheme *theme,
   return best_match;
 }
 
+/* The identifier icons drawn at @size are cached with. The size is tagged
+ * with bit 30, which leaves it clear of quarks and, with the top bit unset,
+ * of the identifiers MxImage caches scaled images with. */
+static gpointer
+mx_icon_theme_get_size_ident (gint size)
+{
+  return GUINT_TO_POINTER (((guint) size & 0x3fffffff) | 0x40000000);
+}
+
+/* Whether drawing the icon at @size gives a better result than the file at
+ * its own size */
+static gboolean
+mx_icon_theme_needs_rasterizing (MxIconData *icon_data,
+                                 gint        size)
+{
+  if (icon_data->type == MX_FIXED)
+    return FALSE;
+
+  return (size != icon_data->size) ||
+    g_str_has_suffix (icon_data->path, ".svg");
+}
+
+static GdkPixbuf *
+mx_icon_theme_rasterize (const gchar *path,
+                         gint         size)
+{
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = gdk_pixbuf_new_from_file_at_size (path, size, size, &error);
+  if (!pixbuf)
+    {
+      g_warning ("Error loading icon \"%s\": %s", path, error->message);
+      g_error_free (error);
+    }
+
+  return pixbuf;
+}
+
+static CoglHandle
+mx_icon_theme_texture_new_from_pixbuf (GdkPixbuf *pixbuf)
+{
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+
+  return cogl_texture_new_from_data (gdk_pixbuf_get_width (pixbuf),
+                                     gdk_pixbuf_get_height (pixbuf),
+                                     COGL_TEXTURE_NONE,
+                                     has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 :
+                                                 COGL_PIXEL_FORMAT_RGB_888,
+                                     COGL_PIXEL_FORMAT_ANY,
+                                     gdk_pixbuf_get_rowstride (pixbuf),
+                                     gdk_pixbuf_get_pixels (pixbuf));
+}
+
+static gboolean
+mx_icon_theme_load_complete_cb (MxIconThemeLoad *load)
+{
+  GSList *t;
+  MxTextureCache *texture_cache;
+
+  CoglHandle texture = NULL;
+  MxIconTheme *theme = load->theme;
+
+  if (load->pixbuf)
+    texture = mx_icon_theme_texture_new_from_pixbuf (load->pixbuf);
+
+  if (texture)
+    {
+      texture_cache = mx_texture_cache_get_default ();
+      mx_texture_cache_insert_meta (texture_cache, load->path,
+                                    mx_icon_theme_get_size_ident (load->size),
+                                    texture, NULL);
+    }
+
+  /* Give the icon to all the textures that are still around */
+  for (t = load->textures; t; t = t->next)
+    {
+      if (!t->data)
+        continue;
+
+      if (texture)
+        clutter_texture_set_cogl_texture (t->data, texture);
+
+      g_object_remove_weak_pointer (t->data, &t->data);
+    }
+
+  if (texture)
+    cogl_handle_unref (texture);
+
+  g_hash_table_remove (theme->priv->loads, load->key);
+  g_object_unref (theme);
+
+  return FALSE;
+}
+
+/* called from the threads */
+static void
+mx_icon_theme_load_cb (MxIconThemeLoad *load,
+                       gpointer         user_data)
+{
+  load->pixbuf = mx_icon_theme_rasterize (load->path, load->size);
+
+  clutter_threads_add_idle_full (G_PRIORITY_DEFAULT_IDLE,
+                                 (GSourceFunc)mx_icon_theme_load_complete_cb,
+                                 load, NULL);
+}
+
+/* Draws the icon at @path at @size in a thread and sets it on @texture once
+ * it's done. Loads of the same icon at the same size are shared. */
+static void
+mx_icon_theme_queue_load (MxIconTheme    *theme,
+                          const gchar    *path,
+                          gint            size,
+                          ClutterTexture *texture)
+{
+  gchar *key;
+  MxIconThemeLoad *load;
+  MxIconThemePrivate *priv = theme->priv;
+
+  key = g_strdup_printf ("%d:%s", size, path);
+  load = g_hash_table_lookup (priv->loads, key);
+
+  if (load)
+    g_free (key);
+  else
+    {
+      load = g_slice_new0 (MxIconThemeLoad);
+      load->theme = g_object_ref (theme);
+      load->key = key;
+      load->path = g_strdup (path);
+      load->size = size;
+
+      g_hash_table_insert (priv->loads, load->key, load);
+
+      if (!priv->load_pool)
+        priv->load_pool = g_thread_pool_new ((GFunc)mx_icon_theme_load_cb,
+                                             NULL, ICON_LOAD_THREADS, FALSE,
+                                             NULL);
+      g_thread_pool_push (priv->load_pool, load, NULL);
+    }
+
+  load->textures = g_slist_prepend (load->textures, texture);
+  g_object_add_weak_pointer (G_OBJECT (texture), &load->textures->data);
+}
+
 /**
  * mx_icon_theme_lookup:
  * @theme: an #MxIconTheme
  * @icon_name: The name of the icon
  * @size: The desired size of the icon
  *
- * If the icon is available, returns a #CoglHandle of the icon.
+ * If the icon is available, returns a #CoglHandle of the icon. Scalable icons
+ * are drawn at @size.
  *
  * Return value: (transfer none): a #CoglHandle of the icon, or %NULL.
  */
@@ -934,6 +1987,9 @@ mx_icon_theme_lookup (MxIconTheme *theme,
 {
   MxTextureCache *texture_cache;
   MxIconData *icon_data;
+  CoglHandle texture;
+  GdkPixbuf *pixbuf;
+  gpointer ident;
 
   g_return_val_if_fail (MX_IS_ICON_THEME (theme), NULL);
   g_return_val_if_fail (icon_name, NULL);
@@ -943,7 +1999,28 @@ mx_icon_theme_lookup (MxIconTheme *theme,
     return NULL;
 
   texture_cache = mx_texture_cache_get_default ();
-  return mx_texture_cache_get_cogl_texture (texture_cache, icon_data->path);
+
+  if (!mx_icon_theme_needs_rasterizing (icon_data, size))
+    return mx_texture_cache_get_cogl_texture (texture_cache, icon_data->path);
+
+  ident = mx_icon_theme_get_size_ident (size);
+  texture = mx_texture_cache_get_meta_cogl_texture (texture_cache,
+                                                    icon_data->path, ident);
+  if (texture)
+    return texture;
+
+  /* The texture is needed straight away, so draw it here */
+  if (!(pixbuf = mx_icon_theme_rasterize (icon_data->path, size)))
+    return NULL;
+
+  texture = mx_icon_theme_texture_new_from_pixbuf (pixbuf);
+  g_object_unref (pixbuf);
+
+  if (texture)
+    mx_texture_cache_insert_meta (texture_cache, icon_data->path, ident,
+                                  texture, NULL);
+
+  return texture;
 }
 
 /**
@@ -952,7 +2029,9 @@ mx_icon_theme_lookup (MxIconTheme *theme,
  * @icon_name: The name of the icon
  * @size: The desired size of the icon
  *
- * If the icon is available, returns a #ClutterTexture of the icon.
+ * If the icon is available, returns a #ClutterTexture of the icon. Scalable
+ * icons are drawn at @size in a thread, and the texture is empty until they
+ * have been.
  *
  * Return value: (transfer none): a #ClutterTexture of the icon, or %NULL.
  */
@@ -963,6 +2042,7 @@ mx_icon_theme_lookup_texture (MxIconTheme *theme,
 {
   MxTextureCache *texture_cache;
   MxIconData *icon_data;
+  ClutterTexture *texture;
 
   g_return_val_if_fail (MX_IS_ICON_THEME (theme), NULL);
   g_return_val_if_fail (icon_name, NULL);
@@ -972,7 +2052,21 @@ mx_icon_theme_lookup_texture (MxIconTheme *theme,
     return NULL;
 
   texture_cache = mx_texture_cache_get_default ();
-  return mx_texture_cache_get_texture (texture_cache, icon_data->path);
+
+  if (!mx_icon_theme_needs_rasterizing (icon_data, size))
+    return mx_texture_cache_get_texture (texture_cache, icon_data->path);
+
+  texture =
+    mx_texture_cache_get_meta_texture (texture_cache, icon_data->path,
+                                       mx_icon_theme_get_size_ident (size));
+  if (texture)
+    return texture;
+
+  /* The texture stays empty until the icon has been drawn */
+  texture = CLUTTER_TEXTURE (clutter_texture_new ());
+  mx_icon_theme_queue_load (theme, icon_data->path, size, texture);
+
+  return texture;
 }
 
 gboolean
@@ -1033,4 +2127,7 @@ mx_icon_theme_set_search_paths (MxIconTheme *theme,
   priv->search_paths = g_list_copy ((GList *)paths);
   for (p = priv->search_paths; p; p = p->next)
     p->data = g_strdup ((const gchar *)p->data);
+
+  /* The themes will be indexed again in the new paths */
+  g_hash_table_remove_all (priv->theme_index_hash);
 }
@@ -28,7 +28,11 @@
  * Since: 1.2
  */
 
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
 #include <cogl/cogl.h>
 
 #include "mx-image.h"
@@ -45,6 +49,57 @@ G_DEFINE_TYPE (MxImage, mx_image, MX_TYPE_WIDGET)
 
 #define DEFAULT_DURATION 250
 
+/* decoded images waiting to be uploaded stop more from being decoded once
+ * they add up to this many bytes */
+#define MAX_BYTES_IN_FLIGHT (32 * 1024 * 1024)
+
+/* how long, in milliseconds, and how many bytes of decoded images to spend
+ * uploading textures before letting a frame be drawn */
+#define UPLOAD_TIME_SLICE 5
+#define UPLOAD_BYTES_PER_SLICE (4 * 1024 * 1024)
+
+/* how much of an image file is given to the decoder at a time */
+#define LOAD_CHUNK_SIZE (64 * 1024)
+
+/* Scaled images can be kept on disk, in the user's cache directory, so that
+ * loading them again needs no decoding or scaling. Each file holds the
+ * pixels of one image, as a header followed by the rows of pixels with no
+ * padding, in a form that can be mapped and uploaded as it is. They are
+ * only read by the machine that wrote them, so use its byte order. */
+#define THUMBNAIL_MAGIC   "MxThumb\n"
+#define THUMBNAIL_VERSION 2
+
+/* Thumbnails not used for THUMBNAIL_MAX_AGE seconds are removed, and then
+ * the least recently used ones while there are more than THUMBNAIL_MAX_SIZE
+ * bytes of them. The directory is checked once every THUMBNAIL_PRUNE_INTERVAL
+ * thumbnails saved, starting with the first. */
+#define THUMBNAIL_MAX_AGE        (30 * 24 * 60 * 60)
+#define THUMBNAIL_MAX_SIZE       (256 * 1024 * 1024)
+#define THUMBNAIL_PRUNE_INTERVAL 64
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 has_alpha;
+  guint32 reserved;
+  guint64 mtime;        /* of the source file, in microseconds */
+} MxImageThumbnailHeader;
+
+/* what an image cached in memory at a size was loaded from */
+typedef struct
+{
+  guint64  mtime;
+  gint     width;
+  gint     height;
+  guint    width_threshold;
+  guint    height_threshold;
+  gboolean upscale;
+} MxImageCacheKey;
+
 /* This stucture holds all that is necessary for cancellable async
  * image loading using thread pools.
  *
@@ -55,25 +110,44 @@ G_DEFINE_TYPE (MxImage, mx_image, MX_TYPE_WIDGET)
  * The thread handler uses this to indicate that the load was completed.
  *
  * The thread will take the mutex while it's loading data - if cancelled
- * is set when it takes the mutex, it will add the idle handler and let the
- * main thread free the data.
+ * is set when it takes the mutex, it will add the structure to the upload
+ * queue and let the main thread free the data.
  *
- * The idle handler will check that the cancelled member isn't set and if not,
- * will try to upload the image using mx_image_set_from_pixbuf(). It will free
+ * The upload queue is emptied by an idle handler, a few images at a time so
+ * that a burst of completed loads doesn't hold up drawing a frame. For each
+ * image, it will check that the cancelled member isn't set and if not, will
+ * try to upload the image using mx_image_set_from_pixbuf(). It will free
  * the async structure always. It will also reset the pointer to the task in
  * the MxImage priv struct, but only if the cancelled member *isn't* set.
+ *
+ * Rather than being handed to the thread-pool directly, the structure waits
+ * in a queue sorted by whether the image is mapped, its load priority and
+ * the order the loads were started in. Each push to the thread-pool lets a
+ * thread take the first load from the queue. Until a thread takes it, the
+ * load can be changed or dropped by the main thread, and one whose image has
+ * been unmapped waits in the queue until the image is mapped again. The
+ * members protected by mx_image_queue_lock are marked below.
  */
 typedef struct
 {
   MxImage   *parent;
 
+  /* protected by mx_image_queue_lock */
+  GSequenceIter  *queue_iter;
+  guint           serial;
+  gint            priority;
+  gboolean        mapped;
+  gboolean        was_mapped;
+  gsize           bytes;
+
   GMutex          mutex;
   guint           complete  : 1;
   guint           cancelled : 1;
   guint           upscale   : 1;
-  guint           idle_handler;
+  guint           cache_thumbnails : 1;
 
   gchar          *filename;
+  guint64         mtime;
   guchar         *buffer;
   gsize           count;
   GDestroyNotify  free_func;
@@ -83,6 +157,8 @@ typedef struct
   guint           width_threshold;
   guint           height_threshold;
 
+  GCancellable   *cancellable;
+
   GdkPixbuf      *pixbuf;
   GError         *error;
 } MxImageAsyncData;
@@ -93,6 +169,7 @@ struct _MxImagePrivate
   MxImageScaleMode previous_mode;
   guint            load_async : 1;
   guint            upscale    : 1;
+  guint            cache_thumbnails : 1;
   guint            width_threshold;
   guint            height_threshold;
 
@@ -113,6 +190,8 @@ struct _MxImagePrivate
 
   guint transition_duration;
 
+  gint load_priority;
+
   MxImageAsyncData *async_load_data;
 };
 
@@ -128,6 +207,8 @@ enum
   PROP_IMAGE_ROTATION,
   PROP_TRANSITION_DURATION,
   PROP_FILENAME,
+  PROP_LOAD_PRIORITY,
+  PROP_CACHE_THUMBNAILS,
 
   LAST_PROP
 };
@@ -143,13 +224,24 @@ enum
 static guint signals[LAST_SIGNAL] = { 0, };
 
 static GThreadPool *mx_image_threads = NULL;
+static GMutex mx_image_queue_lock;
+static GSequence *mx_image_queue = NULL;
+static guint mx_image_queue_serial = 0;
+static gsize mx_image_bytes_in_flight = 0;
+static GQueue mx_image_uploads = G_QUEUE_INIT;
+static guint mx_image_uploads_source = 0;
+static gint *mx_image_blank_area = NULL;
+static gint mx_image_blank_area_size = 0;
 static GQuark mx_image_cache_quark = 0;
+static CoglUserDataKey mx_image_cache_key;
+
+static gint mx_image_thumbnails_saved = 0;
 
 static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
-                                 gboolean          use_cache,
+                                 gpointer          ident,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
                                  gint              height,
@@ -170,8 +262,7 @@ mx_image_async_data_free (MxImageAsyncData *data)
 
   g_free (data->filename);
 
-  if (data->idle_handler)
-    g_source_remove (data->idle_handler);
+  g_object_unref (data->cancellable);
 
   if (data->pixbuf)
     g_object_unref (data->pixbuf);
@@ -189,15 +280,186 @@ mx_image_async_data_new (MxImage *parent)
 
   data->parent = parent;
   g_mutex_init (&data->mutex);
+  data->cancellable = g_cancellable_new ();
   data->width = -1;
   data->height = -1;
   data->upscale = parent->priv->upscale;
+  data->cache_thumbnails = parent->priv->cache_thumbnails;
   data->width_threshold = parent->priv->width_threshold;
   data->height_threshold = parent->priv->height_threshold;
+  data->priority = parent->priv->load_priority;
+  data->mapped = CLUTTER_ACTOR_IS_MAPPED (parent);
+  data->was_mapped = data->mapped;
+
+  return data;
+}
+
+/* 0 for mapped images, 1 for images that haven't been mapped yet, which may
+ * be loading before they're shown, and 2 for images that have been unmapped
+ * since the load started, which aren't loaded until they're mapped again */
+static gint
+mx_image_async_data_get_rank (const MxImageAsyncData *data)
+{
+  if (data->mapped)
+    return 0;
+  else if (!data->was_mapped)
+    return 1;
+  else
+    return 2;
+}
+
+static gint
+mx_image_async_data_compare (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+  const MxImageAsyncData *data_a = a;
+  const MxImageAsyncData *data_b = b;
+  gint rank_a, rank_b;
+
+  rank_a = mx_image_async_data_get_rank (data_a);
+  rank_b = mx_image_async_data_get_rank (data_b);
+
+  if (rank_a != rank_b)
+    return rank_a - rank_b;
+
+  if (data_a->priority != data_b->priority)
+    return (data_a->priority < data_b->priority) ? -1 : 1;
+
+  return (data_a->serial < data_b->serial) ? -1 :
+    (data_a->serial > data_b->serial);
+}
+
+/* lets a thread look at the queue again */
+static void
+mx_image_queue_kick (void)
+{
+  g_thread_pool_push (mx_image_threads, GINT_TO_POINTER (1), NULL);
+}
+
+static void
+mx_image_queue_push (MxImageAsyncData *data)
+{
+  g_mutex_lock (&mx_image_queue_lock);
+
+  if (!mx_image_queue)
+    mx_image_queue = g_sequence_new (NULL);
+
+  data->serial = mx_image_queue_serial++;
+  data->queue_iter =
+    g_sequence_insert_sorted (mx_image_queue, data,
+                              mx_image_async_data_compare, NULL);
+
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  mx_image_queue_kick ();
+}
+
+/* called from the threads, returns the load to do next, if any */
+static MxImageAsyncData *
+mx_image_queue_pop (void)
+{
+  MxImageAsyncData *data = NULL;
+  gboolean more = FALSE;
+
+  g_mutex_lock (&mx_image_queue_lock);
+
+  if (mx_image_queue && mx_image_bytes_in_flight < MAX_BYTES_IN_FLIGHT)
+    {
+      GSequenceIter *iter = g_sequence_get_begin_iter (mx_image_queue);
+
+      if (!g_sequence_iter_is_end (iter))
+        {
+          data = g_sequence_get (iter);
+
+          if (mx_image_async_data_get_rank (data) < 2)
+            {
+              g_sequence_remove (iter);
+              data->queue_iter = NULL;
+
+              iter = g_sequence_get_begin_iter (mx_image_queue);
+              more = !g_sequence_iter_is_end (iter) &&
+                (mx_image_async_data_get_rank (g_sequence_get (iter)) < 2);
+            }
+          else
+            data = NULL;
+        }
+    }
+
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  /* Wake-ups are used up while the threads are over the byte budget, and
+   * only one comes back with each finished load, so pass one on while there
+   * are loads left to bring the pool back up to full use */
+  if (more)
+    mx_image_queue_kick ();
 
   return data;
 }
 
+/* updates the position of a load in the queue after its sort keys were
+ * changed, must be called with mx_image_queue_lock held */
+static gboolean
+mx_image_queue_update (MxImageAsyncData *data)
+{
+  if (!data->queue_iter)
+    return FALSE;
+
+  g_sequence_sort_changed (data->queue_iter,
+                           mx_image_async_data_compare, NULL);
+
+  return TRUE;
+}
+
+static void
+mx_image_async_data_set_mapped (MxImageAsyncData *data,
+                                gboolean          mapped)
+{
+  gboolean queued;
+
+  g_mutex_lock (&mx_image_queue_lock);
+
+  data->mapped = mapped;
+  if (mapped)
+    data->was_mapped = TRUE;
+
+  queued = mx_image_queue_update (data);
+
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  /* the load may have been passed over while the image was unmapped */
+  if (queued && mapped)
+    mx_image_queue_kick ();
+}
+
+/* Drops a load that hasn't been taken by a thread yet, otherwise marks it as
+ * cancelled and leaves the idle handler to free it */
+static void
+mx_image_async_data_cancel (MxImageAsyncData *data)
+{
+  gboolean queued;
+
+  g_mutex_lock (&mx_image_queue_lock);
+
+  queued = (data->queue_iter != NULL);
+  if (queued)
+    {
+      g_sequence_remove (data->queue_iter);
+      data->queue_iter = NULL;
+    }
+
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  if (queued)
+    mx_image_async_data_free (data);
+  else
+    {
+      /* stop the thread reading any more of the file */
+      data->cancelled = TRUE;
+      g_cancellable_cancel (data->cancellable);
+    }
+}
+
 static void
 get_center_coords (CoglHandle  tex,
                    float       rotation,
@@ -459,6 +721,14 @@ mx_image_set_property (GObject      *object,
       mx_image_set_from_file (image, g_value_get_string (value), NULL);
       break;
 
+    case PROP_LOAD_PRIORITY:
+      mx_image_set_load_priority (image, g_value_get_int (value));
+      break;
+
+    case PROP_CACHE_THUMBNAILS:
+      mx_image_set_cache_thumbnails (image, g_value_get_boolean (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -503,6 +773,14 @@ mx_image_get_property (GObject    *object,
       g_value_set_uint (value, priv->transition_duration);
       break;
 
+    case PROP_LOAD_PRIORITY:
+      g_value_set_int (value, priv->load_priority);
+      break;
+
+    case PROP_CACHE_THUMBNAILS:
+      g_value_set_boolean (value, priv->cache_thumbnails);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -576,13 +854,35 @@ mx_image_dispose (GObject *object)
 
   if (priv->async_load_data)
     {
-      priv->async_load_data->cancelled = TRUE;
+      mx_image_async_data_cancel (priv->async_load_data);
       priv->async_load_data = NULL;
     }
 
   G_OBJECT_CLASS (mx_image_parent_class)->dispose (object);
 }
 
+static void
+mx_image_map (ClutterActor *actor)
+{
+  MxImagePrivate *priv = MX_IMAGE (actor)->priv;
+
+  CLUTTER_ACTOR_CLASS (mx_image_parent_class)->map (actor);
+
+  if (priv->async_load_data)
+    mx_image_async_data_set_mapped (priv->async_load_data, TRUE);
+}
+
+static void
+mx_image_unmap (ClutterActor *actor)
+{
+  MxImagePrivate *priv = MX_IMAGE (actor)->priv;
+
+  if (priv->async_load_data)
+    mx_image_async_data_set_mapped (priv->async_load_data, FALSE);
+
+  CLUTTER_ACTOR_CLASS (mx_image_parent_class)->unmap (actor);
+}
+
 static void
 mx_image_class_init (MxImageClass *klass)
 {
@@ -600,6 +900,8 @@ mx_image_class_init (MxImageClass *klass)
   actor_class->paint = mx_image_paint;
   actor_class->get_preferred_width = mx_image_get_preferred_width;
   actor_class->get_preferred_height = mx_image_get_preferred_height;
+  actor_class->map = mx_image_map;
+  actor_class->unmap = mx_image_unmap;
 
   pspec = g_param_spec_enum ("scale-mode",
                              "Scale Mode",
@@ -671,6 +973,40 @@ mx_image_class_init (MxImageClass *klass)
 
   g_object_class_install_property (object_class, PROP_FILENAME, pspec);
 
+  /**
+   * MxImage:load-priority:
+   *
+   * The priority of asynchronous loads of the image. Loads of images that
+   * are mapped are started first, then ones with lower values of this
+   * property, like #GSource priorities.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_int ("load-priority",
+                            "Load Priority",
+                            "The priority of asynchronous image loads",
+                            G_MININT, G_MAXINT, G_PRIORITY_DEFAULT,
+                            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_property (object_class, PROP_LOAD_PRIORITY, pspec);
+
+  /**
+   * MxImage:cache-thumbnails:
+   *
+   * Whether images loaded from files at a size are kept, scaled, in the
+   * user's cache directory.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("cache-thumbnails",
+                                "Cache Thumbnails",
+                                "Whether to keep images loaded at a size on "
+                                "disk",
+                                FALSE,
+                                G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_property (object_class, PROP_CACHE_THUMBNAILS, pspec);
+
   /**
    * MxImage::image-loaded:
    * @image: the #MxImage that emitted the signal
@@ -977,7 +1313,7 @@ mx_image_cancel_in_progress (MxImage *image)
   /* Cancel any asynchronous image load */
   if (priv->async_load_data)
     {
-      priv->async_load_data->cancelled = TRUE;
+      mx_image_async_data_cancel (priv->async_load_data);
       priv->async_load_data = NULL;
     }
 }
@@ -1027,7 +1363,7 @@ mx_image_clear (MxImage *image)
  * @image: An #MxImage
  * @data: Image data, or %NULL
  * @uri: A local file path / URI, or %NULL
- * @use_cache: Whether the texture cache should be used
+ * @ident: The identifier to cache the image with, or %NULL
  * @pixel_format: The #CoglPixelFormat of the buffer
  * @width: Width in pixels of image data.
  * @height: Height in pixels of image data
@@ -1044,7 +1380,7 @@ static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
-                                 gboolean          use_cache,
+                                 gpointer          ident,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
                                  gint              height,
@@ -1073,10 +1409,10 @@ mx_image_set_from_data_internal (MxImage          *image,
   /* See if the texture's cached, otherwise create it */
   cache = mx_texture_cache_get_default ();
 
-  if (use_cache && uri && !data)
+  if (ident && uri && !data)
     {
-      priv->texture = mx_texture_cache_get_meta_cogl_texture (
-        cache, uri, GINT_TO_POINTER (mx_image_cache_quark));
+      priv->texture = mx_texture_cache_get_meta_cogl_texture (cache, uri,
+                                                              ident);
 
       if (!priv->texture)
         {
@@ -1110,8 +1446,16 @@ mx_image_set_from_data_internal (MxImage          *image,
                                width, height, width, height,
                                pixel_format, rowstride, data);
 
-      /* Blit a transparent buffer around the texture */
-      blank_area = g_new0 (gint, MAX (width, height) + 2);
+      /* Blit a transparent buffer around the texture. The buffer is kept
+       * for the next image, growing it when it's too small. */
+      if (mx_image_blank_area_size < MAX (width, height) + 2)
+        {
+          g_free (mx_image_blank_area);
+          mx_image_blank_area_size = MAX (width, height) + 2;
+          mx_image_blank_area = g_new0 (gint, mx_image_blank_area_size);
+        }
+      blank_area = mx_image_blank_area;
+
       cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
                                width, 1, width, 1,
                                COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
@@ -1128,15 +1472,10 @@ mx_image_set_from_data_internal (MxImage          *image,
                                1, height + 2, 1, height + 2,
                                COGL_PIXEL_FORMAT_RGBA_8888, 4,
                                (const guint8 *)blank_area);
-      g_free (blank_area);
 
       /* Insert the processed image into the cache, if we have a URI */
-      if (uri)
-        {
-          mx_texture_cache_insert_meta (cache, uri,
-                                        GINT_TO_POINTER (mx_image_cache_quark),
-                                        priv->texture, NULL);
-        }
+      if (uri && ident)
+        mx_texture_cache_insert_meta (cache, uri, ident, priv->texture, NULL);
     }
 
   /* Replace the old texture */
@@ -1186,7 +1525,7 @@ mx_image_set_from_data (MxImage          *image,
       return FALSE;
     }
 
-  return mx_image_set_from_data_internal (image, data, NULL, FALSE,
+  return mx_image_set_from_data_internal (image, data, NULL, NULL,
                                           pixel_format, width, height,
                                           rowstride, error);
 }
@@ -1196,10 +1535,12 @@ mx_image_set_from_data (MxImage          *image,
  * @image: A #MxImage
  * @pixbuf: A #GdkPixbuf, or %NULL
  * @filename: A path or URI to an image file, or %NULL
+ * @ident: The identifier the image is cached with, or %NULL
  * @error: A pointer to a #GError, or %NULL
  *
  * Sets the MxImage from a #GdkPixbuf, or from the cache if a filename is
- * given, no pixbuf is given and the filename has been previously cached.
+ * given, no pixbuf is given and the filename has been previously cached
+ * with @ident.
  *
  * Returns: %TRUE on success, %FALSE otherwise. @error is set on failure
  */
@@ -1207,6 +1548,7 @@ static gboolean
 mx_image_set_from_pixbuf (MxImage      *image,
                           GdkPixbuf    *pixbuf,
                           const gchar  *filename,
+                          gpointer      ident,
                           GError      **error)
 {
   gboolean has_alpha;
@@ -1224,9 +1566,8 @@ mx_image_set_from_pixbuf (MxImage      *image,
   cache = mx_texture_cache_get_default ();
 
   /* Check if we have valid input arguments */
-  if ((!pixbuf && !filename) || (!pixbuf && filename &&
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark))))
+  if ((!pixbuf && (!filename || !ident)) || (!pixbuf &&
+      !mx_texture_cache_contains_meta (cache, filename, ident)))
     {
       if (filename)
         g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_INTERNAL,
@@ -1274,17 +1615,107 @@ mx_image_set_from_pixbuf (MxImage      *image,
   return
     mx_image_set_from_data_internal (image,
                                  pixbuf ? gdk_pixbuf_get_pixels (pixbuf) : NULL,
-                                 filename, TRUE,
+                                 filename, ident,
                                  has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 :
                                              COGL_PIXEL_FORMAT_RGB_888,
                                  width, height, rowstride, error);
 }
 
+static void
+mx_image_cache_key_init (MxImageCacheKey *key,
+                         guint64          mtime,
+                         gint             width,
+                         gint             height,
+                         guint            width_threshold,
+                         guint            height_threshold,
+                         gboolean         upscale)
+{
+  key->mtime = mtime;
+  key->width = width;
+  key->height = height;
+  key->width_threshold = width_threshold;
+  key->height_threshold = height_threshold;
+  key->upscale = upscale ? TRUE : FALSE;
+}
+
+/* The identifier images loaded at a size are cached with. This is a hash of
+ * the size, with the top bit set so that it can't be mistaken for the
+ * quark that unscaled images are cached with. Two sizes can share an
+ * identifier, so the key is checked again when the texture is found. */
+static gpointer
+mx_image_cache_key_get_ident (const MxImageCacheKey *key)
+{
+  guint hash;
+
+  hash = key->width;
+  hash = hash * 31 + key->height;
+  hash = hash * 31 + key->width_threshold;
+  hash = hash * 31 + key->height_threshold;
+  hash = hash * 31 + key->upscale;
+
+  return GUINT_TO_POINTER (hash | 0x80000000);
+}
+
+/* returns when a file was last modified, in microseconds, or 0. Whole
+ * seconds would miss a file being rewritten in the same second. */
+static guint64
+mx_image_get_mtime (const gchar *filename)
+{
+  guint64 mtime;
+  GFileInfo *info;
+  GFile *file;
+
+  file = g_file_new_for_path (filename);
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  g_object_unref (file);
+
+  if (!info)
+    return 0;
+
+  mtime = g_file_info_get_attribute_uint64 (info,
+                                            G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+    G_USEC_PER_SEC +
+    g_file_info_get_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  g_object_unref (info);
+
+  return mtime;
+}
+
+/* records the size and the modification time of the file a cached texture
+ * was loaded from, so it isn't used once the file has changed or for a
+ * size that shares its identifier */
+static void
+mx_image_set_texture_key (CoglHandle             texture,
+                          const MxImageCacheKey *key)
+{
+  cogl_object_set_user_data (texture, &mx_image_cache_key,
+                             g_memdup (key, sizeof (MxImageCacheKey)),
+                             g_free);
+}
+
 static gboolean
-mx_image_load_complete_cb (gpointer task_data)
+mx_image_texture_is_current (CoglHandle             texture,
+                             const MxImageCacheKey *key)
 {
-  MxImageAsyncData *data = task_data;
+  MxImageCacheKey *data = cogl_object_get_user_data (texture,
+                                                     &mx_image_cache_key);
+
+  return data &&
+    data->mtime == key->mtime &&
+    data->width == key->width &&
+    data->height == key->height &&
+    data->width_threshold == key->width_threshold &&
+    data->height_threshold == key->height_threshold &&
+    data->upscale == key->upscale;
+}
 
+static void
+mx_image_load_complete (MxImageAsyncData *data)
+{
   /* Lock/unlock mutex to make sure the thread is finished. This is necessary
    * as it's possible that this idle handler will run before the thread unlocks
    * the mutex, and freeing a locked mutex results in undefined behaviour
@@ -1293,11 +1724,6 @@ mx_image_load_complete_cb (gpointer task_data)
   g_mutex_lock (&data->mutex);
   g_mutex_unlock (&data->mutex);
 
-  /* Reset the idle handler id so we don't try to remove it when we free
-   * the data later on.
-   */
-  data->idle_handler = 0;
-
   /* Don't do anything with the image data if we've been cancelled already */
   if (!data->cancelled && data->complete)
     {
@@ -1311,9 +1737,26 @@ mx_image_load_complete_cb (gpointer task_data)
         {
           GError *error = NULL;
           gboolean resized = (data->width != -1 || data->height != -1);
-          gboolean success =
-            mx_image_set_from_pixbuf (data->parent, data->pixbuf,
-                                      resized ? data->filename : NULL, &error);
+          MxImageCacheKey key;
+          gpointer ident = NULL;
+          gboolean success;
+
+          /* Scaled images are cached by the size they were loaded at */
+          if (resized && data->filename)
+            {
+              mx_image_cache_key_init (&key, data->mtime,
+                                       data->width, data->height,
+                                       data->width_threshold,
+                                       data->height_threshold,
+                                       data->upscale);
+              ident = mx_image_cache_key_get_ident (&key);
+            }
+
+          success = mx_image_set_from_pixbuf (data->parent, data->pixbuf,
+                                              data->filename, ident, &error);
+
+          if (success && ident)
+            mx_image_set_texture_key (data->parent->priv->texture, &key);
 
           if (success)
             g_signal_emit (data->parent, signals[IMAGE_LOADED], 0);
@@ -1327,12 +1770,83 @@ mx_image_load_complete_cb (gpointer task_data)
         g_signal_emit (data->parent, signals[IMAGE_LOAD_ERROR], 0, data->error);
     }
 
+  /* Let the threads decode more now that this image is uploaded */
+  if (data->bytes)
+    {
+      g_mutex_lock (&mx_image_queue_lock);
+      mx_image_bytes_in_flight -= data->bytes;
+      g_mutex_unlock (&mx_image_queue_lock);
+
+      mx_image_queue_kick ();
+    }
+
   /* Free the async loading struct */
   mx_image_async_data_free (data);
+}
+
+static gboolean
+mx_image_uploads_cb (gpointer user_data)
+{
+  gint64 start;
+  gsize bytes;
+
+  start = g_get_monotonic_time ();
+  bytes = 0;
+
+  while (TRUE)
+    {
+      MxImageAsyncData *data;
+
+      g_mutex_lock (&mx_image_queue_lock);
+      data = g_queue_pop_head (&mx_image_uploads);
+      if (!data)
+        {
+          mx_image_uploads_source = 0;
+          g_mutex_unlock (&mx_image_queue_lock);
+
+          return FALSE;
+        }
+      g_mutex_unlock (&mx_image_queue_lock);
+
+      bytes += data->bytes;
+      mx_image_load_complete (data);
+
+      if ((g_get_monotonic_time () - start) >= UPLOAD_TIME_SLICE * 1000 ||
+          bytes >= UPLOAD_BYTES_PER_SLICE)
+        break;
+    }
+
+  /* Leave the rest until after the next frame; Clutter draws frames at a
+   * higher priority than this */
+  g_mutex_lock (&mx_image_queue_lock);
+  if (g_queue_is_empty (&mx_image_uploads))
+    mx_image_uploads_source = 0;
+  else
+    mx_image_uploads_source =
+      clutter_threads_add_idle_full (CLUTTER_PRIORITY_REDRAW + 1,
+                                     mx_image_uploads_cb, NULL, NULL);
+  g_mutex_unlock (&mx_image_queue_lock);
 
   return FALSE;
 }
 
+/* called from the threads, hands a finished or cancelled load to the main
+ * thread */
+static void
+mx_image_uploads_push (MxImageAsyncData *data)
+{
+  g_mutex_lock (&mx_image_queue_lock);
+
+  g_queue_push_tail (&mx_image_uploads, data);
+
+  if (!mx_image_uploads_source)
+    mx_image_uploads_source =
+      clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
+                                     mx_image_uploads_cb, NULL, NULL);
+
+  g_mutex_unlock (&mx_image_queue_lock);
+}
+
 typedef struct
 {
   gint     width;
@@ -1409,9 +1923,12 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
  * @height_threshold: The delta allowed before actually scaling the height
  * @upscale: %TRUE if the image should be allowed to scale upwards,
  *   %FALSE otherwise
+ * @cancellable: A #GCancellable, or %NULL
  * @error: A pointer to a #GError
  *
- * Loads and scales a #GdkPixbuf using the given filename or data.
+ * Loads and scales a #GdkPixbuf using the given filename or data. A file is
+ * mapped rather than read in to memory, and the data is given to the
+ * decoder a chunk at a time, stopping early if @cancellable is cancelled.
  *
  * Returns: A new #GdkPixbuf, or %NULL on failure (@error will be set)
  */
@@ -1425,11 +1942,14 @@ mx_image_pixbuf_new (const gchar  *filename,
                      guint         height_threshold,
                      gboolean      upscale,
                      gboolean     *scaled,
+                     GCancellable *cancellable,
                      GError      **error)
 {
   GdkPixbuf *pixbuf;
   GdkPixbufLoader *loader;
   MxImageSizeRequest constraints;
+  GMappedFile *file = NULL;
+  gsize offset;
 
   GError *err = NULL;
 
@@ -1447,7 +1967,8 @@ mx_image_pixbuf_new (const gchar  *filename,
 
   if (filename)
     {
-      if (!g_file_get_contents (filename, (gchar **)&buffer, &count, &err))
+      file = g_mapped_file_new (filename, FALSE, &err);
+      if (!file)
         {
           if (error)
             g_propagate_error (error, err);
@@ -1456,23 +1977,46 @@ mx_image_pixbuf_new (const gchar  *filename,
           return NULL;
         }
 
-      g_object_weak_ref (G_OBJECT (loader), (GWeakNotify)g_free, buffer);
+      /* the file is unmapped when the loader goes away */
+      g_object_weak_ref (G_OBJECT (loader), (GWeakNotify)g_mapped_file_unref,
+                         file);
+
+      buffer = (guchar *)g_mapped_file_get_contents (file);
+      count = g_mapped_file_get_length (file);
     }
 
-  if (!buffer)
+  /* an empty file maps to no contents at all */
+  if (!buffer || !count)
     {
+      if (filename)
+        g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
+                     "Image file '%s' is empty", filename);
+      else
+        g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
+                     "Image data is empty");
       gdk_pixbuf_loader_close (loader, NULL);
       g_object_unref (loader);
       return NULL;
     }
 
-  if (!gdk_pixbuf_loader_write (loader, buffer, count, &err))
+  /* Only the part of a mapped file that the decoder has got to needs to be
+   * in memory, so give it the data in chunks; this also lets a cancelled
+   * load stop part way through */
+  for (offset = 0; offset < count; offset += LOAD_CHUNK_SIZE)
     {
-      if (error)
-        g_propagate_error (error, err);
-      gdk_pixbuf_loader_close (loader, NULL);
-      g_object_unref (loader);
-      return NULL;
+      if (g_cancellable_set_error_if_cancelled (cancellable, &err) ||
+          !gdk_pixbuf_loader_write (loader, buffer + offset,
+                                    MIN (LOAD_CHUNK_SIZE, count - offset),
+                                    &err))
+        {
+          if (error)
+            g_propagate_error (error, err);
+          else
+            g_error_free (err);
+          gdk_pixbuf_loader_close (loader, NULL);
+          g_object_unref (loader);
+          return NULL;
+        }
     }
 
   /* Note, closing the pixbuf loader will make sure that size-prepared
@@ -1496,12 +2040,347 @@ mx_image_pixbuf_new (const gchar  *filename,
   return pixbuf;
 }
 
+static gchar *
+mx_image_thumbnail_get_path (const gchar *filename,
+                             guint64      mtime,
+                             gint         width,
+                             gint         height,
+                             guint        width_threshold,
+                             guint        height_threshold,
+                             gboolean     upscale)
+{
+  gchar *key, *checksum, *basename, *path, *absolute;
+  GFile *file;
+
+  /* the same file shouldn't get a thumbnail for each way it's named */
+  file = g_file_new_for_path (filename);
+  absolute = g_file_get_path (file);
+  g_object_unref (file);
+
+  key = g_strdup_printf ("%s\n%" G_GUINT64_FORMAT "\n%dx%d\n%ux%u\n%d",
+                         absolute ? absolute : filename, mtime, width, height,
+                         width_threshold, height_threshold, upscale);
+  g_free (absolute);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, key, -1);
+  basename = g_strconcat (checksum, ".raw", NULL);
+
+  path = g_build_filename (g_get_user_cache_dir (), "mx", "thumbnails",
+                           basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_free (key);
+
+  return path;
+}
+
+static void
+mx_image_thumbnail_free (guchar   *pixels,
+                         gpointer  user_data)
+{
+  g_mapped_file_unref (user_data);
+}
+
+/* marks a thumbnail as used, at most once a day to save on disk writes */
+static void
+mx_image_thumbnail_touch (const gchar *path)
+{
+  GStatBuf buf;
+
+  if (g_stat (path, &buf) == 0 &&
+      (g_get_real_time () / G_USEC_PER_SEC) - buf.st_mtime > 24 * 60 * 60)
+    g_utime (path, NULL);
+}
+
+typedef struct
+{
+  gchar  *path;
+  gint64  size;
+  gint64  mtime;
+} MxImageThumbnailFile;
+
+static gint
+mx_image_thumbnail_file_compare (gconstpointer a,
+                                 gconstpointer b)
+{
+  const MxImageThumbnailFile *file_a = a;
+  const MxImageThumbnailFile *file_b = b;
+
+  return (file_a->mtime < file_b->mtime) ? -1 :
+    (file_a->mtime > file_b->mtime);
+}
+
+/* Removes old thumbnails, and the least recently used ones while the
+ * directory is too big. Called from the threads. */
+static void
+mx_image_thumbnails_prune (const gchar *dirname)
+{
+  static GMutex prune_lock;
+
+  MxImageThumbnailFile *file;
+  const gchar *name;
+  GArray *files;
+  gint64 now, total;
+  GDir *dir;
+  guint i;
+
+  /* one thread pruning at a time is plenty */
+  if (!g_mutex_trylock (&prune_lock))
+    return;
+
+  dir = g_dir_open (dirname, 0, NULL);
+  if (!dir)
+    {
+      g_mutex_unlock (&prune_lock);
+      return;
+    }
+
+  now = g_get_real_time () / G_USEC_PER_SEC;
+  files = g_array_new (FALSE, FALSE, sizeof (MxImageThumbnailFile));
+  total = 0;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      MxImageThumbnailFile new_file;
+      GStatBuf buf;
+
+      new_file.path = g_build_filename (dirname, name, NULL);
+
+      if (g_stat (new_file.path, &buf) != 0)
+        {
+          g_free (new_file.path);
+          continue;
+        }
+
+      /* also catches files left behind by a save that didn't finish */
+      if (now - buf.st_mtime > THUMBNAIL_MAX_AGE ||
+          (!g_str_has_suffix (name, ".raw") && now - buf.st_mtime > 60 * 60))
+        {
+          g_unlink (new_file.path);
+          g_free (new_file.path);
+          continue;
+        }
+
+      new_file.size = buf.st_size;
+      new_file.mtime = buf.st_mtime;
+      total += new_file.size;
+
+      g_array_append_val (files, new_file);
+    }
+
+  g_dir_close (dir);
+
+  if (total > THUMBNAIL_MAX_SIZE)
+    {
+      g_array_sort (files, mx_image_thumbnail_file_compare);
+
+      for (i = 0; i < files->len && total > THUMBNAIL_MAX_SIZE; i++)
+        {
+          file = &g_array_index (files, MxImageThumbnailFile, i);
+
+          if (g_unlink (file->path) == 0)
+            total -= file->size;
+        }
+    }
+
+  for (i = 0; i < files->len; i++)
+    g_free (g_array_index (files, MxImageThumbnailFile, i).path);
+  g_array_free (files, TRUE);
+
+  g_mutex_unlock (&prune_lock);
+}
+
+/* maps a thumbnail and wraps its pixels in a pixbuf, without copying them */
+static GdkPixbuf *
+mx_image_thumbnail_load (const gchar *path,
+                         guint64      mtime)
+{
+  const MxImageThumbnailHeader *header;
+  GMappedFile *file;
+  gsize length, row_length;
+
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (!file)
+    return NULL;
+
+  length = g_mapped_file_get_length (file);
+  header = (const MxImageThumbnailHeader *) g_mapped_file_get_contents (file);
+
+  if (length < sizeof (MxImageThumbnailHeader) ||
+      memcmp (header->magic, THUMBNAIL_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != THUMBNAIL_VERSION ||
+      header->mtime != mtime ||
+      header->width < 1 || header->width > G_MAXINT / 4 ||
+      header->height < 1)
+    {
+      g_mapped_file_unref (file);
+      return NULL;
+    }
+
+  row_length = header->width * (header->has_alpha ? 4 : 3);
+
+  if (header->rowstride < row_length ||
+      header->height > (length - sizeof (MxImageThumbnailHeader)) /
+                       header->rowstride)
+    {
+      g_mapped_file_unref (file);
+      return NULL;
+    }
+
+  /* keep the thumbnail from being pruned while it's being used */
+  mx_image_thumbnail_touch (path);
+
+  return gdk_pixbuf_new_from_data ((const guchar *) (header + 1),
+                                   GDK_COLORSPACE_RGB, header->has_alpha, 8,
+                                   header->width, header->height,
+                                   header->rowstride,
+                                   mx_image_thumbnail_free, file);
+}
+
+static void
+mx_image_thumbnail_save (const gchar *path,
+                         GdkPixbuf   *pixbuf,
+                         guint64      mtime)
+{
+  MxImageThumbnailHeader header;
+  const guchar *pixels;
+  gchar *dirname, *tmp_path;
+  gsize row_length;
+  gboolean success;
+  FILE *file;
+  guint i;
+  gint fd;
+
+  if ((gdk_pixbuf_get_bits_per_sample (pixbuf) != 8) ||
+      (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB))
+    return;
+
+  dirname = g_path_get_dirname (path);
+  g_mkdir_with_parents (dirname, 0700);
+
+  if (g_atomic_int_add (&mx_image_thumbnails_saved, 1) %
+      THUMBNAIL_PRUNE_INTERVAL == 0)
+    mx_image_thumbnails_prune (dirname);
+
+  g_free (dirname);
+
+  /* write to a temporary file, so that a thumbnail is either complete or
+   * not there at all */
+  tmp_path = g_strconcat (path, ".XXXXXX", NULL);
+  fd = g_mkstemp (tmp_path);
+  if (fd == -1)
+    {
+      g_free (tmp_path);
+      return;
+    }
+
+  file = fdopen (fd, "wb");
+  if (!file)
+    {
+      close (fd);
+      g_unlink (tmp_path);
+      g_free (tmp_path);
+      return;
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, THUMBNAIL_MAGIC, sizeof (header.magic));
+  header.version = THUMBNAIL_VERSION;
+  header.width = gdk_pixbuf_get_width (pixbuf);
+  header.height = gdk_pixbuf_get_height (pixbuf);
+  header.has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+  header.mtime = mtime;
+
+  row_length = header.width * gdk_pixbuf_get_n_channels (pixbuf);
+  header.rowstride = row_length;
+
+  success = (fwrite (&header, sizeof (header), 1, file) == 1);
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  for (i = 0; success && i < header.height; i++)
+    success = (fwrite (pixels + i * gdk_pixbuf_get_rowstride (pixbuf),
+                       row_length, 1, file) == 1);
+
+  if (fclose (file) != 0)
+    success = FALSE;
+
+  if (!success || g_rename (tmp_path, path) != 0)
+    g_unlink (tmp_path);
+
+  g_free (tmp_path);
+}
+
+/*
+ * mx_image_pixbuf_new_cached:
+ *
+ * Like mx_image_pixbuf_new(), but when @cache_thumbnails is set and @filename
+ * is loaded at a size, the scaled image is read from or written to the
+ * thumbnail cache. The file's modification time is given in @mtime.
+ */
+static GdkPixbuf *
+mx_image_pixbuf_new_cached (const gchar  *filename,
+                            guint64       mtime,
+                            gboolean      cache_thumbnails,
+                            guchar       *buffer,
+                            gsize         count,
+                            gint          width,
+                            gint          height,
+                            guint         width_threshold,
+                            guint         height_threshold,
+                            gboolean      upscale,
+                            gboolean     *scaled,
+                            GCancellable *cancellable,
+                            GError      **error)
+{
+  GdkPixbuf *pixbuf;
+  gboolean was_scaled;
+  gchar *path = NULL;
+
+  if (filename && cache_thumbnails && (width != -1 || height != -1))
+    {
+      path = mx_image_thumbnail_get_path (filename, mtime, width, height,
+                                          width_threshold, height_threshold,
+                                          upscale);
+
+      pixbuf = mx_image_thumbnail_load (path, mtime);
+      if (pixbuf)
+        {
+          g_free (path);
+
+          if (scaled)
+            *scaled = TRUE;
+
+          return pixbuf;
+        }
+    }
+
+  pixbuf = mx_image_pixbuf_new (filename, buffer, count, width, height,
+                                width_threshold, height_threshold, upscale,
+                                &was_scaled, cancellable, error);
+
+  /* images that didn't need scaling are as quick to load from the file */
+  if (pixbuf && path && was_scaled)
+    mx_image_thumbnail_save (path, pixbuf, mtime);
+
+  g_free (path);
+
+  if (scaled)
+    *scaled = was_scaled;
+
+  return pixbuf;
+}
+
 static void
 mx_image_async_cb (gpointer task_data,
                    gpointer user_data)
 {
   gboolean scaled;
-  MxImageAsyncData *data = task_data;
+  MxImageAsyncData *data;
+
+  /* The pushed task only wakes us up, take the most important load */
+  data = mx_image_queue_pop ();
+  if (!data)
+    return;
 
   g_mutex_lock (&data->mutex);
 
@@ -1510,21 +2389,23 @@ mx_image_async_cb (gpointer task_data,
    */
   if (data->cancelled)
     {
-      data->idle_handler =
-        clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
-                                       mx_image_load_complete_cb, data, NULL);
+      mx_image_uploads_push (data);
       g_mutex_unlock (&data->mutex);
 
       return;
     }
 
   /* Try to load the pixbuf */
-  data->pixbuf = mx_image_pixbuf_new (data->filename, data->buffer,
-                                      data->count, data->width, data->height,
-                                      data->width_threshold,
-                                      data->height_threshold, data->upscale,
-                                      &scaled,
-                                      &data->error);
+  data->pixbuf = mx_image_pixbuf_new_cached (data->filename, data->mtime,
+                                             data->cache_thumbnails,
+                                             data->buffer, data->count,
+                                             data->width, data->height,
+                                             data->width_threshold,
+                                             data->height_threshold,
+                                             data->upscale,
+                                             &scaled,
+                                             data->cancellable,
+                                             &data->error);
 
   /* If scaling was unnecessary, we can cache the result */
   if (!scaled)
@@ -1533,10 +2414,18 @@ mx_image_async_cb (gpointer task_data,
       data->height = -1;
     }
 
+  /* Count the decoded image until the main thread has uploaded it */
+  if (data->pixbuf)
+    {
+      g_mutex_lock (&mx_image_queue_lock);
+      data->bytes = gdk_pixbuf_get_rowstride (data->pixbuf) *
+        gdk_pixbuf_get_height (data->pixbuf);
+      mx_image_bytes_in_flight += data->bytes;
+      g_mutex_unlock (&mx_image_queue_lock);
+    }
+
   data->complete = TRUE;
-  data->idle_handler =
-    clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
-                                   mx_image_load_complete_cb, data, NULL);
+  mx_image_uploads_push (data);
 
   g_mutex_unlock (&data->mutex);
 }
@@ -1544,6 +2433,7 @@ mx_image_async_cb (gpointer task_data,
 static gboolean
 mx_image_set_async (MxImage         *image,
                     const gchar     *filename,
+                    guint64          mtime,
                     guchar          *buffer,
                     gsize            count,
                     GDestroyNotify   free_func,
@@ -1598,49 +2488,55 @@ mx_image_set_async (MxImage         *image,
   if (priv->async_load_data)
     {
       MxImageAsyncData *old_data = priv->async_load_data;
+      GDestroyNotify old_free_func = NULL;
+      guchar *old_buffer = NULL;
+      gchar *old_filename = NULL;
 
-      if (!g_mutex_trylock (&old_data->mutex))
-        {
-          /* The thread is busy, cancel it and start a new one */
-          old_data->cancelled = TRUE;
-        }
-      else
+      g_mutex_lock (&mx_image_queue_lock);
+
+      if (old_data->queue_iter)
         {
-          if (old_data->complete)
-            {
-              /* The load finished, cancel the upload */
-              old_data->cancelled = TRUE;
-              g_mutex_unlock (&old_data->mutex);
-            }
-          else
-            {
-              /* The load hasn't begun, we'll hijack it */
-              g_free (old_data->filename);
-              old_data->filename = g_strdup (filename);
-              old_data->buffer = buffer;
-              old_data->count = count;
-              old_data->free_func = free_func;
-              old_data->width = width;
-              old_data->height = height;
-              old_data->cancelled = FALSE;
-              g_mutex_unlock (&old_data->mutex);
-
-              data = old_data;
-            }
+          /* The load hasn't begun, we'll hijack it */
+          old_free_func = old_data->free_func;
+          old_buffer = old_data->buffer;
+          old_filename = old_data->filename;
+
+          old_data->filename = g_strdup (filename);
+          old_data->mtime = mtime;
+          old_data->buffer = buffer;
+          old_data->count = count;
+          old_data->free_func = free_func;
+          old_data->width = width;
+          old_data->height = height;
+
+          data = old_data;
         }
+
+      g_mutex_unlock (&mx_image_queue_lock);
+
+      /* the caller's free function may re-enter MxImage, so it's only called
+       * once the queue is unlocked */
+      if (old_free_func)
+        old_free_func (old_buffer);
+      g_free (old_filename);
+
+      /* Otherwise a thread has it, cancel it and start a new one */
+      if (!data)
+        mx_image_async_data_cancel (old_data);
     }
 
   if (!data)
     {
-      /* Create the async load data and add it to the thread-pool */
+      /* Create the async load data and queue it for the thread-pool */
       priv->async_load_data = data = mx_image_async_data_new (image);
       data->filename = g_strdup (filename);
+      data->mtime = mtime;
       data->buffer = buffer;
       data->count = count;
       data->free_func = free_func;
       data->width = width;
       data->height = height;
-      g_thread_pool_push (mx_image_threads, data, NULL);
+      mx_image_queue_push (data);
     }
 
   return TRUE;
@@ -1693,7 +2589,10 @@ mx_image_set_from_file_at_size (MxImage      *image,
   GdkPixbuf *pixbuf;
   MxImagePrivate *priv;
   MxTextureCache *cache;
-  gboolean retval, use_cache;
+  gboolean retval, scaled;
+  MxImageCacheKey key;
+  gpointer ident;
+  guint64 mtime;
 
   if (G_UNLIKELY (!MX_IS_IMAGE (image)))
     {
@@ -1704,23 +2603,21 @@ mx_image_set_from_file_at_size (MxImage      *image,
     }
 
   priv = image->priv;
-  pixbuf = NULL;
-
-  /* Check if the processed image is in the cache - we don't use the cache
-   * if we're loading at a particular size.
-   */
   cache = mx_texture_cache_get_default ();
-  use_cache = TRUE;
 
-  if ((width != -1) || (height != -1) ||
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark)))
+  if ((width == -1) && (height == -1))
     {
+      /* Check if the processed image is in the cache */
+      if (mx_texture_cache_contains_meta (cache, filename,
+                                          GINT_TO_POINTER (mx_image_cache_quark)))
+        return mx_image_set_from_pixbuf (image, NULL, filename,
+                                         GINT_TO_POINTER (mx_image_cache_quark),
+                                         error);
+
       /* Check if the unprocessed image is in the cache, and if so, skip
        * loading it and set it from the Cogl texture handle.
        */
-      if ((width == -1) && (height == -1) &&
-          mx_texture_cache_contains (cache, filename))
+      if (mx_texture_cache_contains (cache, filename))
         {
           if (mx_image_set_from_cogl_texture (image,
               mx_texture_cache_get_cogl_texture (cache, filename)))
@@ -1740,25 +2637,58 @@ mx_image_set_from_file_at_size (MxImage      *image,
             }
         }
 
-      /* Load the pixbuf in a thread, then later on upload it to the GPU */
-      if (priv->load_async)
-        return mx_image_set_async (image, filename, NULL, 0, NULL,
-                                   width, height, error);
+      mtime = 0;
+      ident = NULL;
+    }
+  else
+    {
+      CoglHandle texture;
+
+      /* Check if the image has been loaded at this size since the file was
+       * last changed */
+      mtime = mx_image_get_mtime (filename);
+      mx_image_cache_key_init (&key, mtime, width, height,
+                               priv->width_threshold, priv->height_threshold,
+                               priv->upscale);
+      ident = mx_image_cache_key_get_ident (&key);
+
+      texture = mx_texture_cache_get_meta_cogl_texture (cache, filename, ident);
+      if (texture)
+        {
+          gboolean current = mx_image_texture_is_current (texture, &key);
 
-      /* Synchronously load the pixbuf and set it */
-      pixbuf = mx_image_pixbuf_new (filename, NULL, 0, width, height,
-                                    priv->width_threshold,
-                                    priv->height_threshold,
-                                    priv->upscale, &use_cache, error);
-      if (!pixbuf)
-        return FALSE;
+          cogl_object_unref (texture);
+
+          if (current)
+            return mx_image_set_from_pixbuf (image, NULL, filename, ident,
+                                             error);
+        }
     }
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf,
-                                     use_cache ? filename : NULL, error);
+  /* Load the pixbuf in a thread, then later on upload it to the GPU */
+  if (priv->load_async)
+    return mx_image_set_async (image, filename, mtime, NULL, 0, NULL,
+                               width, height, error);
+
+  /* Synchronously load the pixbuf and set it */
+  pixbuf = mx_image_pixbuf_new_cached (filename, mtime, priv->cache_thumbnails,
+                                       NULL, 0, width, height,
+                                       priv->width_threshold,
+                                       priv->height_threshold,
+                                       priv->upscale, &scaled, NULL, error);
+  if (!pixbuf)
+    return FALSE;
 
-  if (pixbuf)
-    g_object_unref (pixbuf);
+  /* Only scaled images are cached, by the size they were loaded at */
+  if (!scaled)
+    ident = NULL;
+
+  retval = mx_image_set_from_pixbuf (image, pixbuf, filename, ident, error);
+
+  if (retval && ident)
+    mx_image_set_texture_key (priv->texture, &key);
+
+  g_object_unref (pixbuf);
 
   return retval;
 }
@@ -1941,16 +2871,16 @@ mx_image_set_from_buffer_at_size (MxImage         *image,
   priv = image->priv;
 
   if (priv->load_async)
-    return mx_image_set_async (image, NULL, buffer, buffer_size,
+    return mx_image_set_async (image, NULL, 0, buffer, buffer_size,
                                buffer_free_func, width, height, error);
 
   pixbuf = mx_image_pixbuf_new (NULL, buffer, buffer_size, width, height,
                                 priv->width_threshold, priv->height_threshold,
-                                priv->upscale, NULL, error);
+                                priv->upscale, NULL, NULL, error);
   if (!pixbuf)
     return FALSE;
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, error);
+  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, NULL, error);
 
   g_object_unref (pixbuf);
 
@@ -1992,7 +2922,7 @@ mx_image_set_load_async (MxImage  *image,
       /* Cancel the old transfer if we're turning async off */
       if (!load_async && priv->async_load_data)
         {
-          priv->async_load_data->cancelled = TRUE;
+          mx_image_async_data_cancel (priv->async_load_data);
           priv->async_load_data = NULL;
         }
     }
@@ -2241,3 +3171,110 @@ mx_image_get_transition_duration (MxImage *image)
 
   return image->priv->transition_duration;
 }
+
+/**
+ * mx_image_set_load_priority:
+ * @image: A #MxImage
+ * @priority: the load priority
+ *
+ * Sets the priority of asynchronous loads of @image, including one that is
+ * waiting to start. Loads of images that are mapped are started before
+ * others, then ones with a lower @priority, like #GSource priorities. Loads
+ * with the same priority are started in the order they were requested.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_load_priority (MxImage *image,
+                            gint     priority)
+{
+  MxImagePrivate *priv;
+
+  g_return_if_fail (MX_IS_IMAGE (image));
+
+  priv = image->priv;
+
+  if (priv->load_priority == priority)
+    return;
+
+  priv->load_priority = priority;
+
+  if (priv->async_load_data)
+    {
+      g_mutex_lock (&mx_image_queue_lock);
+      priv->async_load_data->priority = priority;
+      mx_image_queue_update (priv->async_load_data);
+      g_mutex_unlock (&mx_image_queue_lock);
+    }
+
+  g_object_notify (G_OBJECT (image), "load-priority");
+}
+
+/**
+ * mx_image_get_load_priority:
+ * @image: A #MxImage
+ *
+ * Gets the priority of asynchronous loads of @image.
+ *
+ * Returns: the load priority
+ *
+ * Since: 2.0
+ */
+gint
+mx_image_get_load_priority (MxImage *image)
+{
+  g_return_val_if_fail (MX_IS_IMAGE (image), G_PRIORITY_DEFAULT);
+
+  return image->priv->load_priority;
+}
+
+/**
+ * mx_image_set_cache_thumbnails:
+ * @image: A #MxImage
+ * @cache_thumbnails: %TRUE to keep scaled images on disk
+ *
+ * Sets whether images that are scaled while being loaded from a file, with
+ * mx_image_set_from_file_at_size(), are kept in the user's cache directory.
+ * Loading the same file at the same size again, until the file is changed,
+ * then reads the scaled image from the cache instead of decoding and scaling
+ * the file.
+ *
+ * Whether or not this is set, images loaded at a size are kept in the
+ * #MxTextureCache while they fit in its budget.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_cache_thumbnails (MxImage  *image,
+                               gboolean  cache_thumbnails)
+{
+  MxImagePrivate *priv;
+
+  g_return_if_fail (MX_IS_IMAGE (image));
+
+  priv = image->priv;
+
+  if (priv->cache_thumbnails != cache_thumbnails)
+    {
+      priv->cache_thumbnails = cache_thumbnails;
+      g_object_notify (G_OBJECT (image), "cache-thumbnails");
+    }
+}
+
+/**
+ * mx_image_get_cache_thumbnails:
+ * @image: A #MxImage
+ *
+ * Gets whether images loaded from files at a size are kept on disk.
+ *
+ * Returns: %TRUE if scaled images are kept on disk
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_image_get_cache_thumbnails (MxImage *image)
+{
+  g_return_val_if_fail (MX_IS_IMAGE (image), FALSE);
+
+  return image->priv->cache_thumbnails;
+}
@@ -134,6 +134,14 @@ void     mx_image_set_load_async (MxImage  *image,
                                   gboolean  load_async);
 gboolean mx_image_get_load_async (MxImage  *image);
 
+void     mx_image_set_load_priority (MxImage *image,
+                                     gint     priority);
+gint     mx_image_get_load_priority (MxImage *image);
+
+void     mx_image_set_cache_thumbnails (MxImage  *image,
+                                        gboolean  cache_thumbnails);
+gboolean mx_image_get_cache_thumbnails (MxImage  *image);
+
 void     mx_image_set_allow_upscale (MxImage *image,
                                      gboolean allow);
 gboolean mx_image_get_allow_upscale (MxImage *image);
@@ -32,10 +32,21 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxItemView can be made virtualized with
+ * mx_item_view_set_virtualized(). In this mode every cell has the same size,
+ * cells are placed by their index in the model, and children are only
+ * created for the cells in the scrolled area plus a number of extra lines
+ * of cells either side (see mx_item_view_set_overscan()). Children are
+ * re-used for other cells as the view scrolls.
  */
 
+#include <math.h>
+
 #include "mx-item-view.h"
 #include "mx-private.h"
+#include "mx-scrollable.h"
+#include "mx-utils.h"
 
 G_DEFINE_TYPE (MxItemView, mx_item_view, MX_TYPE_GRID)
 
@@ -54,9 +65,13 @@ enum
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUALIZED,
+  PROP_OVERSCAN
 };
 
+#define DEFAULT_OVERSCAN 2
+
 struct _MxItemViewPrivate
 {
   ClutterModel  *model;
@@ -71,7 +86,31 @@ struct _MxItemViewPrivate
   gulong         row_removed;
   gulong         sort_changed;
 
+  /* the child of each row, in row order, when not virtualized */
+  GSequence     *rows;
+
   guint          is_frozen : 1;
+  guint          virtualized : 1;
+  guint          rebind : 1;
+  guint          rebuild : 1;
+
+  /* virtualized mode: the children showing cells first_cell onwards, in
+   * order, and the hidden children waiting to be re-used */
+  GQueue         items;
+  GQueue         recycled;
+  gint           first_cell;
+  guint          overscan;
+
+  /* the size of every cell along and across the lines, and the space
+   * inside the padding */
+  gfloat         cell_a;
+  gfloat         cell_b;
+  gfloat         avail_a;
+  gfloat         avail_b;
+
+  MxAdjustment  *hadjustment;
+  MxAdjustment  *vadjustment;
+  guint          update_id;
 };
 
 /* gobject implementations */
@@ -94,6 +133,12 @@ mx_item_view_get_property (GObject    *object,
     case PROP_FACTORY:
       g_value_set_object (value, priv->factory);
       break;
+    case PROP_VIRTUALIZED:
+      g_value_set_boolean (value, priv->virtualized);
+      break;
+    case PROP_OVERSCAN:
+      g_value_set_uint (value, priv->overscan);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -110,6 +155,7 @@ mx_item_view_set_property (GObject      *object,
     case PROP_MODEL:
       mx_item_view_set_model ((MxItemView*) object,
                               (ClutterModel*) g_value_get_object (value));
+      break;
     case PROP_ITEM_TYPE:
       mx_item_view_set_item_type ((MxItemView*) object,
                                   g_value_get_gtype (value));
@@ -118,6 +164,14 @@ mx_item_view_set_property (GObject      *object,
       mx_item_view_set_factory ((MxItemView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUALIZED:
+      mx_item_view_set_virtualized ((MxItemView*) object,
+                                    g_value_get_boolean (value));
+      break;
+    case PROP_OVERSCAN:
+      mx_item_view_set_overscan ((MxItemView*) object,
+                                 g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -126,9 +180,41 @@ mx_item_view_set_property (GObject      *object,
 static void
 mx_item_view_dispose (GObject *object)
 {
+  MxItemViewPrivate *priv = MX_ITEM_VIEW (object)->priv;
+
   /* This will cause the unref of the model and also disconnect the signals */
   mx_item_view_set_model (MX_ITEM_VIEW (object), NULL);
 
+  if (priv->update_id)
+    {
+      clutter_threads_remove_repaint_func (priv->update_id);
+      priv->update_id = 0;
+    }
+
+  if (priv->hadjustment)
+    {
+      g_signal_handlers_disconnect_matched (priv->hadjustment,
+                                            G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, object);
+      g_object_unref (priv->hadjustment);
+      priv->hadjustment = NULL;
+    }
+
+  if (priv->vadjustment)
+    {
+      g_signal_handlers_disconnect_matched (priv->vadjustment,
+                                            G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, object);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
+    }
+
+  /* the children themselves are destroyed by ClutterActor */
+  g_queue_clear (&priv->items);
+  g_queue_clear (&priv->recycled);
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->rows),
+                           g_sequence_get_end_iter (priv->rows));
+
   G_OBJECT_CLASS (mx_item_view_parent_class)->dispose (object);
 }
 
@@ -144,13 +230,762 @@ mx_item_view_finalize (GObject *object)
       priv->attributes = NULL;
     }
 
+  g_sequence_free (priv->rows);
+
   G_OBJECT_CLASS (mx_item_view_parent_class)->finalize (object);
 }
 
+/* items */
+
+static ClutterActor *
+mx_item_view_create_item (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+
+  if (priv->item_type)
+    return g_object_new (priv->item_type, NULL);
+  else
+    return mx_item_factory_create (priv->factory);
+}
+
+static void
+mx_item_view_bind_item (MxItemView       *item_view,
+                        GObject          *child,
+                        ClutterModelIter *iter)
+{
+  GSList *p;
+
+  g_object_freeze_notify (child);
+  for (p = item_view->priv->attributes; p; p = p->next)
+    {
+      GValue value = { 0, };
+      AttributeData *attr = p->data;
+
+      clutter_model_iter_get_value (iter, attr->col, &value);
+
+      g_object_set_property (child, attr->name, &value);
+
+      g_value_unset (&value);
+    }
+  g_object_thaw_notify (child);
+}
+
+
+/* virtualized mode */
+
+static ClutterActor *
+mx_item_view_get_item (MxItemView *item_view)
+{
+  ClutterActor *item;
+
+  item = g_queue_pop_head (&item_view->priv->recycled);
+  if (item)
+    {
+      clutter_actor_show (item);
+      return item;
+    }
+
+  item = mx_item_view_create_item (item_view);
+  clutter_actor_add_child (CLUTTER_ACTOR (item_view), item);
+
+  return item;
+}
+
+static void
+mx_item_view_recycle_item (MxItemView   *item_view,
+                           ClutterActor *item)
+{
+  /* recycled items stay in the container, hidden, so that re-using them
+   * doesn't have to re-parent them */
+  clutter_actor_hide (item);
+  g_queue_push_head (&item_view->priv->recycled, item);
+}
+
+static void
+mx_item_view_remove_item (ClutterActor *item,
+                          MxItemView   *item_view)
+{
+  clutter_actor_remove_child (CLUTTER_ACTOR (item_view), item);
+}
+
+/* removes the children the view created for rows, leaving any others that
+ * were added to the container alone */
+static void
+mx_item_view_clear_items (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+
+  g_queue_foreach (&priv->items, (GFunc) mx_item_view_remove_item,
+                   item_view);
+  g_queue_foreach (&priv->recycled, (GFunc) mx_item_view_remove_item,
+                   item_view);
+  g_queue_clear (&priv->items);
+  g_queue_clear (&priv->recycled);
+  priv->first_cell = 0;
+
+  g_sequence_foreach (priv->rows, (GFunc) mx_item_view_remove_item,
+                      item_view);
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->rows),
+                           g_sequence_get_end_iter (priv->rows));
+}
+
+/* Cells flow along the "a" axis and lines of cells are stacked along the
+ * "b" axis, which is the one that scrolls. With a horizontal orientation
+ * "a" is x and "b" is y, and the other way round with a vertical one. */
+static gboolean
+mx_item_view_is_vertical (MxItemView *item_view)
+{
+  return mx_grid_get_orientation (MX_GRID (item_view))
+    == MX_ORIENTATION_VERTICAL;
+}
+
+static void
+mx_item_view_get_gaps (MxItemView *item_view,
+                       gfloat     *agap,
+                       gfloat     *bgap)
+{
+  MxGrid *grid = MX_GRID (item_view);
+
+  if (mx_item_view_is_vertical (item_view))
+    {
+      *agap = mx_grid_get_row_spacing (grid);
+      *bgap = mx_grid_get_column_spacing (grid);
+    }
+  else
+    {
+      *agap = mx_grid_get_column_spacing (grid);
+      *bgap = mx_grid_get_row_spacing (grid);
+    }
+}
+
+static void
+mx_item_view_get_padding_ab (MxItemView *item_view,
+                             gfloat     *a_start,
+                             gfloat     *a_total,
+                             gfloat     *b_start,
+                             gfloat     *b_total)
+{
+  MxPadding padding;
+
+  mx_widget_get_padding (MX_WIDGET (item_view), &padding);
+
+  if (mx_item_view_is_vertical (item_view))
+    {
+      *a_start = padding.top;
+      *a_total = padding.top + padding.bottom;
+      *b_start = padding.left;
+      *b_total = padding.left + padding.right;
+    }
+  else
+    {
+      *a_start = padding.left;
+      *a_total = padding.left + padding.right;
+      *b_start = padding.top;
+      *b_total = padding.top + padding.bottom;
+    }
+}
+
+static gint
+mx_item_view_get_n_cells (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+
+  if (!priv->model)
+    return 0;
+
+  return clutter_model_get_n_rows (priv->model);
+}
+
+/* the number of cells in each line for the given length of the "a" axis,
+ * not including padding, or -1 for unlimited */
+static gint
+mx_item_view_get_cells_per_line (MxItemView *item_view,
+                                 gfloat      avail_a)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gint max_stride, n_per_line;
+  gfloat agap, bgap;
+
+  max_stride = mx_grid_get_max_stride (MX_GRID (item_view));
+  mx_item_view_get_gaps (item_view, &agap, &bgap);
+
+  if (avail_a < 0 || priv->cell_a <= 0)
+    n_per_line = mx_item_view_get_n_cells (item_view);
+  else
+    n_per_line = (gint) ((avail_a + agap) / (priv->cell_a + agap));
+
+  if (max_stride > 0)
+    n_per_line = MIN (n_per_line, max_stride);
+
+  return MAX (n_per_line, 1);
+}
+
+/* the length of the "b" axis for the given number of cells per line,
+ * not including padding */
+static gfloat
+mx_item_view_get_content_b (MxItemView *item_view,
+                            gint        n_per_line)
+{
+  gint n_cells, n_lines;
+  gfloat agap, bgap;
+
+  n_cells = mx_item_view_get_n_cells (item_view);
+  if (n_cells == 0)
+    return 0;
+
+  mx_item_view_get_gaps (item_view, &agap, &bgap);
+  n_lines = (n_cells + n_per_line - 1) / n_per_line;
+
+  return n_lines * (item_view->priv->cell_b + bgap) - bgap;
+}
+
+static MxAdjustment *
+mx_item_view_get_scroll_adjustment (MxItemView *item_view)
+{
+  if (mx_item_view_is_vertical (item_view))
+    return item_view->priv->hadjustment;
+  else
+    return item_view->priv->vadjustment;
+}
+
+/* find the cells that need children: the ones on the lines in the visible
+ * area plus the overscan lines either side */
+static void
+mx_item_view_get_window (MxItemView *item_view,
+                         gint        n_cells,
+                         gint       *first_p,
+                         gint       *last_p)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat a_start, a_total, b_start, b_total, agap, bgap, stride;
+  MxAdjustment *adjustment;
+  gdouble value, page_size;
+  gint n_per_line, first_line, last_line;
+
+  /* until a cell has been measured, only realize the first one */
+  if (priv->cell_a <= 0 || priv->cell_b <= 0)
+    {
+      *first_p = 0;
+      *last_p = MIN (1, n_cells);
+      return;
+    }
+
+  mx_item_view_get_padding_ab (item_view, &a_start, &a_total,
+                               &b_start, &b_total);
+  mx_item_view_get_gaps (item_view, &agap, &bgap);
+  n_per_line = mx_item_view_get_cells_per_line (item_view, priv->avail_a);
+  stride = priv->cell_b + bgap;
+
+  adjustment = mx_item_view_get_scroll_adjustment (item_view);
+  if (adjustment)
+    mx_adjustment_get_values (adjustment, &value, NULL, NULL, NULL,
+                              NULL, &page_size);
+  else
+    {
+      value = 0;
+      page_size = priv->avail_b;
+    }
+
+  if (page_size <= 0)
+    page_size = stride;
+
+  first_line = (gint) floor ((value - b_start) / stride) - priv->overscan;
+  last_line = (gint) ceil ((value + page_size - b_start) / stride)
+    + priv->overscan;
+
+  first_line = MAX (first_line, 0);
+  last_line = MAX (last_line, first_line);
+
+  *first_p = MIN (first_line * n_per_line, n_cells);
+  *last_p = CLAMP (last_line * n_per_line, *first_p, n_cells);
+}
+
+static void
+mx_item_view_move_window (MxItemView *item_view,
+                          gint        first,
+                          gint        last,
+                          gboolean    rebind)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  ClutterActor *actor = CLUTTER_ACTOR (item_view);
+  ClutterModelIter *iter;
+  ClutterActor *item, *old_head;
+  gint end, cell;
+
+  end = priv->first_cell + g_queue_get_length (&priv->items);
+
+  /* if none of the current items can be kept, start again */
+  if (rebind || g_queue_is_empty (&priv->items)
+      || first >= end || last <= priv->first_cell)
+    {
+      while ((item = g_queue_pop_head (&priv->items)))
+        mx_item_view_recycle_item (item_view, item);
+
+      priv->first_cell = end = first;
+    }
+
+  /* recycle the cells that have moved out of the window */
+  for (; priv->first_cell < first; priv->first_cell++)
+    {
+      item = g_queue_pop_head (&priv->items);
+      mx_item_view_recycle_item (item_view, item);
+    }
+
+  for (; end > last; end--)
+    {
+      item = g_queue_pop_tail (&priv->items);
+      mx_item_view_recycle_item (item_view, item);
+    }
+
+  /* and fill in the cells that have moved in, keeping the children in the
+   * same order as the cells for keyboard navigation */
+  if (first < priv->first_cell)
+    {
+      old_head = g_queue_peek_head (&priv->items);
+      iter = clutter_model_get_iter_at_row (priv->model, first);
+
+      for (cell = first; iter && cell < priv->first_cell; cell++)
+        {
+          item = mx_item_view_get_item (item_view);
+          mx_item_view_bind_item (item_view, G_OBJECT (item), iter);
+          g_queue_push_nth (&priv->items, item, cell - first);
+          clutter_actor_set_child_below_sibling (actor, item, old_head);
+
+          clutter_model_iter_next (iter);
+        }
+
+      if (iter)
+        g_object_unref (iter);
+
+      priv->first_cell = first;
+    }
+
+  if (end < last)
+    {
+      iter = clutter_model_get_iter_at_row (priv->model, end);
+
+      for (cell = end; iter && cell < last; cell++)
+        {
+          item = mx_item_view_get_item (item_view);
+          mx_item_view_bind_item (item_view, G_OBJECT (item), iter);
+          g_queue_push_tail (&priv->items, item);
+          clutter_actor_set_child_above_sibling (actor, item, NULL);
+
+          clutter_model_iter_next (iter);
+        }
+
+      if (iter)
+        g_object_unref (iter);
+    }
+}
+
+/* all the cells are given the size of the largest realized one, as with
+ * the homogenous-rows and homogenous-columns properties of MxGrid */
+static gboolean
+mx_item_view_measure_cells (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat cell_a = 0, cell_b = 0;
+  GList *l;
+
+  if (g_queue_is_empty (&priv->items))
+    return FALSE;
+
+  for (l = priv->items.head; l; l = l->next)
+    {
+      gfloat width, height;
+
+      clutter_actor_get_preferred_size (l->data, NULL, NULL, &width, &height);
+
+      cell_a = MAX (cell_a, width);
+      cell_b = MAX (cell_b, height);
+    }
+
+  if (mx_item_view_is_vertical (item_view))
+    {
+      gfloat temp = cell_a;
+      cell_a = cell_b;
+      cell_b = temp;
+    }
+
+  if (fabsf (cell_a - priv->cell_a) < 0.5f
+      && fabsf (cell_b - priv->cell_b) < 0.5f)
+    return FALSE;
+
+  priv->cell_a = cell_a;
+  priv->cell_b = cell_b;
+
+  return TRUE;
+}
+
+static void
+mx_item_view_update_items (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gboolean rebind;
+  gint first, last, n_cells, pass;
+
+  rebind = priv->rebind;
+  priv->rebind = FALSE;
+
+  if (!priv->virtualized || priv->is_frozen)
+    return;
+
+  if (!priv->model || (!priv->item_type && !priv->factory))
+    return;
+
+  n_cells = clutter_model_get_n_rows (priv->model);
+
+  /* realizing cells can change the cell size, which changes the window,
+   * so go round a second time if it does */
+  for (pass = 0; pass < 2; pass++)
+    {
+      mx_item_view_get_window (item_view, n_cells, &first, &last);
+      mx_item_view_move_window (item_view, first, last, rebind);
+      rebind = FALSE;
+
+      if (!mx_item_view_measure_cells (item_view))
+        break;
+    }
+
+  MX_NOTE (LAYOUT, "item view %p showing cells %d-%d of %d",
+           item_view, priv->first_cell,
+           priv->first_cell + (gint) g_queue_get_length (&priv->items),
+           n_cells);
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (item_view));
+}
+
+static void model_changed_cb (ClutterModel *model,
+                              MxItemView   *item_view);
+
+static gboolean
+mx_item_view_update_cb (gpointer data)
+{
+  MxItemView *item_view = data;
+  MxItemViewPrivate *priv = item_view->priv;
+
+  priv->update_id = 0;
+
+  if (priv->rebuild)
+    {
+      priv->rebuild = FALSE;
+      model_changed_cb (priv->model, item_view);
+    }
+
+  mx_item_view_update_items (item_view);
+
+  return FALSE;
+}
+
+/* Children can't be added or hidden during an allocation, so the window is
+ * moved before the next frame is laid out instead */
+static void
+mx_item_view_queue_update (MxItemView *item_view,
+                           gboolean    rebind)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+
+  if (rebind)
+    priv->rebind = TRUE;
+
+  if (!priv->update_id)
+    priv->update_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT
+                                             | CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD,
+                                             mx_item_view_update_cb,
+                                             item_view, NULL);
+}
+
+static void
+mx_item_view_adjustment_notify_cb (MxAdjustment *adjustment,
+                                   GParamSpec   *pspec,
+                                   MxItemView   *item_view)
+{
+  if (item_view->priv->virtualized
+      && adjustment == mx_item_view_get_scroll_adjustment (item_view))
+    mx_item_view_queue_update (item_view, FALSE);
+}
+
+static void
+mx_item_view_set_adjustment (MxItemView    *item_view,
+                             MxAdjustment **adjustment_p,
+                             MxAdjustment  *adjustment)
+{
+  if (*adjustment_p == adjustment)
+    return;
+
+  if (*adjustment_p)
+    {
+      g_signal_handlers_disconnect_by_func (*adjustment_p,
+                                            mx_item_view_adjustment_notify_cb,
+                                            item_view);
+      g_object_unref (*adjustment_p);
+      *adjustment_p = NULL;
+    }
+
+  if (adjustment)
+    {
+      *adjustment_p = g_object_ref (adjustment);
+      g_signal_connect (adjustment, "notify::value",
+                        G_CALLBACK (mx_item_view_adjustment_notify_cb),
+                        item_view);
+      g_signal_connect (adjustment, "notify::page-size",
+                        G_CALLBACK (mx_item_view_adjustment_notify_cb),
+                        item_view);
+    }
+
+  if (item_view->priv->virtualized)
+    mx_item_view_queue_update (item_view, FALSE);
+}
+
+static void
+mx_item_view_adjustments_notify_cb (MxItemView *item_view,
+                                    GParamSpec *pspec,
+                                    gpointer    user_data)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  MxAdjustment *hadjustment, *vadjustment;
+
+  /* reading the property would create an adjustment in place of one that
+   * has just been cleared */
+  _mx_grid_peek_adjustments (MX_GRID (item_view), &hadjustment, &vadjustment);
+
+  if (g_str_equal (pspec->name, "horizontal-adjustment"))
+    mx_item_view_set_adjustment (item_view, &priv->hadjustment, hadjustment);
+  else
+    mx_item_view_set_adjustment (item_view, &priv->vadjustment, vadjustment);
+}
+
+static void
+mx_item_view_orientation_notify_cb (MxItemView *item_view,
+                                    GParamSpec *pspec,
+                                    gpointer    user_data)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+
+  /* the axes have swapped, so measure the cells again */
+  priv->cell_a = priv->cell_b = 0;
+  priv->avail_a = priv->avail_b = 0;
+
+  if (priv->virtualized)
+    mx_item_view_queue_update (item_view, FALSE);
+}
+
+/* actor implementations */
+
+static void
+mx_item_view_get_preferred_a (MxItemView *item_view,
+                              gfloat      for_b,
+                              gfloat     *min_a_p,
+                              gfloat     *natural_a_p)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat a_start, a_total, b_start, b_total, agap, bgap;
+  gint n_cells, n_per_line, n_lines;
+
+  mx_item_view_get_padding_ab (item_view, &a_start, &a_total,
+                               &b_start, &b_total);
+  mx_item_view_get_gaps (item_view, &agap, &bgap);
+
+  n_cells = mx_item_view_get_n_cells (item_view);
+  n_per_line = mx_item_view_get_cells_per_line (item_view, -1);
+
+  /* Only ask for enough cells per line to fit the cells in to @for_b, or
+   * without that, for a roughly square grid, rather than for a single line
+   * of every cell */
+  if (for_b >= 0 && priv->cell_b > 0)
+    n_lines = (gint) ((for_b - b_total + bgap) / (priv->cell_b + bgap));
+  else
+    n_lines = (gint) ceil (sqrt (n_cells));
+
+  if (n_lines > 0)
+    n_per_line = MIN (n_per_line, (n_cells + n_lines - 1) / n_lines);
+
+  n_per_line = MAX (n_per_line, 1);
+
+  if (min_a_p)
+    *min_a_p = priv->cell_a + a_total;
+  if (natural_a_p)
+    *natural_a_p = n_per_line * (priv->cell_a + agap) - agap + a_total;
+}
+
+static void
+mx_item_view_get_preferred_b (MxItemView *item_view,
+                              gfloat      for_a,
+                              gfloat     *min_b_p,
+                              gfloat     *natural_b_p)
+{
+  gfloat a_start, a_total, b_start, b_total, b;
+  gint n_per_line;
+
+  mx_item_view_get_padding_ab (item_view, &a_start, &a_total,
+                               &b_start, &b_total);
+
+  n_per_line = mx_item_view_get_cells_per_line (item_view,
+                                                (for_a < 0) ? -1
+                                                : for_a - a_total);
+
+  b = mx_item_view_get_content_b (item_view, n_per_line) + b_total;
+
+  if (min_b_p)
+    *min_b_p = b;
+  if (natural_b_p)
+    *natural_b_p = b;
+}
+
+static void
+mx_item_view_get_preferred_width (ClutterActor *actor,
+                                  gfloat        for_height,
+                                  gfloat       *min_width_p,
+                                  gfloat       *natural_width_p)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+
+  if (!item_view->priv->virtualized)
+    CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->
+      get_preferred_width (actor, for_height, min_width_p, natural_width_p);
+  else if (mx_item_view_is_vertical (item_view))
+    mx_item_view_get_preferred_b (item_view, for_height,
+                                  min_width_p, natural_width_p);
+  else
+    mx_item_view_get_preferred_a (item_view, for_height,
+                                  min_width_p, natural_width_p);
+}
+
+static void
+mx_item_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+
+  if (!item_view->priv->virtualized)
+    CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->
+      get_preferred_height (actor, for_width, min_height_p, natural_height_p);
+  else if (mx_item_view_is_vertical (item_view))
+    mx_item_view_get_preferred_a (item_view, for_width,
+                                  min_height_p, natural_height_p);
+  else
+    mx_item_view_get_preferred_b (item_view, for_width,
+                                  min_height_p, natural_height_p);
+}
+
+static void
+mx_item_view_allocate (ClutterActor          *actor,
+                       const ClutterActorBox *box,
+                       ClutterAllocationFlags flags)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat a_start, a_total, b_start, b_total, agap, bgap;
+  gfloat avail_a, avail_b, upper;
+  MxAdjustment *adjustment, *other;
+  ClutterActorClass *widget_class;
+  gboolean vertical;
+  MxAlign x_align, y_align;
+  gint n_per_line, cell;
+  GList *l;
+
+  if (!priv->virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
+    }
+
+  /* MxGrid would flow the realized cells from the start, so skip it and
+   * place them by their index */
+  widget_class = g_type_class_peek_parent (mx_item_view_parent_class);
+  widget_class->allocate (actor, box, flags);
+
+  vertical = mx_item_view_is_vertical (item_view);
+  mx_item_view_get_padding_ab (item_view, &a_start, &a_total,
+                               &b_start, &b_total);
+  mx_item_view_get_gaps (item_view, &agap, &bgap);
+
+  if (vertical)
+    {
+      avail_a = box->y2 - box->y1 - a_total;
+      avail_b = box->x2 - box->x1 - b_total;
+    }
+  else
+    {
+      avail_a = box->x2 - box->x1 - a_total;
+      avail_b = box->y2 - box->y1 - b_total;
+    }
+
+  if (avail_a != priv->avail_a || avail_b != priv->avail_b)
+    {
+      priv->avail_a = avail_a;
+      priv->avail_b = avail_b;
+      mx_item_view_queue_update (item_view, FALSE);
+    }
+
+  n_per_line = mx_item_view_get_cells_per_line (item_view, avail_a);
+
+  /* as with MxGrid, only the axis the lines are stacked along scrolls */
+  adjustment = mx_item_view_get_scroll_adjustment (item_view);
+  other = vertical ? priv->vadjustment : priv->hadjustment;
+
+  if (adjustment)
+    {
+      upper = mx_item_view_get_content_b (item_view, n_per_line) + b_total;
+
+      g_object_set (G_OBJECT (adjustment),
+                    "lower", 0.0,
+                    "upper", (gdouble) upper,
+                    "page-size", (gdouble) (avail_b + b_total),
+                    "step-increment", (gdouble) (priv->cell_b + bgap),
+                    "page-increment", (gdouble) (avail_b + b_total),
+                    NULL);
+    }
+
+  if (other)
+    g_object_set (G_OBJECT (other),
+                  "lower", 0.0,
+                  "upper", 0.0,
+                  NULL);
+
+  x_align = mx_grid_get_child_x_align (MX_GRID (item_view));
+  y_align = mx_grid_get_child_y_align (MX_GRID (item_view));
+
+  for (l = priv->items.head, cell = priv->first_cell; l; l = l->next, cell++)
+    {
+      ClutterActorBox child_box;
+      gfloat a, b;
+
+      a = a_start + (cell % n_per_line) * (priv->cell_a + agap);
+      b = b_start + (cell / n_per_line) * (priv->cell_b + bgap);
+
+      if (vertical)
+        {
+          child_box.x1 = b;
+          child_box.y1 = a;
+          child_box.x2 = b + priv->cell_b;
+          child_box.y2 = a + priv->cell_a;
+        }
+      else
+        {
+          child_box.x1 = a;
+          child_box.y1 = b;
+          child_box.x2 = a + priv->cell_a;
+          child_box.y2 = b + priv->cell_b;
+        }
+
+      mx_allocate_align_fill (l->data, &child_box, x_align, y_align,
+                              FALSE, FALSE);
+
+      clutter_actor_allocate (l->data, &child_box, flags);
+    }
+}
+
 static void
 mx_item_view_class_init (MxItemViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxItemViewPrivate));
@@ -160,6 +995,10 @@ mx_item_view_class_init (MxItemViewClass *klass)
   object_class->dispose = mx_item_view_dispose;
   object_class->finalize = mx_item_view_finalize;
 
+  actor_class->get_preferred_width = mx_item_view_get_preferred_width;
+  actor_class->get_preferred_height = mx_item_view_get_preferred_height;
+  actor_class->allocate = mx_item_view_allocate;
+
   pspec = g_param_spec_object ("model",
                                "model",
                                "The model for the item view",
@@ -185,24 +1024,66 @@ mx_item_view_class_init (MxItemViewClass *klass)
                                G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
                                MX_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_FACTORY, pspec);
+
+  /**
+   * MxItemView:virtualized:
+   *
+   * Whether children are only created for the visible cells.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("virtualized",
+                                "Virtualized",
+                                "Only create children for the visible cells.",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUALIZED, pspec);
+
+  /**
+   * MxItemView:overscan:
+   *
+   * The number of lines of cells either side of the visible area that have
+   * children when the view is virtualized.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint ("overscan",
+                             "Overscan",
+                             "The number of extra lines of cells to create "
+                             "children for when virtualized.",
+                             0, G_MAXINT, DEFAULT_OVERSCAN,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OVERSCAN, pspec);
 }
 
 static void
 mx_item_view_init (MxItemView *item_view)
 {
-  item_view->priv = ITEM_VIEW_PRIVATE (item_view);
-}
+  MxItemViewPrivate *priv;
+
+  priv = item_view->priv = ITEM_VIEW_PRIVATE (item_view);
 
+  priv->rows = g_sequence_new (g_object_unref);
+  g_queue_init (&priv->items);
+  g_queue_init (&priv->recycled);
+  priv->overscan = DEFAULT_OVERSCAN;
+
+  g_signal_connect (item_view, "notify::horizontal-adjustment",
+                    G_CALLBACK (mx_item_view_adjustments_notify_cb), NULL);
+  g_signal_connect (item_view, "notify::vertical-adjustment",
+                    G_CALLBACK (mx_item_view_adjustments_notify_cb), NULL);
+  g_signal_connect (item_view, "notify::orientation",
+                    G_CALLBACK (mx_item_view_orientation_notify_cb), NULL);
+}
 
 /* model monitors */
 static void
 model_changed_cb (ClutterModel *model,
                   MxItemView   *item_view)
 {
-  GSList *p;
-  GList *l, *children;
   MxItemViewPrivate *priv = item_view->priv;
   ClutterModelIter *iter = NULL;
+  GSequenceIter *seq_iter;
   gint model_n = 0, child_n = 0;
 
 
@@ -225,8 +1106,14 @@ model_changed_cb (ClutterModel *model,
         }
     }
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
-  child_n = g_list_length (children);
+  /* only the visible cells have children, which are all re-bound */
+  if (priv->virtualized)
+    {
+      mx_item_view_queue_update (item_view, TRUE);
+      return;
+    }
+
+  child_n = g_sequence_get_length (priv->rows);
 
   if (model)
     model_n = clutter_model_get_n_rows (priv->model);
@@ -238,66 +1125,108 @@ model_changed_cb (ClutterModel *model,
     {
       ClutterActor *new_child;
 
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
+      new_child = mx_item_view_create_item (item_view);
 
       clutter_actor_add_child (CLUTTER_ACTOR (item_view), new_child);
+      g_sequence_append (priv->rows, g_object_ref (new_child));
       child_n++;
     }
 
   /* remove children as needed */
-  l = g_list_last (children);
   while (child_n > model_n)
     {
-      clutter_actor_remove_child (CLUTTER_ACTOR (item_view), l->data);
-      l = g_list_previous (l);
+      seq_iter = g_sequence_iter_prev (g_sequence_get_end_iter (priv->rows));
+
+      clutter_actor_remove_child (CLUTTER_ACTOR (item_view),
+                                  g_sequence_get (seq_iter));
+      g_sequence_remove (seq_iter);
       child_n--;
     }
 
-  g_list_free (children);
-
   if (!priv->model)
     return;
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
-
   /* set the properties on the children */
   iter = clutter_model_get_first_iter (priv->model);
-  l = children;
+  seq_iter = g_sequence_get_begin_iter (priv->rows);
   while (iter && !clutter_model_iter_is_last (iter))
     {
-      GObject *child;
+      mx_item_view_bind_item (item_view, g_sequence_get (seq_iter), iter);
 
-      child = G_OBJECT (l->data);
+      seq_iter = g_sequence_iter_next (seq_iter);
+      clutter_model_iter_next (iter);
+    }
 
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
+  if (iter)
+    g_object_unref (iter);
+}
+
+/* Whether a row could have moved in, out of, or within the model without a
+ * "row-added", "row-removed" or "sort-changed" signal, which can only be
+ * found out by walking the whole model */
+static gboolean
+model_rows_can_move (ClutterModel *model)
+{
+  return clutter_model_get_filter_set (model)
+    || clutter_model_get_sorting_column (model) >= 0;
+}
 
-          clutter_model_iter_get_value (iter, attr->col, &value);
+static void
+row_added_cb (ClutterModel     *model,
+              ClutterModelIter *iter,
+              MxItemView       *item_view)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  GSequenceIter *seq_iter;
+  ClutterActor *child;
+  gint row;
 
-          g_object_set_property (child, attr->name, &value);
+  if (priv->is_frozen || (!priv->item_type && !priv->factory))
+    return;
+
+  /* the row number of a sorted or filtered model doesn't say where the
+   * row is shown */
+  if (model_rows_can_move (model))
+    {
+      model_changed_cb (model, item_view);
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      gint end = priv->first_cell + g_queue_get_length (&priv->items);
 
-          g_value_unset (&value);
+      if (row < priv->first_cell)
+        priv->first_cell++;
+      else if (row < end)
+        {
+          ClutterActor *next = g_queue_peek_nth (&priv->items,
+                                                 row - priv->first_cell);
+
+          child = mx_item_view_get_item (item_view);
+          mx_item_view_bind_item (item_view, G_OBJECT (child), iter);
+          g_queue_push_nth (&priv->items, child, row - priv->first_cell);
+          clutter_actor_set_child_below_sibling (CLUTTER_ACTOR (item_view),
+                                                 child, next);
         }
-      g_object_thaw_notify (child);
 
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
+      /* fix up the ends of the window */
+      mx_item_view_queue_update (item_view, FALSE);
+      return;
     }
 
-  g_list_free (children);
+  child = mx_item_view_create_item (item_view);
+  mx_item_view_bind_item (item_view, G_OBJECT (child), iter);
 
-  if (iter)
-    g_object_unref (iter);
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (g_sequence_iter_is_end (seq_iter))
+    clutter_actor_add_child (CLUTTER_ACTOR (item_view), child);
+  else
+    clutter_actor_insert_child_below (CLUTTER_ACTOR (item_view), child,
+                                      g_sequence_get (seq_iter));
+  g_sequence_insert_before (seq_iter, g_object_ref (child));
 }
 
 static void
@@ -305,7 +1234,35 @@ row_changed_cb (ClutterModel     *model,
                 ClutterModelIter *iter,
                 MxItemView       *item_view)
 {
-  model_changed_cb (model, item_view);
+  MxItemViewPrivate *priv = item_view->priv;
+  GSequenceIter *seq_iter;
+  gint row;
+
+  if (priv->is_frozen)
+    return;
+
+  if (model_rows_can_move (model))
+    {
+      model_changed_cb (model, item_view);
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      if (row >= priv->first_cell
+          && row < priv->first_cell + (gint) g_queue_get_length (&priv->items))
+        mx_item_view_bind_item (item_view,
+                                g_queue_peek_nth (&priv->items,
+                                                  row - priv->first_cell),
+                                iter);
+      return;
+    }
+
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (!g_sequence_iter_is_end (seq_iter))
+    mx_item_view_bind_item (item_view, g_sequence_get (seq_iter), iter);
 }
 
 static void
@@ -313,18 +1270,47 @@ row_removed_cb (ClutterModel     *model,
                 ClutterModelIter *iter,
                 MxItemView       *item_view)
 {
-  GList *children;
-  GList *l;
-  ClutterActor *child;
+  MxItemViewPrivate *priv = item_view->priv;
+  GSequenceIter *seq_iter;
+  gint row;
 
-  if (item_view->priv->is_frozen)
+  if (priv->is_frozen)
     return;
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_actor_remove_child (CLUTTER_ACTOR (item_view), child);
-  g_list_free (children);
+  /* The row number of a filtered model counts the rows that are filtered
+   * out. The row is only taken out of the model after this signal, so
+   * rebuild the children before the next frame. */
+  if (clutter_model_get_filter_set (model))
+    {
+      priv->rebuild = TRUE;
+      mx_item_view_queue_update (item_view, FALSE);
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      gint end = priv->first_cell + g_queue_get_length (&priv->items);
+
+      if (row < priv->first_cell)
+        priv->first_cell--;
+      else if (row < end)
+        mx_item_view_recycle_item (item_view,
+                                   g_queue_pop_nth (&priv->items,
+                                                    row - priv->first_cell));
+
+      mx_item_view_queue_update (item_view, FALSE);
+      return;
+    }
+
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (g_sequence_iter_is_end (seq_iter))
+    return;
+
+  clutter_actor_remove_child (CLUTTER_ACTOR (item_view),
+                              g_sequence_get (seq_iter));
+  g_sequence_remove (seq_iter);
 }
 
 /* public api */
@@ -376,6 +1362,10 @@ mx_item_view_set_item_type (MxItemView *item_view,
 
   item_view->priv->item_type = item_type;
 
+  /* the recycled children are of the old type */
+  if (item_view->priv->virtualized)
+    mx_item_view_clear_items (item_view);
+
   /* update the view */
   model_changed_cb (item_view->priv->model, item_view);
 }
@@ -419,6 +1409,9 @@ mx_item_view_set_model (MxItemView   *item_view,
       g_signal_handlers_disconnect_by_func (priv->model,
                                             (GCallback) model_changed_cb,
                                             item_view);
+      g_signal_handlers_disconnect_by_func (priv->model,
+                                            (GCallback) row_added_cb,
+                                            item_view);
       g_signal_handlers_disconnect_by_func (priv->model,
                                             (GCallback) row_changed_cb,
                                             item_view);
@@ -443,7 +1436,7 @@ mx_item_view_set_model (MxItemView   *item_view,
 
       priv->row_added = g_signal_connect (priv->model,
                                           "row-added",
-                                          G_CALLBACK (row_changed_cb),
+                                          G_CALLBACK (row_added_cb),
                                           item_view);
 
       priv->row_changed = g_signal_connect (priv->model,
@@ -452,13 +1445,13 @@ mx_item_view_set_model (MxItemView   *item_view,
                                             item_view);
 
       /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
+       * row_removed_cb needs to look at the row, which is removed by the
+       * default handler, so don't use _after
        */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  item_view);
+      priv->row_removed = g_signal_connect (priv->model,
+                                            "row-removed",
+                                            G_CALLBACK (row_removed_cb),
+                                            item_view);
 
       priv->sort_changed = g_signal_connect (priv->model,
                                              "sort-changed",
@@ -572,6 +1565,13 @@ mx_item_view_set_factory (MxItemView    *item_view,
   if (factory)
     priv->factory = g_object_ref (factory);
 
+  /* the recycled children were made by the old factory */
+  if (priv->virtualized)
+    {
+      mx_item_view_clear_items (item_view);
+      model_changed_cb (priv->model, item_view);
+    }
+
   g_object_notify (G_OBJECT (item_view), "factory");
 }
 
@@ -589,3 +1589,109 @@ mx_item_view_get_factory (MxItemView *item_view)
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), NULL);
   return item_view->priv->factory;
 }
+
+/**
+ * mx_item_view_set_virtualized:
+ * @item_view: A #MxItemView
+ * @virtualized: %TRUE to only create children for the visible cells
+ *
+ * Sets whether @item_view creates a child for every row in the model, or
+ * only for the cells that are visible in the scrolled area. When
+ * virtualized, every cell is given the size of the largest visible child,
+ * cells are placed by their index rather than flowed, and children are
+ * re-used for other cells as the view is scrolled.
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_set_virtualized (MxItemView *item_view,
+                              gboolean    virtualized)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  priv = item_view->priv;
+
+  if (priv->virtualized == virtualized)
+    return;
+
+  priv->virtualized = virtualized;
+  priv->cell_a = priv->cell_b = 0;
+
+  /* the children were laid out for the other mode, so start again */
+  mx_item_view_clear_items (item_view);
+  model_changed_cb (priv->model, item_view);
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (item_view));
+
+  g_object_notify (G_OBJECT (item_view), "virtualized");
+}
+
+/**
+ * mx_item_view_get_virtualized:
+ * @item_view: A #MxItemView
+ *
+ * Gets whether @item_view only creates children for the visible cells.
+ *
+ * Returns: %TRUE if @item_view is virtualized
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_item_view_get_virtualized (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), FALSE);
+
+  return item_view->priv->virtualized;
+}
+
+/**
+ * mx_item_view_set_overscan:
+ * @item_view: A #MxItemView
+ * @overscan: the number of lines of cells
+ *
+ * Sets the number of lines of cells either side of the visible area that
+ * have children when @item_view is virtualized.
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_set_overscan (MxItemView *item_view,
+                           guint       overscan)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  priv = item_view->priv;
+
+  if (priv->overscan == overscan)
+    return;
+
+  priv->overscan = overscan;
+
+  if (priv->virtualized)
+    mx_item_view_queue_update (item_view, FALSE);
+
+  g_object_notify (G_OBJECT (item_view), "overscan");
+}
+
+/**
+ * mx_item_view_get_overscan:
+ * @item_view: A #MxItemView
+ *
+ * Gets the number of lines of cells either side of the visible area that
+ * have children when @item_view is virtualized.
+ *
+ * Returns: the number of lines
+ *
+ * Since: 2.0
+ */
+guint
+mx_item_view_get_overscan (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), 0);
+
+  return item_view->priv->overscan;
+}
@@ -32,12 +32,25 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxListView can be made virtualized with
+ * mx_list_view_set_virtualized(). In this mode, children are only created
+ * for the rows that are visible in the scrolled area plus a number of extra
+ * rows either side (see mx_list_view_set_overscan()), and children are
+ * re-used for other rows as the view scrolls. The height of the view is
+ * estimated from the height of the visible rows and every row is allocated
+ * that height.
  */
 
+#include <math.h>
+
 #include "mx-list-view.h"
 #include "mx-box-layout.h"
+#include "mx-box-layout-child.h"
 #include "mx-private.h"
 #include "mx-item-factory.h"
+#include "mx-scrollable.h"
+#include "mx-utils.h"
 
 G_DEFINE_TYPE (MxListView, mx_list_view, MX_TYPE_BOX_LAYOUT)
 
@@ -56,9 +69,13 @@ enum
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUALIZED,
+  PROP_OVERSCAN
 };
 
+#define DEFAULT_OVERSCAN 4
+
 struct _MxListViewPrivate
 {
   ClutterModel  *model;
@@ -73,7 +90,27 @@ struct _MxListViewPrivate
   gulong         row_removed;
   gulong         sort_changed;
 
+  /* the child of each row, in row order, when not virtualized */
+  GSequence     *rows;
+
   guint          is_frozen : 1;
+  guint          virtualized : 1;
+  guint          rebind : 1;
+  guint          rebuild : 1;
+
+  /* virtualized mode: the children showing rows first_row onwards, in
+   * order, and the hidden children waiting to be re-used */
+  GQueue         items;
+  GQueue         recycled;
+  gint           first_row;
+  guint          overscan;
+
+  gfloat         row_height;
+  gfloat         avail_width;
+  gfloat         avail_height;
+
+  MxAdjustment  *vadjustment;
+  guint          update_id;
 };
 
 /* gobject implementations */
@@ -96,6 +133,12 @@ mx_list_view_get_property (GObject    *object,
     case PROP_FACTORY:
       g_value_set_object (value, priv->factory);
       break;
+    case PROP_VIRTUALIZED:
+      g_value_set_boolean (value, priv->virtualized);
+      break;
+    case PROP_OVERSCAN:
+      g_value_set_uint (value, priv->overscan);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -121,6 +164,14 @@ mx_list_view_set_property (GObject      *object,
       mx_list_view_set_factory ((MxListView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUALIZED:
+      mx_list_view_set_virtualized ((MxListView*) object,
+                                    g_value_get_boolean (value));
+      break;
+    case PROP_OVERSCAN:
+      mx_list_view_set_overscan ((MxListView*) object,
+                                 g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -140,6 +191,27 @@ mx_list_view_dispose (GObject *object)
       priv->factory = NULL;
     }
 
+  if (priv->update_id)
+    {
+      clutter_threads_remove_repaint_func (priv->update_id);
+      priv->update_id = 0;
+    }
+
+  if (priv->vadjustment)
+    {
+      g_signal_handlers_disconnect_matched (priv->vadjustment,
+                                            G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, object);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
+    }
+
+  /* the children themselves are destroyed by ClutterActor */
+  g_queue_clear (&priv->items);
+  g_queue_clear (&priv->recycled);
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->rows),
+                           g_sequence_get_end_iter (priv->rows));
+
   G_OBJECT_CLASS (mx_list_view_parent_class)->dispose (object);
 }
 
@@ -162,13 +234,526 @@ mx_list_view_finalize (GObject *object)
       priv->attributes = NULL;
     }
 
+  g_sequence_free (priv->rows);
+
   G_OBJECT_CLASS (mx_list_view_parent_class)->finalize (object);
 }
 
+/* items */
+
+static ClutterActor *
+mx_list_view_create_item (MxListView *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+
+  if (priv->item_type)
+    return g_object_new (priv->item_type, NULL);
+  else
+    return mx_item_factory_create (priv->factory);
+}
+
+static void
+mx_list_view_bind_item (MxListView       *list_view,
+                        GObject          *child,
+                        ClutterModelIter *iter)
+{
+  GSList *p;
+
+  g_object_freeze_notify (child);
+  for (p = list_view->priv->attributes; p; p = p->next)
+    {
+      GValue value = { 0, };
+      AttributeData *attr = p->data;
+
+      clutter_model_iter_get_value (iter, attr->col, &value);
+
+      g_object_set_property (child, attr->name, &value);
+
+      g_value_unset (&value);
+    }
+  g_object_thaw_notify (child);
+}
+
+/* virtualized mode */
+
+static ClutterActor *
+mx_list_view_get_item (MxListView *list_view)
+{
+  ClutterActor *item;
+
+  item = g_queue_pop_head (&list_view->priv->recycled);
+  if (item)
+    {
+      clutter_actor_show (item);
+      return item;
+    }
+
+  item = mx_list_view_create_item (list_view);
+  clutter_actor_add_child (CLUTTER_ACTOR (list_view), item);
+
+  return item;
+}
+
+static void
+mx_list_view_recycle_item (MxListView   *list_view,
+                           ClutterActor *item)
+{
+  /* recycled items stay in the container, hidden, so that re-using them
+   * doesn't have to re-parent them */
+  clutter_actor_hide (item);
+  g_queue_push_head (&list_view->priv->recycled, item);
+}
+
+static void
+mx_list_view_remove_item (ClutterActor *item,
+                          MxListView   *list_view)
+{
+  clutter_actor_remove_child (CLUTTER_ACTOR (list_view), item);
+}
+
+/* removes the children the view created for rows, leaving any others that
+ * were added to the container alone */
+static void
+mx_list_view_clear_items (MxListView *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+
+  g_queue_foreach (&priv->items, (GFunc) mx_list_view_remove_item,
+                   list_view);
+  g_queue_foreach (&priv->recycled, (GFunc) mx_list_view_remove_item,
+                   list_view);
+  g_queue_clear (&priv->items);
+  g_queue_clear (&priv->recycled);
+  priv->first_row = 0;
+
+  g_sequence_foreach (priv->rows, (GFunc) mx_list_view_remove_item,
+                      list_view);
+  g_sequence_remove_range (g_sequence_get_begin_iter (priv->rows),
+                           g_sequence_get_end_iter (priv->rows));
+}
+
+static gfloat
+mx_list_view_get_stride (MxListView *list_view)
+{
+  return list_view->priv->row_height
+    + mx_box_layout_get_spacing (MX_BOX_LAYOUT (list_view));
+}
+
+/* the estimated height of all the rows, not including padding */
+static gfloat
+mx_list_view_get_content_height (MxListView *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  gint n_rows;
+
+  if (!priv->model)
+    return 0;
+
+  n_rows = clutter_model_get_n_rows (priv->model);
+  if (n_rows == 0)
+    return 0;
+
+  return n_rows * mx_list_view_get_stride (list_view)
+    - mx_box_layout_get_spacing (MX_BOX_LAYOUT (list_view));
+}
+
+/* find the rows that need children: the ones in the visible area plus the
+ * overscan either side */
+static void
+mx_list_view_get_window (MxListView *list_view,
+                         gint        n_rows,
+                         gint       *first_p,
+                         gint       *last_p)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  MxPadding padding;
+  gdouble value, page_size;
+  gfloat stride;
+  gint first, last;
+
+  /* until a row has been measured, only realize the first one */
+  if (priv->row_height <= 0)
+    {
+      *first_p = 0;
+      *last_p = MIN (1, n_rows);
+      return;
+    }
+
+  mx_widget_get_padding (MX_WIDGET (list_view), &padding);
+  stride = mx_list_view_get_stride (list_view);
+
+  if (priv->vadjustment)
+    mx_adjustment_get_values (priv->vadjustment, &value, NULL, NULL, NULL,
+                              NULL, &page_size);
+  else
+    {
+      value = 0;
+      page_size = priv->avail_height;
+    }
+
+  if (page_size <= 0)
+    page_size = stride;
+
+  first = (gint) floor ((value - padding.top) / stride) - priv->overscan;
+  last = (gint) ceil ((value + page_size - padding.top) / stride)
+    + priv->overscan;
+
+  *first_p = CLAMP (first, 0, n_rows);
+  *last_p = CLAMP (last, *first_p, n_rows);
+}
+
+static void
+mx_list_view_move_window (MxListView *list_view,
+                          gint        first,
+                          gint        last,
+                          gboolean    rebind)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  ClutterActor *actor = CLUTTER_ACTOR (list_view);
+  ClutterModelIter *iter;
+  ClutterActor *item, *old_head;
+  gint end, row;
+
+  end = priv->first_row + g_queue_get_length (&priv->items);
+
+  /* if none of the current items can be kept, start again */
+  if (rebind || g_queue_is_empty (&priv->items)
+      || first >= end || last <= priv->first_row)
+    {
+      while ((item = g_queue_pop_head (&priv->items)))
+        mx_list_view_recycle_item (list_view, item);
+
+      priv->first_row = end = first;
+    }
+
+  /* recycle the rows that have moved out of the window */
+  for (; priv->first_row < first; priv->first_row++)
+    {
+      item = g_queue_pop_head (&priv->items);
+      mx_list_view_recycle_item (list_view, item);
+    }
+
+  for (; end > last; end--)
+    {
+      item = g_queue_pop_tail (&priv->items);
+      mx_list_view_recycle_item (list_view, item);
+    }
+
+  /* and fill in the rows that have moved in, keeping the children in the
+   * same order as the rows for keyboard navigation */
+  if (first < priv->first_row)
+    {
+      old_head = g_queue_peek_head (&priv->items);
+      iter = clutter_model_get_iter_at_row (priv->model, first);
+
+      for (row = first; iter && row < priv->first_row; row++)
+        {
+          item = mx_list_view_get_item (list_view);
+          mx_list_view_bind_item (list_view, G_OBJECT (item), iter);
+          g_queue_push_nth (&priv->items, item, row - first);
+          clutter_actor_set_child_below_sibling (actor, item, old_head);
+
+          clutter_model_iter_next (iter);
+        }
+
+      if (iter)
+        g_object_unref (iter);
+
+      priv->first_row = first;
+    }
+
+  if (end < last)
+    {
+      iter = clutter_model_get_iter_at_row (priv->model, end);
+
+      for (row = end; iter && row < last; row++)
+        {
+          item = mx_list_view_get_item (list_view);
+          mx_list_view_bind_item (list_view, G_OBJECT (item), iter);
+          g_queue_push_tail (&priv->items, item);
+          clutter_actor_set_child_above_sibling (actor, item, NULL);
+
+          clutter_model_iter_next (iter);
+        }
+
+      if (iter)
+        g_object_unref (iter);
+    }
+}
+
+/* the row height estimate is the average height of the realized rows */
+static gfloat
+mx_list_view_measure_rows (MxListView *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  gfloat for_width, height, total = 0;
+  GList *l;
+
+  if (g_queue_is_empty (&priv->items))
+    return priv->row_height;
+
+  for_width = (priv->avail_width > 0) ? priv->avail_width : -1;
+
+  for (l = priv->items.head; l; l = l->next)
+    {
+      clutter_actor_get_preferred_height (l->data, for_width, NULL, &height);
+      total += height;
+    }
+
+  return total / g_queue_get_length (&priv->items);
+}
+
+static void
+mx_list_view_update_items (MxListView *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  gboolean rebind;
+  gfloat row_height;
+  gint first, last, n_rows, pass;
+
+  rebind = priv->rebind;
+  priv->rebind = FALSE;
+
+  if (!priv->virtualized || priv->is_frozen)
+    return;
+
+  if (!priv->model || (!priv->item_type && !priv->factory))
+    return;
+
+  n_rows = clutter_model_get_n_rows (priv->model);
+
+  /* realizing rows can change the row height estimate, which changes the
+   * window, so go round a second time if it does */
+  for (pass = 0; pass < 2; pass++)
+    {
+      mx_list_view_get_window (list_view, n_rows, &first, &last);
+      mx_list_view_move_window (list_view, first, last, rebind);
+      rebind = FALSE;
+
+      row_height = mx_list_view_measure_rows (list_view);
+      if (fabsf (row_height - priv->row_height) < 0.5f)
+        break;
+
+      priv->row_height = row_height;
+    }
+
+  MX_NOTE (LAYOUT, "list view %p showing rows %d-%d of %d",
+           list_view, priv->first_row,
+           priv->first_row + (gint) g_queue_get_length (&priv->items),
+           n_rows);
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (list_view));
+}
+
+static void model_changed_cb (ClutterModel *model,
+                              MxListView   *list_view);
+
+static gboolean
+mx_list_view_update_cb (gpointer data)
+{
+  MxListView *list_view = data;
+  MxListViewPrivate *priv = list_view->priv;
+
+  priv->update_id = 0;
+
+  if (priv->rebuild)
+    {
+      priv->rebuild = FALSE;
+      model_changed_cb (priv->model, list_view);
+    }
+
+  mx_list_view_update_items (list_view);
+
+  return FALSE;
+}
+
+/* Children can't be added or hidden during an allocation, so the window is
+ * moved before the next frame is laid out instead */
+static void
+mx_list_view_queue_update (MxListView *list_view,
+                           gboolean    rebind)
+{
+  MxListViewPrivate *priv = list_view->priv;
+
+  if (rebind)
+    priv->rebind = TRUE;
+
+  if (!priv->update_id)
+    priv->update_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT
+                                             | CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD,
+                                             mx_list_view_update_cb,
+                                             list_view, NULL);
+}
+
+static void
+mx_list_view_adjustment_notify_cb (MxAdjustment *adjustment,
+                                   GParamSpec   *pspec,
+                                   MxListView   *list_view)
+{
+  if (list_view->priv->virtualized)
+    mx_list_view_queue_update (list_view, FALSE);
+}
+
+static void
+mx_list_view_vadjustment_notify_cb (MxListView *list_view,
+                                    GParamSpec *pspec,
+                                    gpointer    user_data)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  MxAdjustment *hadjustment, *vadjustment;
+
+  /* mx_scrollable_get_adjustments() would create an adjustment in place of
+   * one that has just been cleared */
+  _mx_box_layout_peek_adjustments (MX_BOX_LAYOUT (list_view), &hadjustment,
+                                   &vadjustment);
+
+  if (priv->vadjustment == vadjustment)
+    return;
+
+  if (priv->vadjustment)
+    {
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            mx_list_view_adjustment_notify_cb,
+                                            list_view);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
+    }
+
+  if (vadjustment)
+    {
+      priv->vadjustment = g_object_ref (vadjustment);
+      g_signal_connect (vadjustment, "notify::value",
+                        G_CALLBACK (mx_list_view_adjustment_notify_cb),
+                        list_view);
+      g_signal_connect (vadjustment, "notify::page-size",
+                        G_CALLBACK (mx_list_view_adjustment_notify_cb),
+                        list_view);
+    }
+
+  if (priv->virtualized)
+    mx_list_view_queue_update (list_view, FALSE);
+}
+
+/* actor implementations */
+
+static void
+mx_list_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
+{
+  MxListView *list_view = MX_LIST_VIEW (actor);
+  MxPadding padding;
+  gfloat height;
+
+  if (!list_view->priv->virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->
+        get_preferred_height (actor, for_width, min_height_p, natural_height_p);
+      return;
+    }
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  height = mx_list_view_get_content_height (list_view)
+    + padding.top + padding.bottom;
+
+  if (min_height_p)
+    *min_height_p = height;
+  if (natural_height_p)
+    *natural_height_p = height;
+}
+
+static void
+mx_list_view_allocate (ClutterActor          *actor,
+                       const ClutterActorBox *box,
+                       ClutterAllocationFlags flags)
+{
+  MxListView *list_view = MX_LIST_VIEW (actor);
+  MxListViewPrivate *priv = list_view->priv;
+  ClutterActorClass *widget_class;
+  gfloat avail_width, avail_height, stride;
+  MxPadding padding;
+  GList *l;
+  gint row;
+
+  if (!priv->virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
+    }
+
+  /* MxBoxLayout would place the realized rows one after the other from the
+   * top, so skip it and place them by row number */
+  widget_class = g_type_class_peek_parent (mx_list_view_parent_class);
+  widget_class->allocate (actor, box, flags);
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  avail_width = box->x2 - box->x1 - padding.left - padding.right;
+  avail_height = box->y2 - box->y1 - padding.top - padding.bottom;
+
+  if (avail_width != priv->avail_width || avail_height != priv->avail_height)
+    {
+      priv->avail_width = avail_width;
+      priv->avail_height = avail_height;
+      mx_list_view_queue_update (list_view, FALSE);
+    }
+
+  stride = mx_list_view_get_stride (list_view);
+
+  if (priv->vadjustment)
+    {
+      gdouble step_inc, page_inc;
+
+      if (stride > 0)
+        {
+          step_inc = stride;
+          page_inc = ((gint)(avail_height / step_inc)) * step_inc;
+        }
+      else
+        {
+          step_inc = avail_height / 6;
+          page_inc = avail_height;
+        }
+
+      g_object_set (G_OBJECT (priv->vadjustment),
+                    "lower", 0.0,
+                    "upper", (gdouble) mx_list_view_get_content_height (list_view),
+                    "page-size", (gdouble) avail_height,
+                    "step-increment", step_inc,
+                    "page-increment", page_inc,
+                    NULL);
+    }
+
+  for (l = priv->items.head, row = priv->first_row; l; l = l->next, row++)
+    {
+      ClutterActor *child = l->data;
+      MxBoxLayoutChild *meta;
+      ClutterActorBox child_box;
+
+      meta = (MxBoxLayoutChild *)
+        clutter_container_get_child_meta (CLUTTER_CONTAINER (actor), child);
+
+      child_box.x1 = padding.left;
+      child_box.x2 = padding.left + avail_width;
+      child_box.y1 = padding.top + row * stride;
+      child_box.y2 = child_box.y1 + priv->row_height;
+
+      mx_allocate_align_fill (child, &child_box, meta->x_align, meta->y_align,
+                              meta->x_fill, meta->y_fill);
+
+      clutter_actor_allocate (child, &child_box, flags);
+    }
+}
+
 static void
 mx_list_view_class_init (MxListViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxListViewPrivate));
@@ -178,6 +763,9 @@ mx_list_view_class_init (MxListViewClass *klass)
   object_class->dispose = mx_list_view_dispose;
   object_class->finalize = mx_list_view_finalize;
 
+  actor_class->get_preferred_height = mx_list_view_get_preferred_height;
+  actor_class->allocate = mx_list_view_allocate;
+
   pspec = g_param_spec_object ("model",
                                "model",
                                "The model for the item view",
@@ -203,14 +791,54 @@ mx_list_view_class_init (MxListViewClass *klass)
                                G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
                                MX_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_FACTORY, pspec);
+
+  /**
+   * MxListView:virtualized:
+   *
+   * Whether children are only created for the visible rows of the model.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("virtualized",
+                                "Virtualized",
+                                "Only create children for the visible rows.",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUALIZED, pspec);
+
+  /**
+   * MxListView:overscan:
+   *
+   * The number of rows either side of the visible area that have children
+   * when the view is virtualized.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint ("overscan",
+                             "Overscan",
+                             "The number of extra rows to create children "
+                             "for when virtualized.",
+                             0, G_MAXINT, DEFAULT_OVERSCAN,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OVERSCAN, pspec);
 }
 
 static void
 mx_list_view_init (MxListView *list_view)
 {
-  list_view->priv = LIST_VIEW_PRIVATE (list_view);
+  MxListViewPrivate *priv;
+
+  priv = list_view->priv = LIST_VIEW_PRIVATE (list_view);
+
+  priv->rows = g_sequence_new (g_object_unref);
+  g_queue_init (&priv->items);
+  g_queue_init (&priv->recycled);
+  priv->overscan = DEFAULT_OVERSCAN;
 
   mx_box_layout_set_orientation (MX_BOX_LAYOUT (list_view), MX_ORIENTATION_VERTICAL);
+
+  g_signal_connect (list_view, "notify::vertical-adjustment",
+                    G_CALLBACK (mx_list_view_vadjustment_notify_cb), NULL);
 }
 
 
@@ -219,10 +847,9 @@ static void
 model_changed_cb (ClutterModel *model,
                   MxListView   *list_view)
 {
-  GSList *p;
-  GList *l, *children;
   MxListViewPrivate *priv = list_view->priv;
   ClutterModelIter *iter = NULL;
+  GSequenceIter *seq_iter;
   gint model_n = 0, child_n = 0;
 
 
@@ -245,8 +872,14 @@ model_changed_cb (ClutterModel *model,
         }
     }
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
-  child_n = g_list_length (children);
+  /* only the visible rows have children, which are all re-bound */
+  if (priv->virtualized)
+    {
+      mx_list_view_queue_update (list_view, TRUE);
+      return;
+    }
+
+  child_n = g_sequence_get_length (priv->rows);
 
   if (model)
     model_n = clutter_model_get_n_rows (priv->model);
@@ -258,66 +891,108 @@ model_changed_cb (ClutterModel *model,
     {
       ClutterActor *new_child;
 
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
+      new_child = mx_list_view_create_item (list_view);
 
       clutter_actor_add_child (CLUTTER_ACTOR (list_view), new_child);
+      g_sequence_append (priv->rows, g_object_ref (new_child));
       child_n++;
     }
 
   /* remove children as needed */
-  l = g_list_last (children);
   while (child_n > model_n)
     {
-      clutter_actor_remove_child (CLUTTER_ACTOR (list_view), l->data);
-      l = g_list_previous (l);
+      seq_iter = g_sequence_iter_prev (g_sequence_get_end_iter (priv->rows));
+
+      clutter_actor_remove_child (CLUTTER_ACTOR (list_view),
+                                  g_sequence_get (seq_iter));
+      g_sequence_remove (seq_iter);
       child_n--;
     }
 
-  g_list_free (children);
-
   if (!priv->model)
     return;
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
-
   /* set the properties on the children */
   iter = clutter_model_get_first_iter (priv->model);
-  l = children;
+  seq_iter = g_sequence_get_begin_iter (priv->rows);
   while (iter && !clutter_model_iter_is_last (iter))
     {
-      GObject *child;
+      mx_list_view_bind_item (list_view, g_sequence_get (seq_iter), iter);
 
-      child = G_OBJECT (l->data);
+      seq_iter = g_sequence_iter_next (seq_iter);
+      clutter_model_iter_next (iter);
+    }
 
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
+  if (iter)
+    g_object_unref (iter);
+}
+
+/* Whether a row could have moved in, out of, or within the model without a
+ * "row-added", "row-removed" or "sort-changed" signal, which can only be
+ * found out by walking the whole model */
+static gboolean
+model_rows_can_move (ClutterModel *model)
+{
+  return clutter_model_get_filter_set (model)
+    || clutter_model_get_sorting_column (model) >= 0;
+}
+
+static void
+row_added_cb (ClutterModel     *model,
+              ClutterModelIter *iter,
+              MxListView       *list_view)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  GSequenceIter *seq_iter;
+  ClutterActor *child;
+  gint row;
 
-          clutter_model_iter_get_value (iter, attr->col, &value);
+  if (priv->is_frozen || (!priv->item_type && !priv->factory))
+    return;
 
-          g_object_set_property (child, attr->name, &value);
+  /* the row number of a sorted or filtered model doesn't say where the
+   * row is shown */
+  if (model_rows_can_move (model))
+    {
+      model_changed_cb (model, list_view);
+      return;
+    }
 
-          g_value_unset (&value);
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      gint end = priv->first_row + g_queue_get_length (&priv->items);
+
+      if (row < priv->first_row)
+        priv->first_row++;
+      else if (row < end)
+        {
+          ClutterActor *next = g_queue_peek_nth (&priv->items,
+                                                 row - priv->first_row);
+
+          child = mx_list_view_get_item (list_view);
+          mx_list_view_bind_item (list_view, G_OBJECT (child), iter);
+          g_queue_push_nth (&priv->items, child, row - priv->first_row);
+          clutter_actor_set_child_below_sibling (CLUTTER_ACTOR (list_view),
+                                                 child, next);
         }
-      g_object_thaw_notify (child);
 
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
+      /* fix up the ends of the window */
+      mx_list_view_queue_update (list_view, FALSE);
+      return;
     }
 
-  g_list_free (children);
+  child = mx_list_view_create_item (list_view);
+  mx_list_view_bind_item (list_view, G_OBJECT (child), iter);
 
-  if (iter)
-    g_object_unref (iter);
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (g_sequence_iter_is_end (seq_iter))
+    clutter_actor_add_child (CLUTTER_ACTOR (list_view), child);
+  else
+    clutter_actor_insert_child_below (CLUTTER_ACTOR (list_view), child,
+                                      g_sequence_get (seq_iter));
+  g_sequence_insert_before (seq_iter, g_object_ref (child));
 }
 
 static void
@@ -325,7 +1000,35 @@ row_changed_cb (ClutterModel     *model,
                 ClutterModelIter *iter,
                 MxListView       *list_view)
 {
-  model_changed_cb (model, list_view);
+  MxListViewPrivate *priv = list_view->priv;
+  GSequenceIter *seq_iter;
+  gint row;
+
+  if (priv->is_frozen)
+    return;
+
+  if (model_rows_can_move (model))
+    {
+      model_changed_cb (model, list_view);
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      if (row >= priv->first_row
+          && row < priv->first_row + (gint) g_queue_get_length (&priv->items))
+        mx_list_view_bind_item (list_view,
+                                g_queue_peek_nth (&priv->items,
+                                                  row - priv->first_row),
+                                iter);
+      return;
+    }
+
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (!g_sequence_iter_is_end (seq_iter))
+    mx_list_view_bind_item (list_view, g_sequence_get (seq_iter), iter);
 }
 
 static void
@@ -333,18 +1036,47 @@ row_removed_cb (ClutterModel     *model,
                 ClutterModelIter *iter,
                 MxListView       *list_view)
 {
-  GList *children;
-  GList *l;
-  ClutterActor *child;
+  MxListViewPrivate *priv = list_view->priv;
+  GSequenceIter *seq_iter;
+  gint row;
+
+  if (priv->is_frozen)
+    return;
+
+  /* The row number of a filtered model counts the rows that are filtered
+   * out. The row is only taken out of the model after this signal, so
+   * rebuild the children before the next frame. */
+  if (clutter_model_get_filter_set (model))
+    {
+      priv->rebuild = TRUE;
+      mx_list_view_queue_update (list_view, FALSE);
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter);
+
+  if (priv->virtualized)
+    {
+      gint end = priv->first_row + g_queue_get_length (&priv->items);
+
+      if (row < priv->first_row)
+        priv->first_row--;
+      else if (row < end)
+        mx_list_view_recycle_item (list_view,
+                                   g_queue_pop_nth (&priv->items,
+                                                    row - priv->first_row));
+
+      mx_list_view_queue_update (list_view, FALSE);
+      return;
+    }
 
-  if (list_view->priv->is_frozen)
+  seq_iter = g_sequence_get_iter_at_pos (priv->rows, row);
+  if (g_sequence_iter_is_end (seq_iter))
     return;
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_actor_remove_child (CLUTTER_ACTOR (list_view), child);
-  g_list_free (children);
+  clutter_actor_remove_child (CLUTTER_ACTOR (list_view),
+                              g_sequence_get (seq_iter));
+  g_sequence_remove (seq_iter);
 }
 
 /* public api */
@@ -396,6 +1128,10 @@ mx_list_view_set_item_type (MxListView *list_view,
 
   list_view->priv->item_type = item_type;
 
+  /* the recycled children are of the old type */
+  if (list_view->priv->virtualized)
+    mx_list_view_clear_items (list_view);
+
   /* update the view */
   model_changed_cb (list_view->priv->model, list_view);
 }
@@ -439,6 +1175,9 @@ mx_list_view_set_model (MxListView   *list_view,
       g_signal_handlers_disconnect_by_func (priv->model,
                                             (GCallback) model_changed_cb,
                                             list_view);
+      g_signal_handlers_disconnect_by_func (priv->model,
+                                            (GCallback) row_added_cb,
+                                            list_view);
       g_signal_handlers_disconnect_by_func (priv->model,
                                             (GCallback) row_changed_cb,
                                             list_view);
@@ -463,7 +1202,7 @@ mx_list_view_set_model (MxListView   *list_view,
 
       priv->row_added = g_signal_connect (priv->model,
                                           "row-added",
-                                          G_CALLBACK (row_changed_cb),
+                                          G_CALLBACK (row_added_cb),
                                           list_view);
 
       priv->row_changed = g_signal_connect (priv->model,
@@ -472,13 +1211,13 @@ mx_list_view_set_model (MxListView   *list_view,
                                             list_view);
 
       /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
+       * row_removed_cb needs to look at the row, which is removed by the
+       * default handler, so don't use _after
        */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  list_view);
+      priv->row_removed = g_signal_connect (priv->model,
+                                            "row-removed",
+                                            G_CALLBACK (row_removed_cb),
+                                            list_view);
 
       priv->sort_changed = g_signal_connect (priv->model,
                                              "sort-changed",
@@ -596,6 +1335,13 @@ mx_list_view_set_factory (MxListView    *list_view,
   if (factory)
     priv->factory = g_object_ref (factory);
 
+  /* the recycled children were made by the old factory */
+  if (priv->virtualized)
+    {
+      mx_list_view_clear_items (list_view);
+      model_changed_cb (priv->model, list_view);
+    }
+
   g_object_notify (G_OBJECT (list_view), "factory");
 }
 
@@ -613,3 +1359,109 @@ mx_list_view_get_factory (MxListView *list_view)
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), NULL);
   return list_view->priv->factory;
 }
+
+/**
+ * mx_list_view_set_virtualized:
+ * @list_view: A #MxListView
+ * @virtualized: %TRUE to only create children for the visible rows
+ *
+ * Sets whether @list_view creates a child for every row in the model, or
+ * only for the rows that are visible in the scrolled area. When virtualized,
+ * the children are re-used for other rows as the view is scrolled, and every
+ * row is given the same, estimated, height.
+ *
+ * Since: 2.0
+ */
+void
+mx_list_view_set_virtualized (MxListView *list_view,
+                              gboolean    virtualized)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  priv = list_view->priv;
+
+  if (priv->virtualized == virtualized)
+    return;
+
+  priv->virtualized = virtualized;
+  priv->row_height = 0;
+
+  /* the children were laid out for the other mode, so start again */
+  mx_list_view_clear_items (list_view);
+  model_changed_cb (priv->model, list_view);
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (list_view));
+
+  g_object_notify (G_OBJECT (list_view), "virtualized");
+}
+
+/**
+ * mx_list_view_get_virtualized:
+ * @list_view: A #MxListView
+ *
+ * Gets whether @list_view only creates children for the visible rows.
+ *
+ * Returns: %TRUE if @list_view is virtualized
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_list_view_get_virtualized (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), FALSE);
+
+  return list_view->priv->virtualized;
+}
+
+/**
+ * mx_list_view_set_overscan:
+ * @list_view: A #MxListView
+ * @overscan: the number of rows
+ *
+ * Sets the number of rows either side of the visible area that have
+ * children when @list_view is virtualized. Larger values use more memory
+ * but leave fewer rows to fill in when the view scrolls quickly.
+ *
+ * Since: 2.0
+ */
+void
+mx_list_view_set_overscan (MxListView *list_view,
+                           guint       overscan)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  priv = list_view->priv;
+
+  if (priv->overscan == overscan)
+    return;
+
+  priv->overscan = overscan;
+
+  if (priv->virtualized)
+    mx_list_view_queue_update (list_view, FALSE);
+
+  g_object_notify (G_OBJECT (list_view), "overscan");
+}
+
+/**
+ * mx_list_view_get_overscan:
+ * @list_view: A #MxListView
+ *
+ * Gets the number of rows either side of the visible area that have
+ * children when @list_view is virtualized.
+ *
+ * Returns: the number of rows
+ *
+ * Since: 2.0
+ */
+guint
+mx_list_view_get_overscan (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), 0);
+
+  return list_view->priv->overscan;
+}
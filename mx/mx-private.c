@@ -122,3 +122,104 @@ _mx_paint_texture_with_opacity (CoglHandle texture,
 
   cogl_handle_unref (material);
 }
+
+void
+_mx_child_extents_add (GArray        *extents,
+                       ClutterActor  *child,
+                       MxOrientation  axis)
+{
+  MxChildExtent extent;
+
+  extent.child = child;
+  clutter_actor_get_allocation_box (child, &extent.box);
+
+  if (axis == MX_ORIENTATION_VERTICAL)
+    {
+      extent.min_start = extent.box.y1;
+      extent.max_end = extent.box.y2;
+    }
+  else
+    {
+      extent.min_start = extent.box.x1;
+      extent.max_end = extent.box.x2;
+    }
+
+  if (extents->len > 0)
+    {
+      MxChildExtent *prev = &g_array_index (extents, MxChildExtent,
+                                            extents->len - 1);
+
+      extent.max_end = MAX (extent.max_end, prev->max_end);
+    }
+
+  g_array_append_val (extents, extent);
+}
+
+void
+_mx_child_extents_finish (GArray *extents)
+{
+  gint i;
+
+  /* min_start is the smallest start of each child and the ones after it,
+   * which, like max_end, never decreases along the array however the
+   * children were placed */
+  for (i = (gint) extents->len - 2; i >= 0; i--)
+    {
+      MxChildExtent *extent = &g_array_index (extents, MxChildExtent, i);
+      MxChildExtent *next = &g_array_index (extents, MxChildExtent, i + 1);
+
+      extent->min_start = MIN (extent->min_start, next->min_start);
+    }
+}
+
+void
+_mx_child_extents_paint (GArray                *extents,
+                         const ClutterActorBox *visible,
+                         MxOrientation          axis)
+{
+  gfloat start, end;
+  guint lower, upper, i;
+
+  if (axis == MX_ORIENTATION_VERTICAL)
+    {
+      start = visible->y1;
+      end = visible->y2;
+    }
+  else
+    {
+      start = visible->x1;
+      end = visible->x2;
+    }
+
+  /* find the first child that could end after the start of the visible
+   * area */
+  lower = 0;
+  upper = extents->len;
+  while (lower < upper)
+    {
+      guint middle = lower + (upper - lower) / 2;
+
+      if (g_array_index (extents, MxChildExtent, middle).max_end > start)
+        upper = middle;
+      else
+        lower = middle + 1;
+    }
+
+  /* and paint until no more children can start before its end */
+  for (i = lower; i < extents->len; i++)
+    {
+      MxChildExtent *extent = &g_array_index (extents, MxChildExtent, i);
+
+      if (extent->min_start >= end)
+        break;
+
+      if ((extent->box.x1 < visible->x2)
+          && (extent->box.x2 > visible->x1)
+          && (extent->box.y1 < visible->y2)
+          && (extent->box.y2 > visible->y1)
+          && CLUTTER_ACTOR_IS_VISIBLE (extent->child))
+        {
+          clutter_actor_paint (extent->child);
+        }
+    }
+}
@@ -74,6 +74,16 @@ ClutterActor *_mx_widget_get_dnd_clone (MxWidget *widget);
 
 void _mx_box_layout_start_animation (MxBoxLayout *box);
 
+void _mx_box_layout_peek_adjustments (MxBoxLayout   *box,
+                                      MxAdjustment **hadjustment,
+                                      MxAdjustment **vadjustment);
+void _mx_grid_peek_adjustments       (MxGrid        *grid,
+                                      MxAdjustment **hadjustment,
+                                      MxAdjustment **vadjustment);
+void _mx_viewport_peek_adjustments   (MxViewport    *viewport,
+                                      MxAdjustment **hadjustment,
+                                      MxAdjustment **vadjustment);
+
 void _mx_bin_get_align_factors (MxBin   *bin,
                                 gdouble *x_align,
                                 gdouble *y_align);
@@ -88,7 +98,37 @@ ClutterActor * _mx_window_get_resize_grip (MxWindow *window);
 
 void _mx_style_invalidate_cache (MxStylable *stylable);
 
-gchar * _mx_stylable_get_style_string (MxStylable *stylable);
+/* A style key holds everything about a stylable that can be matched against
+ * in CSS. Keys are interned and share the key of the nearest stylable
+ * ancestor, so equal keys have the same address. */
+typedef struct _MxStyleKey MxStyleKey;
+struct _MxStyleKey
+{
+  MxStyleKey *parent;
+  GType       type;
+  GQuark      id;
+  GQuark      style_class;
+  guint64     pseudo_class;
+  GQuark      pseudo_class_string;
+
+  guint       hash;
+  gint        ref_count;
+};
+
+MxStyleKey * _mx_style_key_ref                 (MxStyleKey *key);
+void         _mx_style_key_unref               (MxStyleKey *key);
+MxStyleKey * _mx_stylable_get_style_key        (MxStylable *stylable);
+void         _mx_stylable_invalidate_style_key (MxStylable *stylable);
+
+/* Pseudo-class sets are bitsets of interned atoms. Pseudo-classes beyond
+ * the first MX_PSEUDO_CLASS_MAX_ATOMS share the overflow bit. */
+#define MX_PSEUDO_CLASS_MAX_ATOMS 63
+#define MX_PSEUDO_CLASS_OVERFLOW  ((guint64) 1 << MX_PSEUDO_CLASS_MAX_ATOMS)
+
+guint64 _mx_stylable_pseudo_class_to_mask        (const gchar *pseudo_class,
+                                                  gint        *n_pseudo_classes);
+guint64 _mx_stylable_get_style_pseudo_class_mask (MxStylable  *stylable);
+GQuark  _mx_stylable_get_style_class_quark       (MxStylable  *stylable);
 
 const gchar * _mx_enum_to_string (GType type,
                                   gint  value);
@@ -109,6 +149,26 @@ void _mx_paint_texture_with_opacity (CoglHandle texture,
                                      gfloat     width,
                                      gfloat     height);
 
+/* The allocations of a container's children in the order they were
+ * placed along one axis, so that the ones in a visible area can be found
+ * with a binary search. max_end and min_start are running extremes, so they
+ * can be searched even when the children overlap or are out of order. */
+typedef struct
+{
+  ClutterActor    *child;
+  ClutterActorBox  box;
+  gfloat           min_start;
+  gfloat           max_end;
+} MxChildExtent;
+
+void _mx_child_extents_add    (GArray                *extents,
+                               ClutterActor          *child,
+                               MxOrientation          axis);
+void _mx_child_extents_finish (GArray                *extents);
+void _mx_child_extents_paint  (GArray                *extents,
+                               const ClutterActorBox *visible,
+                               MxOrientation          axis);
+
 typedef enum
 {
   MX_DEBUG_LAYOUT      = 1 << 0,
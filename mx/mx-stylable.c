@@ -67,6 +67,45 @@ static GParamSpecPool *style_property_spec_pool = NULL;
 
 static GQuark quark_real_owner         = 0;
 static GQuark quark_style              = 0;
+static GQuark quark_atoms              = 0;
+static GQuark quark_style_key          = 0;
+
+/* the set of interned style keys */
+static GHashTable *style_keys = NULL;
+
+/* Pseudo-class names are interned as small integer atoms, so that a set of
+ * pseudo-classes can be stored as a bitset. The last bit is shared by all
+ * the pseudo-classes that don't fit, and matching against those falls back
+ * to comparing strings.
+ */
+static GHashTable *pseudo_class_atoms   = NULL;
+static guint       n_pseudo_class_atoms = 0;
+
+/* When style changes are deferred, stylables that have been invalidated are
+ * kept here along with their accumulated #MxStyleChangedFlags until the
+ * pre-paint style pass runs.
+ */
+static gboolean    deferred_style_changes = FALSE;
+static GHashTable *dirty_stylables        = NULL;
+static guint       style_pass_id          = 0;
+
+/* The maximum number of times the style pass will run in a frame if
+ * emitting style-changed invalidates more stylables */
+#define MX_STYLE_PASS_MAX_ITERATIONS 4
+
+/* Private flag stored along with pending style changes */
+#define MX_STYLE_CHANGED_PENDING (1 << 16)
+
+/* The interned style class and pseudo-class of a stylable, kept in qdata
+ * and reset whenever either of them change.
+ */
+typedef struct
+{
+  GQuark   style_class;
+  guint64  pseudo_class;
+  guint    style_class_valid : 1;
+  guint    pseudo_class_valid : 1;
+} MxStylableAtoms;
 
 static guint stylable_signals[LAST_SIGNAL] = { 0, };
 
@@ -122,6 +161,8 @@ mx_stylable_base_init (gpointer g_iface)
   quark_real_owner =
     g_quark_from_static_string ("mx-stylable-real-owner-quark");
   quark_style = g_quark_from_static_string ("mx-stylable-style-quark");
+  quark_atoms = g_quark_from_static_string ("mx-stylable-atoms-quark");
+  quark_style_key = g_quark_from_static_string ("mx-stylable-style-key-quark");
 
   style_property_spec_pool = g_param_spec_pool_new (FALSE);
 
@@ -204,79 +245,325 @@ mx_stylable_get_type (void)
 }
 
 static void
-_mx_stylable_prepend_style_string (GString    *string,
-                                   MxStylable *stylable)
+_mx_stylable_atoms_free (MxStylableAtoms *atoms)
 {
-  GType type_id;
-  gchar *style_string;
-  const gchar *type, *id, *class, *pseudo_class;
+  g_slice_free (MxStylableAtoms, atoms);
+}
 
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+static guint64
+_mx_stylable_pseudo_class_atom (const gchar *pseudo_class,
+                                gint         len)
+{
+  gpointer atom;
+  gchar *key;
 
-  id = clutter_actor_get_name ((ClutterActor*) stylable);
+  if (G_UNLIKELY (!pseudo_class_atoms))
+    pseudo_class_atoms = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, NULL);
 
-  class = mx_stylable_get_style_class (stylable);
+  key = g_strndup (pseudo_class, len);
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+  atom = g_hash_table_lookup (pseudo_class_atoms, key);
+  if (!atom)
+    {
+      if (n_pseudo_class_atoms < MX_PSEUDO_CLASS_MAX_ATOMS)
+        {
+          atom = GUINT_TO_POINTER (++n_pseudo_class_atoms);
+          g_hash_table_insert (pseudo_class_atoms, key, atom);
+          key = NULL;
+        }
+      else
+        {
+          g_free (key);
+          return MX_PSEUDO_CLASS_OVERFLOW;
+        }
+    }
+
+  g_free (key);
 
-  style_string = g_strconcat (type,
-                              "#", id ? id : "",
-                              ".", class ? class : "",
-                              ":", pseudo_class ? pseudo_class : "",
-                              ">",
-                              NULL);
-  g_string_prepend (string, style_string);
-  g_free (style_string);
+  return (guint64) 1 << (GPOINTER_TO_UINT (atom) - 1);
 }
 
-gchar *
-_mx_stylable_get_style_string (MxStylable *stylable)
+/* Like _mx_stylable_pseudo_class_atom(), but returns 0 rather than interning
+ * a pseudo-class that doesn't have an atom yet */
+static guint64
+_mx_stylable_pseudo_class_lookup (const gchar *pseudo_class)
 {
-  GType type_id;
-  gchar *cstring;
-  GString *string;
-  const gchar *type, *id, *class, *pseudo_class;
-  ClutterActor *actor;
-  ClutterActor *parent;
+  gpointer atom;
 
-  /* Create a string that contains all the properties of a
-   * Stylable that can be matched against in the CSS.
-   */
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+  if (!pseudo_class_atoms)
+    return 0;
+
+  atom = g_hash_table_lookup (pseudo_class_atoms, pseudo_class);
+  if (!atom)
+    return 0;
+
+  return (guint64) 1 << (GPOINTER_TO_UINT (atom) - 1);
+}
+
+/*
+ * _mx_stylable_pseudo_class_to_mask:
+ * @pseudo_class: a list of pseudo-classes separated by ':', or %NULL
+ * @n_pseudo_classes: (out): return location for the number of pseudo-classes
+ *   in the list, or %NULL
+ *
+ * Interns each pseudo-class in @pseudo_class and returns the set of them as
+ * a bitset. If any pseudo-class could not be given its own atom, the
+ * %MX_PSEUDO_CLASS_OVERFLOW bit is set.
+ */
+guint64
+_mx_stylable_pseudo_class_to_mask (const gchar *pseudo_class,
+                                   gint        *n_pseudo_classes)
+{
+  const gchar *start, *end;
+  guint64 mask = 0;
+  gint n = 0;
+
+  for (start = pseudo_class; start && *start; start = end)
+    {
+      end = strchr (start, ':');
+      if (!end)
+        end = start + strlen (start);
+
+      if (end > start)
+        {
+          mask |= _mx_stylable_pseudo_class_atom (start, end - start);
+          n++;
+        }
+
+      if (*end == ':')
+        end++;
+    }
+
+  if (n_pseudo_classes)
+    *n_pseudo_classes = n;
+
+  return mask;
+}
+
+static MxStylableAtoms *
+_mx_stylable_get_atoms (MxStylable *stylable)
+{
+  MxStylableAtoms *atoms = g_object_get_qdata (G_OBJECT (stylable),
+                                               quark_atoms);
+
+  if (!atoms)
+    {
+      atoms = g_slice_new0 (MxStylableAtoms);
+      g_object_set_qdata_full (G_OBJECT (stylable), quark_atoms, atoms,
+                               (GDestroyNotify) _mx_stylable_atoms_free);
+    }
 
-  actor = CLUTTER_ACTOR (stylable);
+  return atoms;
+}
 
-  id = clutter_actor_get_name (actor);
+static void
+_mx_stylable_invalidate_atoms (MxStylable *stylable)
+{
+  MxStylableAtoms *atoms = g_object_get_qdata (G_OBJECT (stylable),
+                                               quark_atoms);
 
-  class = mx_stylable_get_style_class (stylable);
+  if (atoms)
+    {
+      atoms->style_class_valid = FALSE;
+      atoms->pseudo_class_valid = FALSE;
+    }
+}
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+/*
+ * _mx_stylable_get_style_class_quark:
+ * @stylable: a #MxStylable
+ *
+ * Returns: the interned style class of @stylable, or 0 if it has none
+ */
+GQuark
+_mx_stylable_get_style_class_quark (MxStylable *stylable)
+{
+  MxStylableAtoms *atoms = _mx_stylable_get_atoms (stylable);
 
-  string = g_string_sized_new (512);
+  if (!atoms->style_class_valid)
+    {
+      atoms->style_class =
+        g_quark_from_string (mx_stylable_get_style_class (stylable));
+      atoms->style_class_valid = TRUE;
+    }
 
-  /* Add the actor hierarchy */
-  parent = clutter_actor_get_parent (actor);
+  return atoms->style_class;
+}
 
-  while (parent)
+/*
+ * _mx_stylable_get_style_pseudo_class_mask:
+ * @stylable: a #MxStylable
+ *
+ * Returns: the set of pseudo-classes of @stylable as a bitset of atoms
+ */
+guint64
+_mx_stylable_get_style_pseudo_class_mask (MxStylable *stylable)
+{
+  MxStylableAtoms *atoms = _mx_stylable_get_atoms (stylable);
+
+  if (!atoms->pseudo_class_valid)
     {
-      if (MX_IS_STYLABLE (parent))
-        _mx_stylable_prepend_style_string (string, (MxStylable*) parent);
+      const gchar *pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
 
-      parent = clutter_actor_get_parent (parent);
+      atoms->pseudo_class = _mx_stylable_pseudo_class_to_mask (pseudo_class,
+                                                               NULL);
+      atoms->pseudo_class_valid = TRUE;
     }
 
-  g_string_append_printf (string, "%s#%s.%s:%s",
-                          type,
-                          id ? id : "",
-                          class ? class : "",
-                          pseudo_class ? pseudo_class : "");
+  return atoms->pseudo_class;
+}
 
-  cstring = string->str;
-  g_string_free (string, FALSE);
+static guint
+_mx_style_key_hash (gconstpointer data)
+{
+  const MxStyleKey *key = data;
 
-  return cstring;
+  return key->hash;
+}
+
+static gboolean
+_mx_style_key_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const MxStyleKey *key_a = a;
+  const MxStyleKey *key_b = b;
+
+  /* parent keys are interned, so they can be compared by address */
+  return (key_a->parent == key_b->parent &&
+          key_a->type == key_b->type &&
+          key_a->id == key_b->id &&
+          key_a->style_class == key_b->style_class &&
+          key_a->pseudo_class == key_b->pseudo_class &&
+          key_a->pseudo_class_string == key_b->pseudo_class_string);
+}
+
+MxStyleKey *
+_mx_style_key_ref (MxStyleKey *key)
+{
+  key->ref_count ++;
+
+  return key;
+}
+
+void
+_mx_style_key_unref (MxStyleKey *key)
+{
+  while (key && --key->ref_count == 0)
+    {
+      MxStyleKey *parent = key->parent;
+
+      g_hash_table_remove (style_keys, key);
+      g_slice_free (MxStyleKey, key);
+
+      /* drop the reference the key held on its parent */
+      key = parent;
+    }
+}
+
+/*
+ * _mx_stylable_get_style_key:
+ * @stylable: a #MxStylable
+ *
+ * Gets the key representing everything about @stylable and its stylable
+ * ancestors that can be matched against in CSS. Keys are interned and built
+ * on the key of the nearest stylable ancestor, so computing one only looks
+ * at @stylable itself, and equal keys have the same address.
+ *
+ * The key is kept until _mx_stylable_invalidate_style_key() is called.
+ *
+ * Returns: (transfer none): the style key of @stylable
+ */
+MxStyleKey *
+_mx_stylable_get_style_key (MxStylable *stylable)
+{
+  MxStyleKey template, *key;
+  ClutterActor *parent, *sibling;
+  const gchar *id;
+
+  key = g_object_get_qdata (G_OBJECT (stylable), quark_style_key);
+  if (key)
+    return key;
+
+  if (G_UNLIKELY (!style_keys))
+    style_keys = g_hash_table_new (_mx_style_key_hash, _mx_style_key_equal);
+
+  /* find the key of the nearest stylable ancestor */
+  parent = clutter_actor_get_parent (CLUTTER_ACTOR (stylable));
+  while (parent && !MX_IS_STYLABLE (parent))
+    parent = clutter_actor_get_parent (parent);
+
+  template.parent = parent ?
+    _mx_stylable_get_style_key (MX_STYLABLE (parent)) : NULL;
+  template.type = G_OBJECT_TYPE (stylable);
+
+  /* the name is interned even if no selector uses it yet, as the key
+   * would otherwise not change when a style sheet that does is loaded */
+  id = clutter_actor_get_name (CLUTTER_ACTOR (stylable));
+  template.id = g_quark_from_string (id);
+
+  template.style_class = _mx_stylable_get_style_class_quark (stylable);
+  template.pseudo_class = _mx_stylable_get_style_pseudo_class_mask (stylable);
+
+  /* pseudo-classes that don't have their own atom have to be told apart by
+   * their names */
+  if (template.pseudo_class & MX_PSEUDO_CLASS_OVERFLOW)
+    template.pseudo_class_string =
+      g_quark_from_string (mx_stylable_get_style_pseudo_class (stylable));
+  else
+    template.pseudo_class_string = 0;
+
+  template.hash = GPOINTER_TO_UINT (template.parent) ^
+    (template.type * 31) ^
+    (template.id * 37) ^
+    (template.style_class * 41) ^
+    (guint) (template.pseudo_class ^ (template.pseudo_class >> 32)) ^
+    (template.pseudo_class_string * 43);
+
+  /* siblings usually share their inputs, so try the previous sibling's key
+   * before looking in the table of interned keys */
+  key = NULL;
+  sibling = clutter_actor_get_previous_sibling (CLUTTER_ACTOR (stylable));
+  if (MX_IS_STYLABLE (sibling))
+    {
+      key = g_object_get_qdata (G_OBJECT (sibling), quark_style_key);
+      if (key && !_mx_style_key_equal (key, &template))
+        key = NULL;
+    }
+
+  if (!key)
+    key = g_hash_table_lookup (style_keys, &template);
+
+  if (key)
+    _mx_style_key_ref (key);
+  else
+    {
+      key = g_slice_dup (MxStyleKey, &template);
+      key->ref_count = 1;
+
+      if (key->parent)
+        _mx_style_key_ref (key->parent);
+
+      g_hash_table_insert (style_keys, key, key);
+    }
+
+  g_object_set_qdata_full (G_OBJECT (stylable), quark_style_key, key,
+                           (GDestroyNotify) _mx_style_key_unref);
+
+  return key;
+}
+
+/*
+ * _mx_stylable_invalidate_style_key:
+ * @stylable: a #MxStylable
+ *
+ * Drops the style key of @stylable, so that it will be recalculated the next
+ * time it is needed.
+ */
+void
+_mx_stylable_invalidate_style_key (MxStylable *stylable)
+{
+  g_object_set_qdata (G_OBJECT (stylable), quark_style_key, NULL);
 }
 
 #if 0
@@ -843,6 +1130,9 @@ mx_stylable_set_style_pseudo_class (MxStylable  *stylable,
 
   iface = MX_STYLABLE_GET_IFACE (stylable);
 
+  /* the new pseudo-classes are interned the next time they are matched */
+  _mx_stylable_invalidate_atoms (stylable);
+
   if (G_LIKELY (iface->set_style_pseudo_class))
     iface->set_style_pseudo_class (stylable, pseudo_class);
   else
@@ -868,18 +1158,31 @@ mx_stylable_style_pseudo_class_contains (MxStylable  *stylable,
                                          const gchar *pseudo_class)
 {
   const gchar *old_class, *match;
+  guint64 atom, mask;
 
   g_return_val_if_fail (MX_IS_STYLABLE (stylable), FALSE);
   g_return_val_if_fail (pseudo_class != NULL, FALSE);
 
+  /* Compare the interned pseudo-classes if possible. Queries don't intern
+   * the name, so a name without an atom can only be set if the stylable has
+   * pseudo-classes that overflowed. */
+  mask = _mx_stylable_get_style_pseudo_class_mask (stylable);
+  atom = _mx_stylable_pseudo_class_lookup (pseudo_class);
+  if (atom)
+    return (mask & atom) == atom;
+  else if (!(mask & MX_PSEUDO_CLASS_OVERFLOW))
+    return FALSE;
+
   old_class = mx_stylable_get_style_pseudo_class (stylable);
 
-  if (old_class && pseudo_class && (match = strstr (old_class, pseudo_class)))
+  for (match = old_class ? strstr (old_class, pseudo_class) : NULL;
+       match;
+       match = strstr (match + 1, pseudo_class))
     {
       if ((match == old_class) ||
            (match[-1] == ':'))
         {
-          size_t length = strlen (match);
+          size_t length = strlen (pseudo_class);
           if ((match[length] == ':') ||
               (match[length] == '\0'))
             return TRUE;
@@ -1020,6 +1323,8 @@ mx_stylable_set_style_class (MxStylable  *stylable,
 
   iface = MX_STYLABLE_GET_IFACE (stylable);
 
+  _mx_stylable_invalidate_atoms (stylable);
+
   if (G_LIKELY (iface->set_style_class))
     iface->set_style_class (stylable, style_class);
   else
@@ -1031,6 +1336,8 @@ mx_stylable_set_style_class (MxStylable  *stylable,
 static void
 mx_stylable_property_changed_notify (MxStylable *stylable)
 {
+  _mx_stylable_invalidate_atoms (stylable);
+
   mx_stylable_style_changed (stylable, MX_STYLE_CHANGED_INVALIDATE_CACHE);
 }
 
@@ -1079,6 +1386,9 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
       g_signal_emit (stylable, stylable_signals[STYLE_CHANGED], 0, flags);
     }
 
+  if (!CLUTTER_IS_ACTOR (stylable))
+    return;
+
   /* propagate the style-changed signal to children, since their style may
    * depend on one or more properties of the parent */
   clutter_actor_iter_init (&iter, CLUTTER_ACTOR (stylable));
@@ -1088,6 +1398,95 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
     }
 }
 
+static gboolean
+mx_stylable_has_dirty_ancestor (MxStylable *stylable,
+                                GHashTable *dirty)
+{
+  ClutterActor *parent;
+
+  for (parent = clutter_actor_get_parent (CLUTTER_ACTOR (stylable));
+       parent;
+       parent = clutter_actor_get_parent (parent))
+    {
+      if (g_hash_table_lookup (dirty, parent))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+mx_stylable_style_pass (gpointer data)
+{
+  gint i;
+
+  for (i = 0;
+       i < MX_STYLE_PASS_MAX_ITERATIONS
+       && dirty_stylables
+       && g_hash_table_size (dirty_stylables);
+       i++)
+    {
+      GHashTableIter iter;
+      GHashTable *dirty;
+      gpointer stylable, flags;
+
+      /* emitting style-changed may invalidate more stylables, which will be
+       * picked up in the next iteration */
+      dirty = dirty_stylables;
+      dirty_stylables = NULL;
+
+      /* style-changed is propagated down the tree, so only the top-most
+       * dirty stylables need to be resolved */
+      g_hash_table_iter_init (&iter, dirty);
+      while (g_hash_table_iter_next (&iter, &stylable, &flags))
+        {
+          if (!mx_stylable_has_dirty_ancestor (stylable, dirty))
+            mx_stylable_style_changed_internal (stylable,
+                                                GPOINTER_TO_UINT (flags)
+                                                & ~MX_STYLE_CHANGED_PENDING);
+        }
+
+      g_hash_table_destroy (dirty);
+    }
+
+  if (dirty_stylables && g_hash_table_size (dirty_stylables))
+    return TRUE;
+
+  style_pass_id = 0;
+
+  return FALSE;
+}
+
+static void
+mx_stylable_mark_dirty (MxStylable          *stylable,
+                        MxStyleChangedFlags  flags)
+{
+  gpointer old_flags;
+
+  if (!dirty_stylables)
+    dirty_stylables = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+
+  /* MX_STYLE_CHANGED_PENDING is always set so that the stored flags are
+   * never zero, which would look like a missing entry */
+  old_flags = g_hash_table_lookup (dirty_stylables, stylable);
+  if (old_flags)
+    flags |= GPOINTER_TO_UINT (old_flags);
+  else
+    g_object_ref (stylable);
+
+  g_hash_table_insert (dirty_stylables, stylable,
+                       GUINT_TO_POINTER (flags | MX_STYLE_CHANGED_PENDING));
+
+  if (!style_pass_id)
+    style_pass_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+                                             mx_stylable_style_pass,
+                                             NULL, NULL);
+
+  /* make sure there is a frame for the style pass to run in */
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (stylable));
+}
+
 /**
  * mx_stylable_style_changed:
  * @stylable: an MxStylable
@@ -1100,15 +1499,78 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
  * propagated to it's children, since their style may depend on one or more
  * properties of the parent.
  *
+ * If deferred style changes are enabled (see
+ * mx_stylable_set_deferred_style_changes()), @stylable is only marked as
+ * needing a style update, unless @flags contains %MX_STYLE_CHANGED_FORCE.
  */
 void
 mx_stylable_style_changed (MxStylable *stylable, MxStyleChangedFlags flags)
 {
   g_return_if_fail (MX_IS_STYLABLE (stylable));
 
+  /* nothing will be emitted until the stylable is mapped, at which point it
+   * will be invalidated again; stylables that aren't actors are never
+   * mapped, so they get the change straight away */
+  if (deferred_style_changes
+      && !(flags & MX_STYLE_CHANGED_FORCE)
+      && CLUTTER_IS_ACTOR (stylable)
+      && CLUTTER_ACTOR_IS_MAPPED (CLUTTER_ACTOR (stylable)))
+    {
+      mx_stylable_mark_dirty (stylable, flags);
+      return;
+    }
+
   mx_stylable_style_changed_internal (stylable, flags);
 }
 
+/**
+ * mx_stylable_set_deferred_style_changes:
+ * @deferred: %TRUE to defer style changes
+ *
+ * Sets whether style changes are deferred. When deferred, calls to
+ * mx_stylable_style_changed() (including the ones caused by changing the
+ * style class, pseudo-class, name or parent of a stylable) only mark the
+ * stylable as needing its style updated. A single top-down pass then emits
+ * #MxStylable::style-changed before the next frame is laid out and painted,
+ * so that several changes within a frame cost one update per stylable.
+ *
+ * While style changes are deferred, style properties read between a change
+ * and the next frame reflect the previous state.
+ *
+ * Since: 2.0
+ */
+void
+mx_stylable_set_deferred_style_changes (gboolean deferred)
+{
+  deferred_style_changes = deferred;
+
+  /* apply any pending changes straight away */
+  if (!deferred && style_pass_id)
+    {
+      clutter_threads_remove_repaint_func (style_pass_id);
+      style_pass_id = 0;
+
+      while (dirty_stylables && g_hash_table_size (dirty_stylables))
+        mx_stylable_style_pass (NULL);
+    }
+}
+
+/**
+ * mx_stylable_get_deferred_style_changes:
+ *
+ * Gets whether style changes are deferred. See
+ * mx_stylable_set_deferred_style_changes().
+ *
+ * Returns: %TRUE if style changes are deferred
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_stylable_get_deferred_style_changes (void)
+{
+  return deferred_style_changes;
+}
+
 void
 mx_stylable_connect_change_notifiers (MxStylable *stylable)
 {
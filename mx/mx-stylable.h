@@ -130,6 +130,9 @@ void         mx_stylable_set_style_pseudo_class (MxStylable  *stylable,
                                                  const gchar *pseudo_class);
 
 void mx_stylable_style_changed (MxStylable *stylable, MxStyleChangedFlags flags);
+
+void     mx_stylable_set_deferred_style_changes (gboolean deferred);
+gboolean mx_stylable_get_deferred_style_changes (void);
 void mx_stylable_connect_change_notifiers (MxStylable *stylable);
 void mx_stylable_disconnect_change_notifiers (MxStylable *stylable);
 
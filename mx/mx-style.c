@@ -73,23 +73,37 @@ enum
  */
 #define MX_STYLE_CACHE_SIZE 6
 
-/* A style cache entry is the unique string representing all the properties
+/* Memory used by a cache entry besides its property set: the entry, its
+ * link in the queue and its node in the hash table */
+#define MX_STYLE_CACHE_ENTRY_BYTES (sizeof (MxStyleCacheEntry) + \
+                                    sizeof (GList) + 3 * sizeof (gpointer))
+
+/* A style cache entry is the unique key representing all the properties
  * that can be matched against in CSS, and the matched properties themselves.
  */
 typedef struct
 {
-  gchar      *style_string;
+  MxStyle    *style;
+  MxStyleKey *key;
   gint        age;
-  GHashTable *properties;
+  MxStyleSheetProperties *properties;
+  gint        ref_count;
+
+  GList      *link;  /* link in the cache queue, or NULL once evicted */
+  gsize       size;  /* approximate size in bytes */
 } MxStyleCacheEntry;
 
 /* This is the per-stylable cache store. We need a reference back to the
  * parent style so that we can maintain the count of alive stylables.
+ *
+ * The entry the stylable was last resolved to is kept so that it can be
+ * returned without a look-up while the stylable's key is unchanged, and so
+ * that following siblings with the same key can share it.
  */
 typedef struct
 {
-  GList   *styles;
-  gchar   *string;
+  GList             *styles;
+  MxStyleCacheEntry *entry;
 } MxStylableCache;
 
 typedef struct {
@@ -106,9 +120,15 @@ struct _MxStylePrivate
   GHashTable *node_hash;
 
   gint        alive_stylables;
-  GQueue     *cached_matches;
+  GQueue     *cached_matches;   /* most recently used first */
   GHashTable *cache_hash;
   gint        age;
+
+  gsize       cache_budget;
+  gsize       cache_size;
+  guint       cache_hits;
+  guint       cache_misses;
+  guint       cache_evictions;
 };
 
 static guint style_signals[LAST_SIGNAL] = { 0, };
@@ -129,6 +149,34 @@ g_style_cache_quark (void)
   return g_quark_from_static_string ("mx-style-cache-quark");
 }
 
+static gboolean
+mx_style_real_load_from_compiled (MxStyle      *style,
+                                  const gchar  *id,
+                                  GBytes       *bytes,
+                                  const gchar  *source_checksum,
+                                  GError      **error)
+{
+  MxStylePrivate *priv = style->priv;
+
+  if (!priv->stylesheet)
+    priv->stylesheet = mx_style_sheet_new ();
+
+  if (!mx_style_sheet_add_from_compiled (priv->stylesheet, id, bytes,
+                                         source_checksum, NULL))
+    {
+      g_set_error (error, MX_STYLE_ERROR, MX_STYLE_ERROR_PARSE_ERROR,
+                   "Could not load compiled style sheet '%s'", id);
+      return FALSE;
+    }
+
+  /* Increment the age so we know if a style cache entry is valid */
+  priv->age ++;
+
+  g_signal_emit (style, style_signals[CHANGED], 0, NULL);
+
+  return TRUE;
+}
+
 static gboolean
 mx_style_real_load_from_file (MxStyle      *style,
                               const gchar  *filename,
@@ -154,6 +202,32 @@ mx_style_real_load_from_file (MxStyle      *style,
       return FALSE;
     }
 
+  /* compiled style sheets are used straight from the mapped file */
+  if (!data)
+    {
+      GMappedFile *file = g_mapped_file_new (filename, FALSE, NULL);
+
+      if (file &&
+          mx_style_sheet_data_is_compiled (g_mapped_file_get_contents (file),
+                                           g_mapped_file_get_length (file)))
+        {
+          GBytes *bytes;
+
+          bytes = g_bytes_new_with_free_func (g_mapped_file_get_contents (file),
+                                              g_mapped_file_get_length (file),
+                                              (GDestroyNotify) g_mapped_file_unref,
+                                              file);
+          result = mx_style_real_load_from_compiled (style, filename, bytes,
+                                                     NULL, error);
+          g_bytes_unref (bytes);
+
+          return result;
+        }
+
+      if (file)
+        g_mapped_file_unref (file);
+    }
+
   if (!priv->stylesheet)
     priv->stylesheet = mx_style_sheet_new ();
 
@@ -187,7 +261,8 @@ mx_style_real_load_from_file (MxStyle      *style,
  * @filename: filename of the style sheet to load
  * @error: a #GError or #NULL
  *
- * Load style information from the specified file.
+ * Load style information from the specified file. The file may be either
+ * CSS or a style sheet compiled with mx-css-compiler.
  *
  * returns: TRUE if the style information was loaded successfully. Returns
  * FALSE on error.
@@ -245,8 +320,12 @@ mx_style_load_from_resource (MxStyle      *style,
 
   id = g_strconcat ("resource://", path, NULL);
 
-  mx_style_real_load_from_file (style, id, g_bytes_get_data (bytes, NULL),
-                                error, 0);
+  if (mx_style_sheet_data_is_compiled (g_bytes_get_data (bytes, NULL),
+                                      g_bytes_get_size (bytes)))
+    mx_style_real_load_from_compiled (style, id, bytes, NULL, error);
+  else
+    mx_style_real_load_from_file (style, id, g_bytes_get_data (bytes, NULL),
+                                  error, 0);
 
   /* add the resource to the default texture cache, so that it can open images
    * from the resource file */
@@ -259,6 +338,72 @@ mx_style_load_from_resource (MxStyle      *style,
   return TRUE;
 }
 
+/* The default style sheet is also compiled at build time and installed as a
+ * separate resource. It is used in place of parsing the embedded CSS when it
+ * was compiled from exactly the same source.
+ */
+static gboolean
+mx_style_load_compiled_default (MxStyle     *style,
+                                GResource   *resource,
+                                const gchar *path)
+{
+  static GResource *compiled_resource = NULL;
+  static gboolean compiled_resource_loaded = FALSE;
+  GBytes *source, *bytes;
+  gchar *compiled_path, *id, *checksum;
+  gboolean result;
+  gsize length;
+  gconstpointer data;
+
+  if (!compiled_resource_loaded)
+    {
+      gchar *filename;
+
+      compiled_resource_loaded = TRUE;
+      filename = g_build_filename (PACKAGE_DATA_DIR, "mx",
+                                   "mx-compiled-style.gresource", NULL);
+      compiled_resource = g_resource_load (filename, NULL);
+      g_free (filename);
+    }
+
+  if (!compiled_resource)
+    return FALSE;
+
+  compiled_path = g_strconcat (path, "c", NULL);
+  bytes = g_resource_lookup_data (compiled_resource, compiled_path,
+                                  G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  g_free (compiled_path);
+
+  if (!bytes)
+    return FALSE;
+
+  source = g_resource_lookup_data (resource, path,
+                                   G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  if (!source)
+    {
+      g_bytes_unref (bytes);
+      return FALSE;
+    }
+
+  data = g_bytes_get_data (source, &length);
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, length);
+
+  /* urls are resolved relative to the CSS source */
+  id = g_strconcat ("resource://", path, NULL);
+  result = mx_style_real_load_from_compiled (style, id, bytes, checksum, NULL);
+  if (result)
+    mx_texture_cache_add_resource (mx_texture_cache_get_default (), resource);
+  else
+    MX_NOTE (CSS, "Compiled default style is out of date, parsing '%s'", id);
+
+  g_free (id);
+  g_free (checksum);
+  g_bytes_unref (source);
+  g_bytes_unref (bytes);
+
+  return result;
+}
+
 static void
 mx_style_load (MxStyle *style)
 {
@@ -291,6 +436,10 @@ mx_style_load (MxStyle *style)
 
   resource = mx_get_resource ();
 
+  if (mx_style_load_compiled_default (style, resource,
+                                      "/org/clutter-project/Mx/style/default.css"))
+    return;
+
   mx_style_load_from_resource (style, resource,
                                "/org/clutter-project/Mx/style/default.css",
                                &error);
@@ -303,27 +452,124 @@ mx_style_load (MxStyle *style)
 }
 
 static MxStyleCacheEntry *
-mx_style_cache_entry_new (const gchar *style_string,
-                          GHashTable  *properties,
-                          gint         age)
+mx_style_cache_entry_new (MxStyle                *style,
+                          MxStyleKey             *key,
+                          MxStyleSheetProperties *properties,
+                          gint                    age)
 {
   MxStyleCacheEntry *entry = g_slice_new (MxStyleCacheEntry);
 
-  entry->style_string = g_strdup (style_string);
+  entry->style = style;
+  entry->key = _mx_style_key_ref (key);
   entry->properties = properties;
   entry->age = age;
+  entry->ref_count = 1;
+  entry->link = NULL;
+  entry->size = MX_STYLE_CACHE_ENTRY_BYTES +
+    mx_style_sheet_properties_size (properties);
+
+  return entry;
+}
+
+static MxStyleCacheEntry *
+mx_style_cache_entry_ref (MxStyleCacheEntry *entry)
+{
+  entry->ref_count ++;
 
   return entry;
 }
 
 static void
-mx_style_cache_entry_free (MxStyleCacheEntry *entry,
-                           gboolean           free_struct)
+mx_style_cache_entry_unref (MxStyleCacheEntry *entry)
+{
+  if (--entry->ref_count > 0)
+    return;
+
+  _mx_style_key_unref (entry->key);
+  mx_style_sheet_properties_unref (entry->properties);
+  g_slice_free (MxStyleCacheEntry, entry);
+}
+
+static void
+mx_style_stylable_cache_set_entry (MxStylableCache   *cache,
+                                   MxStyleCacheEntry *entry)
+{
+  if (cache->entry == entry)
+    return;
+
+  if (cache->entry)
+    mx_style_cache_entry_unref (cache->entry);
+
+  cache->entry = entry ? mx_style_cache_entry_ref (entry) : NULL;
+}
+
+static gboolean
+mx_style_cache_entry_is_valid (MxStyleCacheEntry *entry,
+                               MxStyle           *style,
+                               MxStyleKey        *key)
+{
+  return (entry &&
+          entry->style == style &&
+          entry->key == key &&
+          entry->age == style->priv->age);
+}
+
+static void
+mx_style_cache_add (MxStyle           *style,
+                    MxStyleCacheEntry *entry)
+{
+  MxStylePrivate *priv = style->priv;
+
+  g_queue_push_head (priv->cached_matches, entry);
+  entry->link = priv->cached_matches->head;
+  g_hash_table_insert (priv->cache_hash, entry->key, entry->link);
+  priv->cache_size += entry->size;
+}
+
+static void
+mx_style_cache_remove (MxStyle           *style,
+                       MxStyleCacheEntry *entry)
+{
+  MxStylePrivate *priv = style->priv;
+
+  g_hash_table_remove (priv->cache_hash, entry->key);
+  g_queue_delete_link (priv->cached_matches, entry->link);
+  entry->link = NULL;
+  priv->cache_size -= entry->size;
+
+  /* stylables may still hold a reference to the entry */
+  mx_style_cache_entry_unref (entry);
+}
+
+/* Marks @entry as the most recently used */
+static void
+mx_style_cache_promote (MxStyle           *style,
+                        MxStyleCacheEntry *entry)
+{
+  MxStylePrivate *priv = style->priv;
+
+  if (!entry->link || entry->link == priv->cached_matches->head)
+    return;
+
+  g_queue_unlink (priv->cached_matches, entry->link);
+  g_queue_push_head_link (priv->cached_matches, entry->link);
+}
+
+/* Evicts the least recently used entries until the cache fits within both
+ * the per-stylable bound and the byte budget */
+static void
+mx_style_cache_shrink (MxStyle *style)
 {
-  g_free (entry->style_string);
-  g_hash_table_unref (entry->properties);
-  if (free_struct)
-    g_slice_free (MxStyleCacheEntry, entry);
+  MxStylePrivate *priv = style->priv;
+
+  while (g_queue_get_length (priv->cached_matches) >
+         (priv->alive_stylables * MX_STYLE_CACHE_SIZE) ||
+         (priv->cache_budget && priv->cache_size > priv->cache_budget &&
+          g_queue_get_length (priv->cached_matches) > 1))
+    {
+      mx_style_cache_remove (style, g_queue_peek_tail (priv->cached_matches));
+      priv->cache_evictions ++;
+    }
 }
 
 static void
@@ -334,7 +580,12 @@ mx_style_finalize (GObject *gobject)
   g_hash_table_unref (priv->cache_hash);
 
   while (g_queue_get_length (priv->cached_matches))
-    mx_style_cache_entry_free (g_queue_pop_head (priv->cached_matches), TRUE);
+    {
+      MxStyleCacheEntry *entry = g_queue_pop_head (priv->cached_matches);
+
+      entry->link = NULL;
+      mx_style_cache_entry_unref (entry);
+    }
   g_queue_free (priv->cached_matches);
 
   G_OBJECT_CLASS (mx_style_parent_class)->finalize (gobject);
@@ -375,7 +626,7 @@ mx_style_init (MxStyle *style)
   style->priv = priv = MX_STYLE_GET_PRIVATE (style);
 
   priv->cached_matches = g_queue_new ();
-  priv->cache_hash = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->cache_hash = g_hash_table_new (NULL, NULL);
 
   mx_style_load (style);
 }
@@ -415,7 +666,10 @@ mx_style_get_default (void)
 }
 
 
-static void
+/* Converts @css_value to the type of @pspec, returning %FALSE if the result
+ * depends on more than the value type and so must not be cached.
+ */
+static gboolean
 mx_style_transform_css_value (MxStyleSheetValue *css_value,
                               MxStylable        *stylable,
                               GParamSpec        *pspec,
@@ -429,12 +683,19 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
         {
           gint number = atoi (css_value->string);
 
-          if (g_str_equal (g_param_spec_get_name (pspec), "font-size") &&
-              g_str_has_suffix (css_value->string, "pt"))
+          /* point sizes depend on the property and the screen resolution,
+           * which may change */
+          if (g_str_has_suffix (css_value->string, "pt"))
             {
-              ClutterBackend *backend = clutter_get_default_backend ();
-              gdouble res = clutter_backend_get_resolution (backend);
-              number = number * res / 72.0;
+              if (g_str_equal (g_param_spec_get_name (pspec), "font-size"))
+                {
+                  ClutterBackend *backend = clutter_get_default_backend ();
+                  gdouble res = clutter_backend_get_resolution (backend);
+                  number = number * res / 72.0;
+                }
+
+              g_value_set_int (value, number);
+              return FALSE;
             }
 
           g_value_set_int (value, number);
@@ -484,7 +745,7 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
       if (!g_strcmp0 (css_value->string, "none"))
         {
           g_value_set_string (value, NULL);
-          return;
+          return TRUE;
         }
 
 
@@ -524,6 +785,9 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
                      G_OBJECT_CLASS_NAME(G_OBJECT_GET_CLASS (stylable)),
                      css_value->string,
                      g_type_name (pspec->value_type));
+          g_type_class_unref (class);
+
+          return FALSE;
         }
       else
         {
@@ -549,9 +813,45 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
                      G_OBJECT_CLASS_NAME(G_OBJECT_GET_CLASS (stylable)),
                      css_value->string,
                      g_type_name (pspec->value_type));
+          g_value_unset (&strval);
+
+          return FALSE;
         }
       g_value_unset (&strval);
     }
+
+  return TRUE;
+}
+
+static void
+mx_style_get_css_value (MxStyleSheetValue *css_value,
+                        MxStylable        *stylable,
+                        GParamSpec        *pspec,
+                        GValue            *value)
+{
+  /* values only need to be parsed the first time they are requested for a
+   * given type, after that they are copied from the cache */
+  if (css_value->cached_type == pspec->value_type)
+    {
+      g_value_init (value, pspec->value_type);
+      g_value_copy (&css_value->cached_value, value);
+      return;
+    }
+
+  if (!mx_style_transform_css_value (css_value, stylable, pspec, value))
+    return;
+
+  /* without a string the value is the default of @pspec, which another
+   * property of the same type may not share */
+  if (!css_value->string)
+    return;
+
+  if (css_value->cached_type != G_TYPE_INVALID)
+    g_value_unset (&css_value->cached_value);
+
+  g_value_init (&css_value->cached_value, pspec->value_type);
+  g_value_copy (value, &css_value->cached_value);
+  css_value->cached_type = pspec->value_type;
 }
 
 
@@ -583,6 +883,9 @@ mx_style_cache_weak_ref_cb (gpointer  data,
     cache->styles = g_list_delete_link (cache->styles, style_link);
   else
     g_warning (G_STRLOC ": Weak unref on a stylable with no style reference");
+
+  if (cache->entry && cache->entry->style == (MxStyle *) old_object)
+    mx_style_stylable_cache_set_entry (cache, NULL);
 }
 
 static void
@@ -607,30 +910,26 @@ mx_style_stylable_cache_free (MxStylableCache *cache)
       cache->styles = g_list_delete_link (cache->styles, cache->styles);
     }
 
-  g_free (cache->string);
+  mx_style_stylable_cache_set_entry (cache, NULL);
+
   g_slice_free (MxStylableCache, cache);
 }
 
 void
 _mx_style_invalidate_cache (MxStylable *stylable)
 {
-  GObject *object = G_OBJECT (stylable);
-  MxStylableCache *cache = g_object_get_qdata (object, MX_STYLE_CACHE);
-
-  /* Reset the cache string */
-  if (cache)
-    {
-      g_free (cache->string);
-      cache->string = NULL;
-    }
+  /* Reset the style key, it will be rebuilt on the next look-up */
+  _mx_stylable_invalidate_style_key (stylable);
 }
 
-static GHashTable *
+static MxStyleSheetProperties *
 mx_style_get_style_sheet_properties (MxStyle    *style,
                                      MxStylable *stylable)
 {
   GList *entry_link;
   MxStylableCache *cache;
+  ClutterActor *sibling;
+  MxStyleKey *key;
 
   MxStyleCacheEntry *entry = NULL;
   MxStylePrivate *priv = style->priv;
@@ -640,12 +939,6 @@ mx_style_get_style_sheet_properties (MxStyle    *style,
 
   if (cache)
     {
-      /* Make sure that the style string is up-to-date. We set this
-       * to NULL when invalidating the stylable's cache.
-       */
-      if (!cache->string)
-        cache->string = _mx_stylable_get_style_string (stylable);
-
       /* Check that the stylable has a reference to us. If the stylable
        * cache struct was created by another style, we need to add ourselves
        * to the list.
@@ -664,7 +957,6 @@ mx_style_get_style_sheet_properties (MxStyle    *style,
        * properties, initialise a cache.
        */
       cache = g_slice_new0 (MxStylableCache);
-      cache->string = _mx_stylable_get_style_string (stylable);
       cache->styles = g_list_prepend (NULL, style);
 
       /* Increase the alive-stylables count and add a weak reference so we
@@ -681,27 +973,58 @@ mx_style_get_style_sheet_properties (MxStyle    *style,
                                (GDestroyNotify)mx_style_stylable_cache_free);
     }
 
-  if ((entry_link = g_hash_table_lookup (priv->cache_hash, cache->string)))
+  /* The style key is kept until the stylable's cache is invalidated, and
+   * is only rebuilt from the stylable itself and its parent's key.
+   */
+  key = _mx_stylable_get_style_key (stylable);
+
+  /* If the key hasn't changed since the last look-up, the stylable's entry
+   * is still correct.
+   */
+  if (mx_style_cache_entry_is_valid (cache->entry, style, key))
+    {
+      priv->cache_hits ++;
+      mx_style_cache_promote (style, cache->entry);
+      return mx_style_sheet_properties_ref (cache->entry->properties);
+    }
+
+  /* Style sharing: siblings in lists and grids usually have the same key,
+   * so try to share the computed style of the previous sibling.
+   */
+  sibling = clutter_actor_get_previous_sibling (CLUTTER_ACTOR (stylable));
+  if (MX_IS_STYLABLE (sibling))
+    {
+      MxStylableCache *sibling_cache =
+        g_object_get_qdata (G_OBJECT (sibling), MX_STYLE_CACHE);
+
+      if (sibling_cache &&
+          mx_style_cache_entry_is_valid (sibling_cache->entry, style, key))
+        {
+          priv->cache_hits ++;
+          mx_style_cache_promote (style, sibling_cache->entry);
+          mx_style_stylable_cache_set_entry (cache, sibling_cache->entry);
+          return mx_style_sheet_properties_ref (cache->entry->properties);
+        }
+    }
+
+  if ((entry_link = g_hash_table_lookup (priv->cache_hash, key)))
     {
       entry = entry_link->data;
 
       /* If the entry is old, remove it from the cache */
       if (entry->age != priv->age)
         {
-          g_hash_table_remove (priv->cache_hash, entry->style_string);
-          g_queue_delete_link (priv->cached_matches, entry_link);
-          mx_style_cache_entry_free (entry, TRUE);
+          mx_style_cache_remove (style, entry);
           entry = NULL;
         }
-
-      /* As the cache is rarely emptied, FIFO is good enough for the
-       * eviction strategy (preferring speedy retrieval to efficient
-       * eviction)
-       *
-       * If we did want LRU though, for example, here would be the place
-       * to do it. You could remove the link from the queue using
-       * g_queue_unlink() and reinsert it with g_queue_push_head_link()
-       */
+      else
+        {
+          /* Move the entry to the head of the queue, so that the least
+           * recently used entries are evicted first
+           */
+          priv->cache_hits ++;
+          mx_style_cache_promote (style, entry);
+        }
     }
 
   /* No cached style properties were found, or the entry found is out of date,
@@ -710,32 +1033,30 @@ mx_style_get_style_sheet_properties (MxStyle    *style,
   if (!entry || (entry->age != priv->age))
     {
       /* Look up style properties */
-      GHashTable *properties = mx_style_sheet_get_properties (priv->stylesheet,
-                                                              stylable);
+      MxStyleSheetProperties *properties =
+        mx_style_sheet_get_properties (priv->stylesheet, stylable);
+
+      priv->cache_misses ++;
 
       /* Append this to the style cache */
-      entry = mx_style_cache_entry_new (cache->string, properties, priv->age);
-      g_queue_push_head (priv->cached_matches, entry);
-      g_hash_table_insert (priv->cache_hash, entry->style_string,
-                           priv->cached_matches->head);
+      entry = mx_style_cache_entry_new (style, key, properties, priv->age);
+      mx_style_cache_add (style, entry);
 
       /* Shrink the cache if its grown too large */
-      while (g_queue_get_length (priv->cached_matches) >
-             (priv->alive_stylables * MX_STYLE_CACHE_SIZE))
-        {
-          MxStyleCacheEntry *old_entry =
-            g_queue_pop_tail (priv->cached_matches);
-
-          g_hash_table_remove (priv->cache_hash, old_entry->style_string);
-          mx_style_cache_entry_free (old_entry, TRUE);
-        }
+      mx_style_cache_shrink (style);
 
-      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, (Max-size: %d)",
+      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, (Max-size: %d), "
+               "%" G_GSIZE_FORMAT " bytes (Budget: %" G_GSIZE_FORMAT "), "
+               "hits: %u, misses: %u, evictions: %u",
                style, g_queue_get_length (priv->cached_matches),
-               priv->alive_stylables * MX_STYLE_CACHE_SIZE);
+               priv->alive_stylables * MX_STYLE_CACHE_SIZE,
+               priv->cache_size, priv->cache_budget,
+               priv->cache_hits, priv->cache_misses, priv->cache_evictions);
     }
 
-  return entry->properties ? g_hash_table_ref (entry->properties) : NULL;
+  mx_style_stylable_cache_set_entry (cache, entry);
+
+  return mx_style_sheet_properties_ref (entry->properties);
 }
 
 /**
@@ -767,21 +1088,21 @@ mx_style_get_property (MxStyle    *style,
   if (priv->stylesheet)
     {
       MxStyleSheetValue *css_value;
-      GHashTable *properties;
+      MxStyleSheetProperties *properties;
 
       properties = mx_style_get_style_sheet_properties (style, stylable);
 
-      css_value = g_hash_table_lookup (properties,
-                                       mx_style_normalize_property_name (pspec->name));
+      css_value = mx_style_sheet_properties_lookup (properties,
+                                                    mx_style_normalize_property_name (pspec->name));
 
       if (!css_value)
         {
           mx_stylable_get_default_value (stylable, pspec->name, value);
         }
       else
-        mx_style_transform_css_value (css_value, stylable, pspec, value);
+        mx_style_get_css_value (css_value, stylable, pspec, value);
 
-      g_hash_table_unref (properties);
+      mx_style_sheet_properties_unref (properties);
     }
 }
 
@@ -816,7 +1137,7 @@ mx_style_get_valist (MxStyle     *style,
   /* look up the property in the css */
   if (priv->stylesheet)
     {
-      GHashTable *properties;
+      MxStyleSheetProperties *properties;
 
       properties = mx_style_get_style_sheet_properties (style, stylable);
 
@@ -836,15 +1157,15 @@ mx_style_get_valist (MxStyle     *style,
               break;
             }
 
-          css_value = g_hash_table_lookup (properties,
-                                           mx_style_normalize_property_name (name));
+          css_value = mx_style_sheet_properties_lookup (properties,
+                                                        mx_style_normalize_property_name (name));
 
           if (!css_value)
             {
               mx_stylable_get_default_value (stylable, pspec->name, &value);
             }
           else
-            mx_style_transform_css_value (css_value, stylable, pspec, &value);
+            mx_style_get_css_value (css_value, stylable, pspec, &value);
 
           G_VALUE_LCOPY (&value, va_args, 0, &error);
 
@@ -862,7 +1183,7 @@ mx_style_get_valist (MxStyle     *style,
         }
       values_set = TRUE;
 
-      g_hash_table_unref (properties);
+      mx_style_sheet_properties_unref (properties);
     }
 
   if (!values_set)
@@ -918,3 +1239,94 @@ mx_style_get (MxStyle     *style,
   va_end (va_args);
 }
 
+
+/**
+ * mx_style_set_cache_budget:
+ * @style: a #MxStyle
+ * @budget: the maximum size of the match cache in bytes, or 0 for no limit
+ *
+ * Sets an approximate limit on the memory used by the cache of matched style
+ * properties. When the limit is exceeded, the least recently used entries
+ * are evicted. Regardless of the budget, the cache never holds more than a
+ * few entries per stylable.
+ *
+ * The budget only covers the entries held by the cache. A stylable keeps
+ * the entry it was last matched to, so an evicted entry that is still in
+ * use is freed when its last stylable is matched again or destroyed, and no
+ * longer counts against the budget in the meantime. Property sets shared
+ * between entries are counted for each of them.
+ *
+ * Since: 2.0
+ */
+void
+mx_style_set_cache_budget (MxStyle *style,
+                           gsize    budget)
+{
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  style->priv->cache_budget = budget;
+
+  mx_style_cache_shrink (style);
+}
+
+/**
+ * mx_style_get_cache_budget:
+ * @style: a #MxStyle
+ *
+ * Gets the limit on the memory used by the style match cache. See
+ * mx_style_set_cache_budget().
+ *
+ * Returns: the cache budget in bytes, or 0 if there is no limit
+ *
+ * Since: 2.0
+ */
+gsize
+mx_style_get_cache_budget (MxStyle *style)
+{
+  g_return_val_if_fail (MX_IS_STYLE (style), 0);
+
+  return style->priv->cache_budget;
+}
+
+/**
+ * mx_style_get_cache_stats:
+ * @style: a #MxStyle
+ * @n_entries: (out) (allow-none): return location for the number of entries
+ * @size: (out) (allow-none): return location for the approximate size of the
+ *   cache in bytes
+ * @hits: (out) (allow-none): return location for the number of look-ups
+ *   answered from the cache
+ * @misses: (out) (allow-none): return location for the number of look-ups
+ *   that had to be matched against the style sheet
+ * @evictions: (out) (allow-none): return location for the number of entries
+ *   evicted to keep the cache within its bounds
+ *
+ * Retrieves statistics about the cache of matched style properties.
+ *
+ * Since: 2.0
+ */
+void
+mx_style_get_cache_stats (MxStyle *style,
+                          guint   *n_entries,
+                          gsize   *size,
+                          guint   *hits,
+                          guint   *misses,
+                          guint   *evictions)
+{
+  MxStylePrivate *priv;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  priv = style->priv;
+
+  if (n_entries)
+    *n_entries = g_queue_get_length (priv->cached_matches);
+  if (size)
+    *size = priv->cache_size;
+  if (hits)
+    *hits = priv->cache_hits;
+  if (misses)
+    *misses = priv->cache_misses;
+  if (evictions)
+    *evictions = priv->cache_evictions;
+}
@@ -113,6 +113,16 @@ void     mx_style_get_valist     (MxStyle      *style,
                                   const gchar  *first_property_name,
                                   va_list       va_args);
 
+void     mx_style_set_cache_budget (MxStyle *style,
+                                    gsize    budget);
+gsize    mx_style_get_cache_budget (MxStyle *style);
+void     mx_style_get_cache_stats  (MxStyle *style,
+                                    guint   *n_entries,
+                                    gsize   *size,
+                                    guint   *hits,
+                                    guint   *misses,
+                                    guint   *evictions);
+
 G_END_DECLS
 
 #endif /* __MX_STYLE_H__ */
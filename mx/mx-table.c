@@ -88,8 +88,19 @@ typedef struct
   gfloat pref_size;
   gfloat final_size;
 
+  gfloat position;
+
 } DimensionData;
 
+typedef struct
+{
+  ClutterActor *actor;
+
+  /* the top-left cell of the actor */
+  gint row;
+  gint col;
+} CellData;
+
 struct _MxTablePrivate
 {
   guint   ignore_css_col_spacing : 1;
@@ -109,6 +120,28 @@ struct _MxTablePrivate
   GArray *columns;
   GArray *rows;
 
+  /* the columns and rows before the space is distributed */
+  GArray *measured_columns;
+  GArray *measured_rows;
+  gint    measured_visible_cols;
+  gint    measured_visible_rows;
+  gint    columns_for_width;
+  gint    rows_for_width;
+  gint    rows_for_height;
+  guint   columns_measured : 1;
+  guint   columns_valid : 1;
+  guint   rows_measured : 1;
+  guint   rows_valid : 1;
+
+  /* which child occupies each cell, as of the last allocation */
+  CellData *cells;
+  gint      cells_rows;
+  gint      cells_cols;
+  gfloat   *row_ends;
+  gfloat   *col_ends;
+  guint     cells_valid : 1;
+  guint     cells_overlap : 1;
+
   MxFocusable *last_focus;
 };
 
@@ -130,9 +163,21 @@ mx_table_find_actor_at (MxTable *table,
                         int      row,
                         int      column)
 {
+  MxTablePrivate *priv = table->priv;
   ClutterActorIter iter;
   ClutterActor *actor_child;
 
+  /* when no children overlap, the cell grid has the same answer as looking
+   * through all the children */
+  if (priv->cells_valid && !priv->cells_overlap)
+    {
+      if (row < 0 || row >= priv->cells_rows ||
+          column < 0 || column >= priv->cells_cols)
+        return NULL;
+
+      return priv->cells[row * priv->cells_cols + column].actor;
+    }
+
   clutter_actor_iter_init (&iter, CLUTTER_ACTOR (table));
   while (clutter_actor_iter_next (&iter, &actor_child))
     {
@@ -439,6 +484,8 @@ mx_table_actor_added (ClutterContainer *container,
   /* default position of the actor is 0, 0 */
   _mx_table_update_row_col (MX_TABLE (container), meta);
 
+  MX_TABLE (container)->priv->cells_valid = FALSE;
+
   clutter_actor_queue_relayout (CLUTTER_ACTOR (container));
 }
 
@@ -455,6 +502,8 @@ mx_table_actor_removed (ClutterContainer *container,
   if ((ClutterActor *)priv->last_focus == actor)
     priv->last_focus = NULL;
 
+  priv->cells_valid = FALSE;
+
   /* update row/column count */
   rows = 0;
   cols = 0;
@@ -574,18 +623,21 @@ mx_table_finalize (GObject *gobject)
 
   g_array_free (priv->columns, TRUE);
   g_array_free (priv->rows, TRUE);
+  g_array_free (priv->measured_columns, TRUE);
+  g_array_free (priv->measured_rows, TRUE);
+  g_free (priv->cells);
+  g_free (priv->row_ends);
+  g_free (priv->col_ends);
 
   G_OBJECT_CLASS (mx_table_parent_class)->finalize (gobject);
 }
 
 static void
-mx_table_calculate_col_widths (MxTable *table,
-                               gint     for_width)
+mx_table_measure_columns (MxTable *table)
 {
   gint i;
   MxTablePrivate *priv = table->priv;
   DimensionData *columns;
-  MxPadding padding;
   ClutterActorIter iter;
   ClutterActor *child;
 
@@ -593,12 +645,6 @@ mx_table_calculate_col_widths (MxTable *table,
   g_array_set_size (priv->columns, priv->n_cols);
   columns = &g_array_index (priv->columns, DimensionData, 0);
 
-
-  /* take off the padding values to calculate the allocatable width */
-  mx_widget_get_padding (MX_WIDGET (table), &padding);
-
-  for_width -= (int)(padding.left + padding.right);
-
   /* Reset all the visible attributes for the columns */
   priv->visible_cols = 0;
   for (i = 0; i < priv->n_cols; i++)
@@ -748,7 +794,23 @@ mx_table_calculate_col_widths (MxTable *table,
 
 
     }
+}
+
+static void
+mx_table_distribute_columns (MxTable *table,
+                             gint     for_width)
+{
+  gint i;
+  MxTablePrivate *priv = table->priv;
+  DimensionData *columns;
+  MxPadding padding;
 
+  columns = &g_array_index (priv->columns, DimensionData, 0);
+
+  /* take off the padding values to calculate the allocatable width */
+  mx_widget_get_padding (MX_WIDGET (table), &padding);
+
+  for_width -= (int)(padding.left + padding.right);
 
   /* calculate final widths */
   if (for_width >= 0)
@@ -862,21 +924,14 @@ mx_table_calculate_col_widths (MxTable *table,
 }
 
 static void
-mx_table_calculate_row_heights (MxTable *table,
-                                gint     for_height)
+mx_table_measure_rows (MxTable *table)
 {
   MxTablePrivate *priv = MX_TABLE (table)->priv;
   gint i;
   DimensionData *rows, *columns;
-  MxPadding padding;
   ClutterActorIter iter;
   ClutterActor *child;
 
-  mx_widget_get_padding (MX_WIDGET (table), &padding);
-
-  /* take padding off available height */
-  for_height -= (int)(padding.top + padding.bottom);
-
   g_array_set_size (priv->rows, 0);
   g_array_set_size (priv->rows, priv->n_rows);
   rows = &g_array_index (priv->rows, DimensionData, 0);
@@ -1044,7 +1099,23 @@ mx_table_calculate_row_heights (MxTable *table,
         }
 
     }
+}
 
+static void
+mx_table_distribute_rows (MxTable *table,
+                          gint     for_height)
+{
+  MxTablePrivate *priv = MX_TABLE (table)->priv;
+  gint i;
+  DimensionData *rows;
+  MxPadding padding;
+
+  rows = &g_array_index (priv->rows, DimensionData, 0);
+
+  mx_widget_get_padding (MX_WIDGET (table), &padding);
+
+  /* take padding off available height */
+  for_height -= (int)(padding.top + padding.bottom);
 
   /* calculate final heights */
   if (for_height >= 0)
@@ -1157,6 +1228,80 @@ mx_table_calculate_row_heights (MxTable *table,
 
 }
 
+/* Measuring the children is the expensive part of solving the columns and
+ * rows, so the measured sizes are kept until a relayout is queued, which
+ * happens whenever a child's size request, visibility or child properties
+ * change. The column widths don't depend on the width available and the
+ * row heights only depend on it through the column widths, so only
+ * distributing the space runs again for another size. */
+static void
+mx_table_calculate_col_widths (MxTable *table,
+                               gint     for_width)
+{
+  MxTablePrivate *priv = table->priv;
+
+  if (priv->columns_valid && priv->columns_for_width == for_width)
+    return;
+
+  if (!priv->columns_measured)
+    {
+      mx_table_measure_columns (table);
+
+      g_array_set_size (priv->measured_columns, 0);
+      g_array_append_vals (priv->measured_columns, priv->columns->data,
+                           priv->columns->len);
+      priv->measured_visible_cols = priv->visible_cols;
+      priv->columns_measured = TRUE;
+    }
+  else
+    {
+      g_array_set_size (priv->columns, 0);
+      g_array_append_vals (priv->columns, priv->measured_columns->data,
+                           priv->measured_columns->len);
+      priv->visible_cols = priv->measured_visible_cols;
+    }
+
+  mx_table_distribute_columns (table, for_width);
+
+  priv->columns_for_width = for_width;
+  priv->columns_valid = TRUE;
+}
+
+/* must be called after the columns have been calculated */
+static void
+mx_table_calculate_row_heights (MxTable *table,
+                                gint     for_height)
+{
+  MxTablePrivate *priv = table->priv;
+
+  if (!priv->rows_measured ||
+      priv->rows_for_width != priv->columns_for_width)
+    {
+      mx_table_measure_rows (table);
+
+      g_array_set_size (priv->measured_rows, 0);
+      g_array_append_vals (priv->measured_rows, priv->rows->data,
+                           priv->rows->len);
+      priv->measured_visible_rows = priv->visible_rows;
+      priv->rows_for_width = priv->columns_for_width;
+      priv->rows_measured = TRUE;
+    }
+  else if (priv->rows_valid && priv->rows_for_height == for_height)
+    return;
+  else
+    {
+      g_array_set_size (priv->rows, 0);
+      g_array_append_vals (priv->rows, priv->measured_rows->data,
+                           priv->measured_rows->len);
+      priv->visible_rows = priv->measured_visible_rows;
+    }
+
+  mx_table_distribute_rows (table, for_height);
+
+  priv->rows_for_height = for_height;
+  priv->rows_valid = TRUE;
+}
+
 static void
 mx_table_calculate_dimensions (MxTable *table,
                                gfloat for_width,
@@ -1166,6 +1311,78 @@ mx_table_calculate_dimensions (MxTable *table,
   mx_table_calculate_row_heights (table, for_height);
 }
 
+static void
+mx_table_update_cells (MxTable *table)
+{
+  MxTablePrivate *priv = table->priv;
+  ClutterActorIter iter;
+  ClutterActor *child;
+  gint i;
+
+  priv->cells_rows = priv->n_rows;
+  priv->cells_cols = priv->n_cols;
+  priv->cells = g_renew (CellData, priv->cells,
+                         priv->cells_rows * priv->cells_cols);
+  memset (priv->cells, 0,
+          sizeof (CellData) * priv->cells_rows * priv->cells_cols);
+
+  /* keep where the rows and columns end, the dimensions get recalculated
+   * whenever our preferred size is asked for */
+  priv->row_ends = g_renew (gfloat, priv->row_ends, priv->cells_rows);
+  for (i = 0; i < priv->cells_rows; i++)
+    {
+      DimensionData *row = &g_array_index (priv->rows, DimensionData, i);
+      priv->row_ends[i] = row->position + row->final_size;
+    }
+
+  priv->col_ends = g_renew (gfloat, priv->col_ends, priv->cells_cols);
+  for (i = 0; i < priv->cells_cols; i++)
+    {
+      DimensionData *col = &g_array_index (priv->columns, DimensionData, i);
+      priv->col_ends[i] = col->position + col->final_size;
+    }
+
+  priv->cells_overlap = FALSE;
+
+  clutter_actor_iter_init (&iter, CLUTTER_ACTOR (table));
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      MxTableChild *meta;
+      gint row, col;
+
+      meta = (MxTableChild *)
+        clutter_container_get_child_meta (CLUTTER_CONTAINER (table), child);
+
+      /* a child that can't be put in the grid can't be found through it
+       * either, so treat it like an overlap */
+      if (meta->row < 0 || meta->col < 0 ||
+          meta->row + meta->row_span > priv->cells_rows ||
+          meta->col + meta->col_span > priv->cells_cols)
+        {
+          priv->cells_overlap = TRUE;
+          continue;
+        }
+
+      for (row = meta->row; row < meta->row + meta->row_span; row++)
+        for (col = meta->col; col < meta->col + meta->col_span; col++)
+          {
+            CellData *cell = &priv->cells[row * priv->cells_cols + col];
+
+            if (cell->actor)
+              {
+                priv->cells_overlap = TRUE;
+                continue;
+              }
+
+            cell->actor = child;
+            cell->row = meta->row;
+            cell->col = meta->col;
+          }
+    }
+
+  priv->cells_valid = TRUE;
+}
+
 static void
 mx_table_preferred_allocate (ClutterActor          *self,
                              const ClutterActorBox *box,
@@ -1179,6 +1396,7 @@ mx_table_preferred_allocate (ClutterActor          *self,
   DimensionData *rows, *columns;
   ClutterActorIter iter;
   ClutterActor *child;
+  gint child_x, child_y;
 
   table = MX_TABLE (self);
   priv = MX_TABLE (self)->priv;
@@ -1193,6 +1411,31 @@ mx_table_preferred_allocate (ClutterActor          *self,
   rows = &g_array_index (priv->rows, DimensionData, 0);
   columns = &g_array_index (priv->columns, DimensionData, 0);
 
+  /* calculate the position of each column and row */
+  child_x = (int) padding.left;
+  for (i = 0; i < priv->n_cols; i++)
+    {
+      columns[i].position = child_x;
+
+      if (columns[i].is_visible)
+        {
+          child_x += columns[i].final_size;
+          child_x += col_spacing;
+        }
+    }
+
+  child_y = (int) padding.top;
+  for (i = 0; i < priv->n_rows; i++)
+    {
+      rows[i].position = child_y;
+
+      if (rows[i].is_visible)
+        {
+          child_y += rows[i].final_size;
+          child_y += row_spacing;
+        }
+    }
+
   clutter_actor_iter_init (&iter, self);
   while (clutter_actor_iter_next (&iter, &child))
     {
@@ -1200,7 +1443,6 @@ mx_table_preferred_allocate (ClutterActor          *self,
       gint col_width, row_height;
       MxTableChild *meta;
       ClutterActorBox childbox;
-      gint child_x, child_y;
       gdouble x_align_d, y_align_d;
       gboolean x_fill, y_fill;
       MxAlign x_align, y_align;
@@ -1270,27 +1512,8 @@ mx_table_preferred_allocate (ClutterActor          *self,
             }
         }
 
-      /* calculate child x */
-      child_x = (int) padding.left;
-      for (i = 0; i < col; i++)
-        {
-          if (columns[i].is_visible)
-            {
-              child_x += columns[i].final_size;
-              child_x += col_spacing;
-            }
-        }
-
-      /* calculate child y */
-      child_y = (int) padding.top;
-      for (i = 0; i < row; i++)
-        {
-          if (rows[i].is_visible)
-            {
-              child_y += rows[i].final_size;
-              child_y += row_spacing;
-            }
-        }
+      child_x = columns[col].position;
+      child_y = rows[row].position;
 
       /* set up childbox */
       childbox.x1 = (float) child_x;
@@ -1304,6 +1527,8 @@ mx_table_preferred_allocate (ClutterActor          *self,
 
       clutter_actor_allocate (child, &childbox, flags);
     }
+
+  mx_table_update_cells (table);
 }
 
 static void
@@ -1342,8 +1567,8 @@ mx_table_get_preferred_width (ClutterActor *self,
       return;
     }
 
-  /* use min_widths to help allocation of height-for-width widgets */
-  mx_table_calculate_dimensions (MX_TABLE (self), -1, for_height);
+  /* the rows aren't needed to work out the width */
+  mx_table_calculate_col_widths (MX_TABLE (self), -1);
 
   columns = &g_array_index (priv->columns, DimensionData, 0);
 
@@ -1410,23 +1635,181 @@ mx_table_get_preferred_height (ClutterActor *self,
     *natural_height_p = total_pref_height;
 }
 
+/* Reads the adjustments of the scrollables that a table's visible area can
+ * be worked out from, without creating them if they haven't been yet */
+static gboolean
+mx_table_peek_adjustments (ClutterActor  *parent,
+                           MxAdjustment **hadjust,
+                           MxAdjustment **vadjust)
+{
+  if (MX_IS_BOX_LAYOUT (parent))
+    _mx_box_layout_peek_adjustments (MX_BOX_LAYOUT (parent), hadjust, vadjust);
+  else if (MX_IS_GRID (parent))
+    _mx_grid_peek_adjustments (MX_GRID (parent), hadjust, vadjust);
+  else if (MX_IS_VIEWPORT (parent))
+    _mx_viewport_peek_adjustments (MX_VIEWPORT (parent), hadjust, vadjust);
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Whether nothing of the parent's children is drawn outside its allocation,
+ * either because it clips to it or because it's inside an MxScrollView,
+ * which clips its child */
+static gboolean
+mx_table_parent_clips (ClutterActor *parent)
+{
+  ClutterActor *grandparent;
+
+  if (clutter_actor_get_clip_to_allocation (parent))
+    return TRUE;
+
+  grandparent = clutter_actor_get_parent (parent);
+
+  return grandparent && MX_IS_SCROLL_VIEW (grandparent);
+}
+
 static void
-mx_table_paint (ClutterActor *self)
+mx_table_get_visible_box (ClutterActor    *self,
+                          ClutterActorBox *visible)
+{
+  MxAdjustment *hadjust, *vadjust;
+  ClutterActor *parent;
+
+  visible->x1 = -G_MAXFLOAT;
+  visible->y1 = -G_MAXFLOAT;
+  visible->x2 = G_MAXFLOAT;
+  visible->y2 = G_MAXFLOAT;
+
+  /* a scrollable parent, such as MxViewport, shows the part of us under its
+   * own allocation at its scroll position, if it's clipped to that */
+  parent = clutter_actor_get_parent (self);
+  if (parent && mx_table_parent_clips (parent)
+      && mx_table_peek_adjustments (parent, &hadjust, &vadjust))
+    {
+      ClutterActorBox box, parent_box;
+
+      clutter_actor_get_allocation_box (self, &box);
+      clutter_actor_get_allocation_box (parent, &parent_box);
+
+      visible->x1 = (hadjust ? mx_adjustment_get_value (hadjust) : 0) - box.x1;
+      visible->y1 = (vadjust ? mx_adjustment_get_value (vadjust) : 0) - box.y1;
+      visible->x2 = visible->x1 + (parent_box.x2 - parent_box.x1);
+      visible->y2 = visible->y1 + (parent_box.y2 - parent_box.y1);
+    }
+
+  if (clutter_actor_has_clip (self))
+    {
+      gfloat x, y, width, height;
+
+      clutter_actor_get_clip (self, &x, &y, &width, &height);
+
+      visible->x1 = MAX (visible->x1, x);
+      visible->y1 = MAX (visible->y1, y);
+      visible->x2 = MIN (visible->x2, x + width);
+      visible->y2 = MIN (visible->y2, y + height);
+    }
+}
+
+/* returns the first of the columns or rows that ends after @start */
+static gint
+mx_table_find_dimension (const gfloat *ends,
+                         gint          n_dimensions,
+                         gfloat        start)
+{
+  gint lower, upper;
+
+  lower = 0;
+  upper = n_dimensions;
+  while (lower < upper)
+    {
+      gint middle = lower + (upper - lower) / 2;
+
+      if (ends[middle] > start)
+        upper = middle;
+      else
+        lower = middle + 1;
+    }
+
+  return lower;
+}
+
+static void
+mx_table_paint_children (ClutterActor *self)
 {
   MxTablePrivate *priv = MX_TABLE (self)->priv;
   ClutterActorIter iter;
   ClutterActor *child;
+  ClutterActorBox visible;
+  gint first_row, last_row, first_col, last_col, row, col;
 
+  /* without overlapping children, painting each child at the first of its
+   * cells that is visible gives the same result as painting them all */
+  if (!priv->cells_valid || priv->cells_overlap ||
+      priv->cells_rows != priv->n_rows || priv->cells_cols != priv->n_cols)
+    {
+      clutter_actor_iter_init (&iter, self);
+      while (clutter_actor_iter_next (&iter, &child))
+        {
+          if (CLUTTER_ACTOR_IS_VISIBLE (child))
+            clutter_actor_paint (child);
+        }
+
+      return;
+    }
+
+  mx_table_get_visible_box (self, &visible);
+
+  first_row = mx_table_find_dimension (priv->row_ends, priv->cells_rows,
+                                       visible.y1);
+  last_row = mx_table_find_dimension (priv->row_ends, priv->cells_rows,
+                                      visible.y2);
+  first_col = mx_table_find_dimension (priv->col_ends, priv->cells_cols,
+                                       visible.x1);
+  last_col = mx_table_find_dimension (priv->col_ends, priv->cells_cols,
+                                      visible.x2);
+
+  /* include the row and column that the end of the visible area falls in */
+  last_row = MIN (last_row, priv->cells_rows - 1);
+  last_col = MIN (last_col, priv->cells_cols - 1);
+
+  for (row = first_row; row <= last_row; row++)
+    for (col = first_col; col <= last_col; col++)
+      {
+        CellData *cell = &priv->cells[row * priv->cells_cols + col];
+
+        if (!cell->actor || !CLUTTER_ACTOR_IS_VISIBLE (cell->actor))
+          continue;
+
+        if (row == MAX (cell->row, first_row) &&
+            col == MAX (cell->col, first_col))
+          clutter_actor_paint (cell->actor);
+      }
+}
+
+static void
+mx_table_queue_relayout (ClutterActor *self)
+{
+  MxTablePrivate *priv = MX_TABLE (self)->priv;
+
+  priv->columns_measured = FALSE;
+  priv->columns_valid = FALSE;
+  priv->rows_measured = FALSE;
+  priv->rows_valid = FALSE;
+
+  CLUTTER_ACTOR_CLASS (mx_table_parent_class)->queue_relayout (self);
+}
+
+static void
+mx_table_paint (ClutterActor *self)
+{
+  MxTablePrivate *priv = MX_TABLE (self)->priv;
 
   /* make sure the background gets painted first */
   CLUTTER_ACTOR_CLASS (mx_table_parent_class)->paint (self);
 
-  clutter_actor_iter_init (&iter, self);
-  while (clutter_actor_iter_next (&iter, &child))
-    {
-      if (CLUTTER_ACTOR_IS_VISIBLE (child))
-        clutter_actor_paint (child);
-    }
+  mx_table_paint_children (self);
 
   if (_mx_debug (MX_DEBUG_LAYOUT))
     {
@@ -1468,18 +1851,10 @@ static void
 mx_table_pick (ClutterActor       *self,
                const ClutterColor *color)
 {
-  ClutterActorIter iter;
-  ClutterActor *child;
-
   /* Chain up so we get a bounding box painted (if we are reactive) */
   CLUTTER_ACTOR_CLASS (mx_table_parent_class)->pick (self, color);
 
-  clutter_actor_iter_init (&iter, self);
-  while (clutter_actor_iter_next (&iter, &child))
-    {
-      if (CLUTTER_ACTOR_IS_VISIBLE (child))
-        clutter_actor_paint (child);
-    }
+  mx_table_paint_children (self);
 }
 
 static void
@@ -1500,6 +1875,7 @@ mx_table_class_init (MxTableClass *klass)
   actor_class->allocate = mx_table_allocate;
   actor_class->get_preferred_width = mx_table_get_preferred_width;
   actor_class->get_preferred_height = mx_table_get_preferred_height;
+  actor_class->queue_relayout = mx_table_queue_relayout;
 
 
   pspec = g_param_spec_int ("column-spacing",
@@ -1569,6 +1945,10 @@ mx_table_init (MxTable *table)
 
   table->priv->columns = g_array_new (FALSE, TRUE, sizeof (DimensionData));
   table->priv->rows = g_array_new (FALSE, TRUE, sizeof (DimensionData));
+  table->priv->measured_columns =
+    g_array_new (FALSE, FALSE, sizeof (DimensionData));
+  table->priv->measured_rows =
+    g_array_new (FALSE, FALSE, sizeof (DimensionData));
 
   g_signal_connect (table, "style-changed",
                     G_CALLBACK (mx_table_style_changed), NULL);
@@ -1578,6 +1958,8 @@ mx_table_init (MxTable *table)
 void _mx_table_update_row_col (MxTable      *table,
                                MxTableChild *meta)
 {
+  table->priv->cells_valid = FALSE;
+
   if (meta->col > -1)
     table->priv->n_cols = MAX (table->priv->n_cols, meta->col + meta->col_span);
 
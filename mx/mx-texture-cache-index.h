@@ -0,0 +1,97 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-texture-cache-index.h: on-disk format of texture atlas indexes
+ *
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _MX_TEXTURE_CACHE_INDEX_H
+#define _MX_TEXTURE_CACHE_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A texture atlas index describes where a set of images were packed in to
+ * one or more atlas pages. It is written by mx-create-image-cache and read by
+ * mx_texture_cache_load_cache(), which maps it and looks entries up in place.
+ *
+ * All the fields are 32-bit little-endian integers and all the tables are
+ * 4-byte aligned.
+ *
+ *   header   MxTextureCacheIndexHeader
+ *   pages    n_pages * MxTextureCacheIndexPage
+ *   entries  n_entries * MxTextureCacheIndexEntry
+ *   buckets  n_buckets * guint32, the first entry of each hash chain
+ *   strings  strings_size bytes of nul-terminated strings
+ *
+ * Entries are found by hashing their URI with g_str_hash(), taking the
+ * bucket of the hash modulo n_buckets and following the chain of entries
+ * through their next field.
+ *
+ * Version 2 added premultiplied pages; the version is checked so that pages
+ * written by older tools aren't drawn with the wrong alpha.
+ */
+
+#define MX_TEXTURE_CACHE_INDEX_MAGIC   "MxAtlas\n"
+#define MX_TEXTURE_CACHE_INDEX_VERSION 2
+#define MX_TEXTURE_CACHE_INDEX_NONE    0xffffffff
+
+/* formats of the atlas page images: an image file that gdk-pixbuf can
+ * read, or raw premultiplied RGBA pixels with a rowstride of width * 4 */
+#define MX_TEXTURE_CACHE_INDEX_PAGE_IMAGE              0
+#define MX_TEXTURE_CACHE_INDEX_PAGE_RGBA_PREMULTIPLIED 1
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+
+  guint32 n_pages;
+  guint32 pages_offset;
+  guint32 n_entries;
+  guint32 entries_offset;
+  guint32 n_buckets;
+  guint32 buckets_offset;
+  guint32 strings_size;
+  guint32 strings_offset;
+} MxTextureCacheIndexHeader;
+
+typedef struct
+{
+  guint32 filename;     /* string */
+  guint32 format;
+  guint32 width;
+  guint32 height;
+} MxTextureCacheIndexPage;
+
+typedef struct
+{
+  guint32 hash;
+  guint32 uri;          /* string */
+  guint32 next;         /* entry, or MX_TEXTURE_CACHE_INDEX_NONE */
+  guint32 page;
+  guint32 x;
+  guint32 y;
+  guint32 width;
+  guint32 height;
+} MxTextureCacheIndexEntry;
+
+G_END_DECLS
+
+#endif /* _MX_TEXTURE_CACHE_INDEX_H */
@@ -39,6 +39,7 @@
 #include <string.h>
 
 #include "mx-texture-cache.h"
+#include "mx-texture-cache-index.h"
 #include "mx-marshal.h"
 #include "mx-private.h"
 
@@ -54,14 +55,17 @@ struct _MxTextureCachePrivate
   GHashTable *cache;
   GRegex     *is_uri;
   GList      *resources;
+  GList      *atlases;
+
+  /* the items the cache holds references on, most recently used first */
+  GQueue     *lru;
+  gsize       budget;
+  gsize       size;
+  guint       hits;
+  guint       misses;
+  guint       evictions;
 };
 
-typedef struct FinalizedClosure
-{
-  gchar          *uri;
-  MxTextureCache *cache;
-} FinalizedClosure;
-
 enum
 {
   PROP_0,
@@ -70,16 +74,50 @@ enum
 static MxTextureCache* __cache_singleton = NULL;
 
 /*
- * Convention: posX with a value of -1 indicates whole texture
+ * While an item is in the LRU list the cache holds a reference on its
+ * textures. Items evicted to stay within the budget drop their meta textures
+ * and their reference on the texture, but stay in the cache for as long as
+ * anything else keeps the texture alive, so that it is never loaded twice.
+ * Once the texture is destroyed, the item is removed.
+ *
+ * Images from an atlas are sub-textures of a page that the atlas owns, so
+ * they are charged for the area they cover, in region_size, rather than for
+ * the page.
  */
 typedef struct MxTextureCacheItem {
-  char          filename[256];
-  int           width, height;
-  int           posX, posY;
-  CoglHandle    ptr;
-  GHashTable   *meta;
+  CoglHandle      ptr;
+  GHashTable     *meta;
+
+  MxTextureCache *cache;
+  gchar          *uri;
+  GList          *link;
+  gsize           size;
+  gsize           region_size;
+  gboolean        attached;
+  gboolean        detaching;
 } MxTextureCacheItem;
 
+/* A mapped texture atlas index, see mx-texture-cache-index.h. The pages are
+ * only loaded once an entry on them is first used. */
+typedef struct
+{
+  gchar                          *filename;
+  GMappedFile                    *file;
+
+  guint32                         n_pages;
+  guint32                         n_entries;
+  guint32                         n_buckets;
+  guint32                         strings_size;
+
+  const MxTextureCacheIndexPage  *pages;
+  const MxTextureCacheIndexEntry *entries;
+  const guint32                  *buckets;
+  const gchar                    *strings;
+
+  CoglHandle                     *page_textures;
+  gboolean                       *page_failed;
+} MxTextureCacheAtlas;
+
 typedef struct
 {
   gpointer        ident;
@@ -87,6 +125,8 @@ typedef struct
   GDestroyNotify  destroy_func;
 } MxTextureCacheMetaEntry;
 
+static CoglUserDataKey texture_cache_item_key;
+
 static MxTextureCacheItem *
 mx_texture_cache_item_new (void)
 {
@@ -96,15 +136,439 @@ mx_texture_cache_item_new (void)
 static void
 mx_texture_cache_item_free (MxTextureCacheItem *item)
 {
+  gboolean held = TRUE;
+
+  if (item->cache)
+    {
+      MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+
+      held = (item->link != NULL);
+      if (held)
+        {
+          g_queue_delete_link (priv->lru, item->link);
+          priv->size -= item->size;
+        }
+    }
+
   if (item->ptr)
-    cogl_handle_unref (item->ptr);
+    {
+      if (item->attached)
+        {
+          item->detaching = TRUE;
+          cogl_object_set_user_data (item->ptr, &texture_cache_item_key,
+                                     NULL, NULL);
+        }
+
+      if (held)
+        cogl_handle_unref (item->ptr);
+    }
 
   if (item->meta)
     g_hash_table_unref (item->meta);
 
+  g_free (item->uri);
   g_slice_free (MxTextureCacheItem, item);
 }
 
+static gsize
+mx_texture_cache_texture_size (CoglHandle texture)
+{
+  if (!texture)
+    return 0;
+
+  return (gsize) cogl_texture_get_width (texture) *
+    cogl_texture_get_height (texture) * 4;
+}
+
+static void
+mx_texture_cache_add_meta_size (gpointer                 key,
+                                MxTextureCacheMetaEntry *entry,
+                                gsize                   *size)
+{
+  *size += mx_texture_cache_texture_size (entry->texture);
+}
+
+static gsize
+mx_texture_cache_item_get_size (MxTextureCacheItem *item)
+{
+  gsize size;
+
+  if (item->ptr && item->region_size)
+    size = item->region_size;
+  else
+    size = mx_texture_cache_texture_size (item->ptr);
+
+  if (item->meta)
+    g_hash_table_foreach (item->meta, (GHFunc) mx_texture_cache_add_meta_size,
+                          &size);
+
+  return size;
+}
+
+/* Called when the texture of an evicted item is destroyed */
+static void
+mx_texture_cache_item_texture_destroyed (void *data)
+{
+  MxTextureCacheItem *item = data;
+  MxTextureCachePrivate *priv;
+
+  if (item->detaching)
+    return;
+
+  priv = TEXTURE_CACHE_PRIVATE (item->cache);
+
+  item->ptr = NULL;
+  item->attached = FALSE;
+  g_hash_table_remove (priv->cache, item->uri);
+}
+
+/* Evicts the least recently used items until the cache is within its
+ * budget. The most recently used item is always kept, as it is the one
+ * being returned. */
+static void
+mx_texture_cache_shrink (MxTextureCache *self)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+
+  while (priv->budget && priv->size > priv->budget &&
+         priv->lru->tail != priv->lru->head)
+    {
+      MxTextureCacheItem *item = priv->lru->tail->data;
+      CoglHandle texture = item->ptr;
+
+      g_queue_delete_link (priv->lru, item->link);
+      item->link = NULL;
+      priv->size -= item->size;
+      item->size = 0;
+      priv->evictions ++;
+
+      if (item->meta)
+        {
+          g_hash_table_unref (item->meta);
+          item->meta = NULL;
+        }
+
+      if (texture)
+        {
+          /* if nothing else is using the texture, this destroys it and
+           * removes the item from the cache */
+          cogl_handle_unref (texture);
+        }
+      else
+        g_hash_table_remove (priv->cache, item->uri);
+    }
+}
+
+/* Marks @item as the most recently used, taking back a reference on its
+ * texture if it had been evicted, and accounts for any change in its size */
+static void
+mx_texture_cache_item_use (MxTextureCache     *self,
+                           MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  gsize size;
+
+  if (item->link)
+    {
+      g_queue_unlink (priv->lru, item->link);
+      g_queue_push_head_link (priv->lru, item->link);
+    }
+  else
+    {
+      if (item->ptr)
+        cogl_handle_ref (item->ptr);
+
+      g_queue_push_head (priv->lru, item);
+      item->link = priv->lru->head;
+    }
+
+  if (item->ptr && !item->attached)
+    {
+      cogl_object_set_user_data (item->ptr, &texture_cache_item_key, item,
+                                 mx_texture_cache_item_texture_destroyed);
+      item->attached = TRUE;
+    }
+
+  size = mx_texture_cache_item_get_size (item);
+  priv->size += size - item->size;
+  item->size = size;
+
+  mx_texture_cache_shrink (self);
+}
+
+static void
+mx_texture_cache_atlas_free (MxTextureCacheAtlas *atlas)
+{
+  guint32 i;
+
+  for (i = 0; i < atlas->n_pages; i++)
+    if (atlas->page_textures[i])
+      cogl_handle_unref (atlas->page_textures[i]);
+
+  g_free (atlas->page_textures);
+  g_free (atlas->page_failed);
+  g_mapped_file_unref (atlas->file);
+  g_free (atlas->filename);
+
+  g_slice_free (MxTextureCacheAtlas, atlas);
+}
+
+static gboolean
+mx_texture_cache_atlas_range_is_valid (gsize   length,
+                                       guint32 offset,
+                                       guint32 n_items,
+                                       gsize   item_size)
+{
+  return (offset <= length &&
+          offset % sizeof (guint32) == 0 &&
+          n_items <= (length - offset) / item_size);
+}
+
+/* Maps an atlas index and checks its header and tables. The entries are only
+ * checked as they are looked up, so that opening an index doesn't depend on
+ * its size. */
+static MxTextureCacheAtlas *
+mx_texture_cache_atlas_new (const gchar *filename)
+{
+  const MxTextureCacheIndexHeader *header;
+  MxTextureCacheAtlas *atlas;
+  GMappedFile *file;
+  GError *error = NULL;
+  const gchar *data;
+  gsize length;
+
+  file = g_mapped_file_new (filename, FALSE, &error);
+  if (!file)
+    {
+      g_warning (G_STRLOC ": Unable to open texture cache index: %s",
+                 error->message);
+      g_error_free (error);
+      return NULL;
+    }
+
+  data = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const MxTextureCacheIndexHeader *) data;
+
+  if (length < sizeof (MxTextureCacheIndexHeader) ||
+      memcmp (header->magic, MX_TEXTURE_CACHE_INDEX_MAGIC,
+              sizeof (header->magic)) != 0 ||
+      GUINT32_FROM_LE (header->version) != MX_TEXTURE_CACHE_INDEX_VERSION ||
+      !mx_texture_cache_atlas_range_is_valid (length,
+                                              GUINT32_FROM_LE (header->pages_offset),
+                                              GUINT32_FROM_LE (header->n_pages),
+                                              sizeof (MxTextureCacheIndexPage)) ||
+      !mx_texture_cache_atlas_range_is_valid (length,
+                                              GUINT32_FROM_LE (header->entries_offset),
+                                              GUINT32_FROM_LE (header->n_entries),
+                                              sizeof (MxTextureCacheIndexEntry)) ||
+      !mx_texture_cache_atlas_range_is_valid (length,
+                                              GUINT32_FROM_LE (header->buckets_offset),
+                                              GUINT32_FROM_LE (header->n_buckets),
+                                              sizeof (guint32)) ||
+      GUINT32_FROM_LE (header->n_buckets) == 0 ||
+      GUINT32_FROM_LE (header->strings_offset) > length ||
+      GUINT32_FROM_LE (header->strings_size) == 0 ||
+      GUINT32_FROM_LE (header->strings_size) >
+      length - GUINT32_FROM_LE (header->strings_offset) ||
+      data[GUINT32_FROM_LE (header->strings_offset) +
+           GUINT32_FROM_LE (header->strings_size) - 1] != '\0')
+    {
+      g_warning (G_STRLOC ": '%s' is not a valid texture cache index",
+                 filename);
+      g_mapped_file_unref (file);
+      return NULL;
+    }
+
+  atlas = g_slice_new0 (MxTextureCacheAtlas);
+  atlas->filename = g_strdup (filename);
+  atlas->file = file;
+
+  atlas->n_pages = GUINT32_FROM_LE (header->n_pages);
+  atlas->n_entries = GUINT32_FROM_LE (header->n_entries);
+  atlas->n_buckets = GUINT32_FROM_LE (header->n_buckets);
+  atlas->strings_size = GUINT32_FROM_LE (header->strings_size);
+
+  atlas->pages = (const MxTextureCacheIndexPage *)
+    (data + GUINT32_FROM_LE (header->pages_offset));
+  atlas->entries = (const MxTextureCacheIndexEntry *)
+    (data + GUINT32_FROM_LE (header->entries_offset));
+  atlas->buckets = (const guint32 *)
+    (data + GUINT32_FROM_LE (header->buckets_offset));
+  atlas->strings = data + GUINT32_FROM_LE (header->strings_offset);
+
+  atlas->page_textures = g_new0 (CoglHandle, atlas->n_pages);
+  atlas->page_failed = g_new0 (gboolean, atlas->n_pages);
+
+  return atlas;
+}
+
+static const gchar *
+mx_texture_cache_atlas_get_string (MxTextureCacheAtlas *atlas,
+                                   guint32              offset)
+{
+  offset = GUINT32_FROM_LE (offset);
+
+  if (offset >= atlas->strings_size)
+    return NULL;
+
+  return atlas->strings + offset;
+}
+
+static CoglHandle
+mx_texture_cache_atlas_get_page (MxTextureCacheAtlas *atlas,
+                                 guint32              page)
+{
+  const gchar *name;
+  gchar *dirname, *path;
+  GError *error = NULL;
+  guint32 format, width, height;
+
+  if (atlas->page_textures[page] || atlas->page_failed[page])
+    return atlas->page_textures[page];
+
+  name = mx_texture_cache_atlas_get_string (atlas,
+                                            atlas->pages[page].filename);
+  format = GUINT32_FROM_LE (atlas->pages[page].format);
+  width = GUINT32_FROM_LE (atlas->pages[page].width);
+  height = GUINT32_FROM_LE (atlas->pages[page].height);
+
+  if (!name ||
+      (format != MX_TEXTURE_CACHE_INDEX_PAGE_IMAGE &&
+       format != MX_TEXTURE_CACHE_INDEX_PAGE_RGBA_PREMULTIPLIED))
+    {
+      atlas->page_failed[page] = TRUE;
+      return COGL_INVALID_HANDLE;
+    }
+
+  /* pages are found relative to the index */
+  if (g_path_is_absolute (name))
+    path = g_strdup (name);
+  else
+    {
+      dirname = g_path_get_dirname (atlas->filename);
+      path = g_build_filename (dirname, name, NULL);
+      g_free (dirname);
+    }
+
+  if (format == MX_TEXTURE_CACHE_INDEX_PAGE_RGBA_PREMULTIPLIED)
+    {
+      GMappedFile *file = g_mapped_file_new (path, FALSE, &error);
+
+      /* the pixels are already in the format the texture is stored in, so
+       * they are uploaded without any conversion */
+      if (file &&
+          g_mapped_file_get_length (file) == (gsize) width * height * 4)
+        atlas->page_textures[page] =
+          cogl_texture_new_from_data (width, height, COGL_TEXTURE_NONE,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                      width * 4,
+                                      (guint8 *) g_mapped_file_get_contents (file));
+
+      if (file)
+        g_mapped_file_unref (file);
+    }
+  else
+    atlas->page_textures[page] =
+      cogl_texture_new_from_file (path, COGL_TEXTURE_NONE,
+                                  COGL_PIXEL_FORMAT_ANY, &error);
+
+  if (!atlas->page_textures[page] ||
+      cogl_texture_get_width (atlas->page_textures[page]) != width ||
+      cogl_texture_get_height (atlas->page_textures[page]) != height)
+    {
+      if (error)
+        {
+          g_warning (G_STRLOC ": Error opening cache image file: %s",
+                     error->message);
+          g_error_free (error);
+        }
+      else
+        g_warning (G_STRLOC ": Cache image file '%s' does not match its index",
+                   path);
+
+      if (atlas->page_textures[page])
+        {
+          cogl_handle_unref (atlas->page_textures[page]);
+          atlas->page_textures[page] = COGL_INVALID_HANDLE;
+        }
+      atlas->page_failed[page] = TRUE;
+    }
+
+  g_free (path);
+
+  return atlas->page_textures[page];
+}
+
+/* Finds the entry for @uri in an atlas index, or returns %NULL */
+static const MxTextureCacheIndexEntry *
+mx_texture_cache_atlas_find (MxTextureCacheAtlas *atlas,
+                             const gchar         *uri)
+{
+  guint32 hash, index, steps;
+
+  hash = g_str_hash (uri);
+  index = GUINT32_FROM_LE (atlas->buckets[hash % atlas->n_buckets]);
+
+  /* the chain can't be longer than the number of entries, which stops a
+   * corrupt index from looping */
+  for (steps = 0;
+       index < atlas->n_entries && steps < atlas->n_entries;
+       steps++)
+    {
+      const MxTextureCacheIndexEntry *entry = &atlas->entries[index];
+      const gchar *entry_uri;
+
+      if (GUINT32_FROM_LE (entry->hash) == hash &&
+          (entry_uri = mx_texture_cache_atlas_get_string (atlas, entry->uri)) &&
+          strcmp (entry_uri, uri) == 0)
+        return entry;
+
+      index = GUINT32_FROM_LE (entry->next);
+    }
+
+  return NULL;
+}
+
+/* Returns a new texture for the area of an atlas page that @uri was packed
+ * in to, or %COGL_INVALID_HANDLE if the atlas doesn't contain @uri. @size is
+ * set to the size of that area. */
+static CoglHandle
+mx_texture_cache_atlas_lookup (MxTextureCacheAtlas *atlas,
+                               const gchar         *uri,
+                               gsize               *size)
+{
+  const MxTextureCacheIndexEntry *entry;
+  guint32 page, x, y, width, height;
+  CoglHandle texture;
+
+  entry = mx_texture_cache_atlas_find (atlas, uri);
+  if (!entry)
+    return COGL_INVALID_HANDLE;
+
+  page = GUINT32_FROM_LE (entry->page);
+  x = GUINT32_FROM_LE (entry->x);
+  y = GUINT32_FROM_LE (entry->y);
+  width = GUINT32_FROM_LE (entry->width);
+  height = GUINT32_FROM_LE (entry->height);
+
+  if (page >= atlas->n_pages || width == 0 || height == 0)
+    return COGL_INVALID_HANDLE;
+
+  texture = mx_texture_cache_atlas_get_page (atlas, page);
+  if (!texture ||
+      x > cogl_texture_get_width (texture) ||
+      width > cogl_texture_get_width (texture) - x ||
+      y > cogl_texture_get_height (texture) ||
+      height > cogl_texture_get_height (texture) - y)
+    return COGL_INVALID_HANDLE;
+
+  *size = (gsize) width * height * 4;
+
+  return cogl_texture_new_from_sub_texture (texture, x, y, width, height);
+}
+
 static void
 mx_texture_cache_set_property (GObject      *object,
                                guint         prop_id,
@@ -142,6 +606,15 @@ mx_texture_cache_dispose (GObject *object)
     {
       g_list_foreach (priv->resources, (GFunc) g_resource_unref, NULL);
       g_list_free (priv->resources);
+      priv->resources = NULL;
+    }
+
+  if (priv->atlases)
+    {
+      g_list_foreach (priv->atlases, (GFunc) mx_texture_cache_atlas_free,
+                      NULL);
+      g_list_free (priv->atlases);
+      priv->atlases = NULL;
     }
 
   if (G_OBJECT_CLASS (mx_texture_cache_parent_class)->dispose)
@@ -156,6 +629,9 @@ mx_texture_cache_finalize (GObject *object)
   if (priv->cache)
     g_hash_table_unref (priv->cache);
 
+  if (priv->lru)
+    g_queue_free (priv->lru);
+
   if (priv->is_uri)
     g_regex_unref (priv->is_uri);
 
@@ -185,6 +661,7 @@ mx_texture_cache_init (MxTextureCache *self)
   priv->cache =
     g_hash_table_new_full (g_str_hash, g_str_equal,
                            g_free, (GDestroyNotify)mx_texture_cache_item_free);
+  priv->lru = g_queue_new ();
 
   priv->is_uri = g_regex_new ("^([a-zA-Z0-9+.-]+)://.*",
                               G_REGEX_OPTIMIZE, 0, &error);
@@ -209,21 +686,6 @@ mx_texture_cache_get_default (void)
   return __cache_singleton;
 }
 
-#if 0
-static void
-on_texure_finalized (gpointer data,
-                     GObject *where_the_object_was)
-{
-  FinalizedClosure *closure = (FinalizedClosure *) data;
-  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(closure->cache);
-
-  g_hash_table_remove (priv->cache, closure->uri);
-
-  g_free(closure->uri);
-  g_free(closure);
-}
-#endif
-
 /**
  * mx_texture_cache_get_size:
  * @self: A #MxTextureCache
@@ -245,19 +707,16 @@ add_texture_to_cache (MxTextureCache     *self,
                       const gchar        *uri,
                       MxTextureCacheItem *item)
 {
-  /*  FinalizedClosure        *closure; */
   MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(self);
 
-  g_hash_table_insert (priv->cache, g_strdup (uri), item);
-
-#if 0
-  /* Make sure we can remove from hash */
-  closure = g_new0 (FinalizedClosure, 1);
-  closure->uri = g_strdup (uri);
-  closure->cache = self;
+  /* the cache takes over the caller's reference on the texture; the caller
+   * then marks the item as used, which accounts for its size */
+  item->cache = self;
+  item->uri = g_strdup (uri);
+  g_queue_push_head (priv->lru, item);
+  item->link = priv->lru->head;
 
-  g_object_weak_ref (G_OBJECT (res), on_texure_finalized, closure);
-#endif
+  g_hash_table_insert (priv->cache, g_strdup (uri), item);
 }
 
 /* NOTE: you should unref the returned texture when not needed */
@@ -317,10 +776,45 @@ mx_texture_cache_uri_to_filename (const gchar *uri)
   return file;
 }
 
+/* Returns @uri as a URI, converting it from a path if needed */
+static gchar *
+mx_texture_cache_get_uri (MxTextureCache *self,
+                          const gchar    *uri)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (g_str_has_prefix (uri, "resource://") ||
+      g_regex_match (priv->is_uri, uri, 0, NULL))
+    return g_strdup (uri);
+
+  return mx_texture_cache_filename_to_uri (uri);
+}
+
+/* Looks up the item for @uri without loading anything, creating an item or
+ * changing its place in the LRU list */
+static MxTextureCacheItem *
+mx_texture_cache_lookup_item (MxTextureCache *self,
+                              const gchar    *uri)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureCacheItem *item;
+  gchar *new_uri;
+
+  new_uri = mx_texture_cache_get_uri (self, uri);
+  if (!new_uri)
+    return NULL;
+
+  item = g_hash_table_lookup (priv->cache, new_uri);
+  g_free (new_uri);
+
+  return item;
+}
+
+/* Returns the item for @uri with its texture loaded, loading it if needed,
+ * and marks it as the most recently used */
 static MxTextureCacheItem *
 mx_texture_cache_get_item (MxTextureCache *self,
-                           const gchar    *uri,
-                           gboolean        create_if_not_exists)
+                           const gchar    *uri)
 {
   MxTextureCachePrivate *priv;
   MxTextureCacheItem *item;
@@ -339,12 +833,9 @@ mx_texture_cache_get_item (MxTextureCache *self,
     {
       if (g_regex_match (priv->is_uri, uri, 0, NULL))
         {
-          if (create_if_not_exists)
-            {
-              file = new_file = mx_texture_cache_uri_to_filename (uri);
-              if (!new_file)
-                return NULL;
-            }
+          file = new_file = mx_texture_cache_uri_to_filename (uri);
+          if (!new_file)
+            return NULL;
         }
       else
         {
@@ -357,11 +848,35 @@ mx_texture_cache_get_item (MxTextureCache *self,
 
   item = g_hash_table_lookup (priv->cache, uri);
 
-  if ((!item || !item->ptr) && create_if_not_exists)
+  /* images packed in to a loaded atlas are created on first use */
+  if (!item && priv->atlases)
+    {
+      CoglHandle texture = COGL_INVALID_HANDLE;
+      gsize size = 0;
+      GList *l;
+
+      for (l = priv->atlases; l && !texture; l = l->next)
+        texture = mx_texture_cache_atlas_lookup (l->data, uri, &size);
+
+      if (texture)
+        {
+          item = mx_texture_cache_item_new ();
+          item->ptr = texture;
+          item->region_size = size;
+          add_texture_to_cache (self, uri, item);
+          priv->misses ++;
+        }
+    }
+  else if (item && item->ptr)
+    priv->hits ++;
+
+  if (!item || !item->ptr)
     {
       gboolean created;
       GError *err = NULL;
 
+      priv->misses ++;
+
       if (!item)
         {
           item = mx_texture_cache_item_new ();
@@ -372,19 +887,20 @@ mx_texture_cache_get_item (MxTextureCache *self,
 
       if (is_resource)
         {
-          GdkPixbuf *pixbuf;
+          GdkPixbuf *pixbuf = NULL;
           GInputStream *stream = NULL;
           gint width, height, has_alpha, rowstride;
           GList *l;
           GResource *resource = NULL;
+          const gchar *path;
 
           /* strip the "resource://" prefix */
-          uri = &uri[11];
+          path = &uri[11];
 
           /* find the resource that has this path */
           for (l = priv->resources; l; l = g_list_next (l))
             {
-              if (g_resource_get_info (l->data, uri,
+              if (g_resource_get_info (l->data, path,
                                        G_RESOURCE_LOOKUP_FLAGS_NONE, NULL, NULL,
                                        NULL))
                 {
@@ -394,16 +910,19 @@ mx_texture_cache_get_item (MxTextureCache *self,
 
           if (resource)
             {
-              stream = g_resource_open_stream (resource, uri,
+              stream = g_resource_open_stream (resource, path,
                                                G_RESOURCE_LOOKUP_FLAGS_NONE,
                                                &err);
             }
 
           if (stream)
             {
-
               pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, &err);
+              g_object_unref (stream);
+            }
 
+          if (pixbuf)
+            {
 
               width = gdk_pixbuf_get_width (pixbuf);
               height = gdk_pixbuf_get_height (pixbuf);
@@ -417,7 +936,7 @@ mx_texture_cache_get_item (MxTextureCache *self,
                                                       rowstride,
                                                       gdk_pixbuf_get_pixels (pixbuf));
 
-              g_object_unref (stream);
+              g_object_unref (pixbuf);
             }
         }
       else
@@ -448,6 +967,8 @@ mx_texture_cache_get_item (MxTextureCache *self,
         add_texture_to_cache (self, uri, item);
     }
 
+  mx_texture_cache_item_use (self, item);
+
   g_free (new_file);
   g_free (new_uri);
 
@@ -475,7 +996,7 @@ mx_texture_cache_get_cogl_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  item = mx_texture_cache_get_item (self, uri);
 
   if (item)
     return cogl_handle_ref (item->ptr);
@@ -504,7 +1025,7 @@ mx_texture_cache_get_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  item = mx_texture_cache_get_item (self, uri);
 
   if (item)
     {
@@ -569,15 +1090,18 @@ mx_texture_cache_get_meta_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  /* only the entry is needed, don't load the image itself */
+  item = mx_texture_cache_lookup_item (self, uri);
 
   if (item && item->meta)
     {
       MxTextureCacheMetaEntry *entry = g_hash_table_lookup (item->meta, ident);
 
-      if (entry->texture)
+      if (entry && entry->texture)
         {
           ClutterActor *texture = clutter_texture_new ();
+
+          mx_texture_cache_item_use (self, item);
           clutter_texture_set_cogl_texture ((ClutterTexture*) texture,
                                             entry->texture);
           return (ClutterTexture *)texture;
@@ -613,14 +1137,18 @@ mx_texture_cache_get_meta_cogl_texture (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  /* only the entry is needed, don't load the image itself */
+  item = mx_texture_cache_lookup_item (self, uri);
 
   if (item && item->meta)
     {
       MxTextureCacheMetaEntry *entry = g_hash_table_lookup (item->meta, ident);
 
-      if (entry->texture)
-        return cogl_handle_ref (entry->texture);
+      if (entry && entry->texture)
+        {
+          mx_texture_cache_item_use (self, item);
+          return cogl_handle_ref (entry->texture);
+        }
     }
 
   return NULL;
@@ -642,10 +1170,28 @@ gboolean
 mx_texture_cache_contains (MxTextureCache *self,
                            const gchar    *uri)
 {
+  MxTextureCachePrivate *priv;
+  gboolean result;
+  gchar *new_uri;
+  GList *l;
+
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), FALSE);
   g_return_val_if_fail (uri != NULL, FALSE);
 
-  return mx_texture_cache_get_item (self, uri, FALSE) ? TRUE : FALSE;
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  new_uri = mx_texture_cache_get_uri (self, uri);
+  if (!new_uri)
+    return FALSE;
+
+  /* images in an atlas are there even if they haven't been used yet */
+  result = g_hash_table_lookup (priv->cache, new_uri) != NULL;
+  for (l = priv->atlases; l && !result; l = l->next)
+    result = mx_texture_cache_atlas_find (l->data, new_uri) != NULL;
+
+  g_free (new_uri);
+
+  return result;
 }
 
 /**
@@ -671,7 +1217,7 @@ mx_texture_cache_contains_meta (MxTextureCache *self,
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), FALSE);
   g_return_val_if_fail (uri != NULL, FALSE);
 
-  item = mx_texture_cache_get_item (self, uri, FALSE);
+  item = mx_texture_cache_lookup_item (self, uri);
 
   if (item && item->meta &&
       g_hash_table_lookup (item->meta, ident))
@@ -721,6 +1267,7 @@ mx_texture_cache_insert (MxTextureCache *self,
   item = mx_texture_cache_item_new ();
   item->ptr = cogl_handle_ref (texture);
   add_texture_to_cache (self, uri, item);
+  mx_texture_cache_item_use (self, item);
 
   g_free (new_uri);
 }
@@ -781,7 +1328,7 @@ mx_texture_cache_insert_meta (MxTextureCache *self,
         return;
     }
 
-  item = mx_texture_cache_get_item (self, uri, FALSE);
+  item = mx_texture_cache_lookup_item (self, uri);
   if (!item)
     {
       item = mx_texture_cache_item_new ();
@@ -800,91 +1347,140 @@ mx_texture_cache_insert_meta (MxTextureCache *self,
   entry->destroy_func = destroy_func;
 
   g_hash_table_insert (item->meta, ident, entry);
+
+  /* account for the new texture */
+  mx_texture_cache_item_use (self, item);
 }
 
+/**
+ * mx_texture_cache_load_cache:
+ * @self: A #MxTextureCache
+ * @filename: The filename of a texture atlas index
+ *
+ * Makes the images packed in to the texture atlas described by @filename
+ * available from the cache. The index is written by mx-create-image-cache
+ * and is mapped rather than read; each image is only created from its atlas
+ * page when it is first requested.
+ */
 void
 mx_texture_cache_load_cache (MxTextureCache *self,
                              const gchar    *filename)
 {
-  FILE *file;
-  MxTextureCacheItem *element, head;
-  int ret;
-  CoglHandle full_texture;
   MxTextureCachePrivate *priv;
+  MxTextureCacheAtlas *atlas;
+  GList *l;
 
   g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
   g_return_if_fail (filename != NULL);
 
   priv = TEXTURE_CACHE_PRIVATE (self);
 
-  file = fopen(filename, "rm");
-  if (!file)
-    return;
-
-  ret = fread (&head, sizeof(MxTextureCacheItem), 1, file);
-  if (ret < 0)
+  /* check if we already have this index */
+  for (l = priv->atlases; l; l = l->next)
     {
-      fclose (file);
-      return;
-    }
+      atlas = l->data;
 
-  /* check if we already if this texture in the cache */
-  if (g_hash_table_lookup (priv->cache, head.filename))
-    {
-      /* skip it, we're done */
-      fclose (file);
-      return;
+      if (g_str_equal (atlas->filename, filename))
+        return;
     }
 
-  full_texture = mx_texture_cache_get_cogl_texture (self, head.filename);
+  atlas = mx_texture_cache_atlas_new (filename);
+  if (!atlas)
+    return;
 
-  if (full_texture == COGL_INVALID_HANDLE)
-    {
-      g_critical (G_STRLOC ": Error opening cache image file");
-      fclose (file);
-      return;
-    }
+  /* images already in the cache take precedence, and of the atlases the
+   * first loaded is searched first */
+  priv->atlases = g_list_append (priv->atlases, atlas);
+}
 
-  while (!feof (file))
-    {
-      gchar *uri;
+/**
+ * mx_texture_cache_set_budget:
+ * @self: A #MxTextureCache
+ * @budget: the maximum size of the cached textures in bytes, or 0 for no
+ *   limit
+ *
+ * Sets an approximate limit on the texture memory the cache holds on to.
+ * When the limit is exceeded, the least recently used textures are released.
+ * A released texture that is still used elsewhere is kept in the cache until
+ * it is destroyed, so that it is not loaded a second time, but it no longer
+ * counts against the budget.
+ *
+ * Since: 2.0
+ */
+void
+mx_texture_cache_set_budget (MxTextureCache *self,
+                             gsize           budget)
+{
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
 
-      element = mx_texture_cache_item_new ();
-      ret = fread (element, sizeof (MxTextureCacheItem), 1, file);
+  TEXTURE_CACHE_PRIVATE (self)->budget = budget;
 
-      if (ret < 1)
-        {
-          /* end of file */
-          mx_texture_cache_item_free (element);
-          break;
-        }
+  mx_texture_cache_shrink (self);
+}
 
-      uri = mx_texture_cache_filename_to_uri (element->filename);
-      if (!uri)
-        {
-          /* Couldn't resolve path */
-          mx_texture_cache_item_free (element);
-          continue;
-        }
+/**
+ * mx_texture_cache_get_budget:
+ * @self: A #MxTextureCache
+ *
+ * Gets the limit on the texture memory held by the cache. See
+ * mx_texture_cache_set_budget().
+ *
+ * Returns: the budget in bytes, or 0 if there is no limit
+ *
+ * Since: 2.0
+ */
+gsize
+mx_texture_cache_get_budget (MxTextureCache *self)
+{
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), 0);
 
-      if (g_hash_table_lookup (priv->cache, uri))
-        {
-          /* URI is already in the cache.... */
-          mx_texture_cache_item_free (element);
-          g_free (uri);
-        }
-      else
-        {
-          element->ptr = cogl_texture_new_from_sub_texture (full_texture,
-                                                            element->posX,
-                                                            element->posY,
-                                                            element->width,
-                                                            element->height);
-          g_hash_table_insert (priv->cache, uri, element);
-        }
-    }
+  return TEXTURE_CACHE_PRIVATE (self)->budget;
+}
+
+/**
+ * mx_texture_cache_get_stats:
+ * @self: A #MxTextureCache
+ * @n_entries: (out) (allow-none): return location for the number of entries
+ *   the cache holds textures for
+ * @size: (out) (allow-none): return location for the approximate size of
+ *   those textures in bytes
+ * @hits: (out) (allow-none): return location for the number of look-ups
+ *   answered from the cache
+ * @misses: (out) (allow-none): return location for the number of look-ups
+ *   that had to load an image
+ * @evictions: (out) (allow-none): return location for the number of entries
+ *   released to keep the cache within its budget
+ *
+ * Retrieves statistics about the texture cache. Only requests for an image's
+ * texture count as hits or misses; mx_texture_cache_contains() and the meta
+ * texture functions don't.
+ *
+ * Since: 2.0
+ */
+void
+mx_texture_cache_get_stats (MxTextureCache *self,
+                            guint          *n_entries,
+                            gsize          *size,
+                            guint          *hits,
+                            guint          *misses,
+                            guint          *evictions)
+{
+  MxTextureCachePrivate *priv;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
 
-  fclose (file);
+  if (n_entries)
+    *n_entries = g_queue_get_length (priv->lru);
+  if (size)
+    *size = priv->size;
+  if (hits)
+    *hits = priv->hits;
+  if (misses)
+    *misses = priv->misses;
+  if (evictions)
+    *evictions = priv->evictions;
 }
 
 /**
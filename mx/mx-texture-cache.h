@@ -125,6 +125,16 @@ void            mx_texture_cache_insert_meta (MxTextureCache *self,
 void mx_texture_cache_load_cache (MxTextureCache *self,
                                   const char     *filename);
 
+void  mx_texture_cache_set_budget (MxTextureCache *self,
+                                  gsize           budget);
+gsize mx_texture_cache_get_budget (MxTextureCache *self);
+void  mx_texture_cache_get_stats  (MxTextureCache *self,
+                                  guint          *n_entries,
+                                  gsize          *size,
+                                  guint          *hits,
+                                  guint          *misses,
+                                  guint          *evictions);
+
 void mx_texture_cache_add_resource    (MxTextureCache *cache,
                                        GResource      *resource);
 void mx_texture_cache_remove_resource (MxTextureCache *cache,
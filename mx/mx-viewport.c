@@ -584,6 +584,17 @@ scrollable_get_adjustments (MxScrollable  *scrollable,
     }
 }
 
+/* The adjustments that have been set or created so far, without creating
+ * any */
+void
+_mx_viewport_peek_adjustments (MxViewport    *viewport,
+                               MxAdjustment **hadjustment,
+                               MxAdjustment **vadjustment)
+{
+  *hadjustment = viewport->priv->hadjustment;
+  *vadjustment = viewport->priv->vadjustment;
+}
+
 static void
 scrollable_interface_init (MxScrollableIface *iface)
 {
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Compiles a style sheet, loads the result back and checks that every
+ * stylable matches the same properties as with the parsed sheet. Also
+ * checks that stale or truncated compiled sheets are rejected, and that a
+ * compiled sheet loads through MxStyle and its match cache. */
+
+#include <mx/mx.h>
+#include <mx/mx-css.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const gchar *css =
+  "MxButton { color: #ff0000; padding: 4px; }\n"
+  "MxButton.primary { color: #00ff00; }\n"
+  "MxButton#ok:hover { color: #0000ff; border-image: url(\"button.png\") 5; }\n"
+  "MxLabel, MxButton.primary { font-size: 12px; }\n";
+
+static const gchar *property_names[] = {
+  "color",
+  "padding",
+  "border-image",
+  "font-size"
+};
+
+static ClutterActor *
+make_button (const gchar *style_class,
+             const gchar *name,
+             const gchar *pseudo_class)
+{
+  ClutterActor *button = mx_button_new ();
+
+  if (style_class)
+    mx_stylable_set_style_class (MX_STYLABLE (button), style_class);
+  if (name)
+    clutter_actor_set_name (button, name);
+  if (pseudo_class)
+    mx_stylable_set_style_pseudo_class (MX_STYLABLE (button), pseudo_class);
+
+  return g_object_ref_sink (button);
+}
+
+static const gchar *
+lookup_string (MxStyleSheetProperties *properties,
+               const gchar            *name)
+{
+  MxStyleSheetValue *value;
+
+  value = mx_style_sheet_properties_lookup (properties, name);
+
+  return value ? value->string : NULL;
+}
+
+static void
+compare_matches (MxStyleSheet *parsed,
+                 MxStyleSheet *compiled,
+                 ClutterActor *actor)
+{
+  MxStyleSheetProperties *expected, *properties;
+  guint i;
+
+  expected = mx_style_sheet_get_properties (parsed, MX_STYLABLE (actor));
+  properties = mx_style_sheet_get_properties (compiled, MX_STYLABLE (actor));
+
+  for (i = 0; i < G_N_ELEMENTS (property_names); i++)
+    g_assert_cmpstr (lookup_string (properties, property_names[i]), ==,
+                     lookup_string (expected, property_names[i]));
+
+  mx_style_sheet_properties_unref (expected);
+  mx_style_sheet_properties_unref (properties);
+}
+
+static void
+check_value (MxStyleSheet *sheet,
+             ClutterActor *actor,
+             const gchar  *name,
+             const gchar  *expected)
+{
+  MxStyleSheetProperties *properties;
+
+  properties = mx_style_sheet_get_properties (sheet, MX_STYLABLE (actor));
+  g_assert_cmpstr (lookup_string (properties, name), ==, expected);
+  mx_style_sheet_properties_unref (properties);
+}
+
+static void
+test_round_trip (void)
+{
+  MxStyleSheet *parsed, *compiled;
+  ClutterActor *actors[4];
+  GBytes *bytes, *truncated;
+  gchar *checksum, *stale;
+  gsize length;
+  guint i;
+
+  parsed = mx_style_sheet_new ();
+  g_assert (mx_style_sheet_add_from_data (parsed, "test.css", css, NULL));
+  g_assert (!mx_style_sheet_data_is_compiled (css, strlen (css)));
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                          (const guchar *) css, strlen (css));
+  bytes = mx_style_sheet_compile (parsed, checksum);
+  g_assert (bytes != NULL);
+  g_assert (mx_style_sheet_data_is_compiled (g_bytes_get_data (bytes, NULL),
+                                             g_bytes_get_size (bytes)));
+
+  compiled = mx_style_sheet_new ();
+  g_assert (mx_style_sheet_add_from_compiled (compiled, "test.css", bytes,
+                                              checksum, NULL));
+
+  actors[0] = make_button (NULL, NULL, NULL);
+  actors[1] = make_button ("primary", NULL, NULL);
+  actors[2] = make_button (NULL, "ok", "hover");
+  actors[3] = g_object_ref_sink (mx_label_new ());
+
+  for (i = 0; i < G_N_ELEMENTS (actors); i++)
+    compare_matches (parsed, compiled, actors[i]);
+
+  check_value (compiled, actors[0], "color", "#ff0000");
+  check_value (compiled, actors[1], "color", "#00ff00");
+  check_value (compiled, actors[1], "font-size", "12px");
+  check_value (compiled, actors[2], "color", "#0000ff");
+  check_value (compiled, actors[2], "padding", "4px");
+  check_value (compiled, actors[3], "color", NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (actors); i++)
+    g_object_unref (actors[i]);
+
+  mx_style_sheet_destroy (compiled);
+
+  /* a sheet compiled from a different source is stale */
+  stale = g_strnfill (strlen (checksum), '0');
+  compiled = mx_style_sheet_new ();
+  g_assert (!mx_style_sheet_add_from_compiled (compiled, "test.css", bytes,
+                                               stale, NULL));
+
+  /* and a truncated one is invalid */
+  length = g_bytes_get_size (bytes);
+  truncated = g_bytes_new_from_bytes (bytes, 0, length / 2);
+  g_assert (!mx_style_sheet_add_from_compiled (compiled, "test.css",
+                                               truncated, NULL, NULL));
+  mx_style_sheet_destroy (compiled);
+
+  g_bytes_unref (truncated);
+  g_bytes_unref (bytes);
+  g_free (stale);
+  g_free (checksum);
+  mx_style_sheet_destroy (parsed);
+}
+
+static void
+test_style (void)
+{
+  MxStyleSheet *parsed;
+  ClutterActor *button;
+  ClutterColor *color = NULL;
+  GError *error = NULL;
+  MxStyle *style;
+  GBytes *bytes;
+  gchar *filename;
+  guint hits, misses;
+  gint fd;
+
+  parsed = mx_style_sheet_new ();
+  g_assert (mx_style_sheet_add_from_data (parsed, "test.css", css, NULL));
+  bytes = mx_style_sheet_compile (parsed, NULL);
+  mx_style_sheet_destroy (parsed);
+
+  fd = g_file_open_tmp ("test-css-compiler-XXXXXX.cssc", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  g_file_set_contents (filename, g_bytes_get_data (bytes, NULL),
+                       g_bytes_get_size (bytes), &error);
+  g_assert_no_error (error);
+  g_bytes_unref (bytes);
+
+  style = mx_style_new ();
+  g_assert (mx_style_load_from_file (style, filename, &error));
+  g_assert_no_error (error);
+
+  button = make_button ("primary", NULL, NULL);
+
+  mx_style_get (style, MX_STYLABLE (button), "color", &color, NULL);
+  g_assert (color != NULL);
+  g_assert_cmpint (color->red, ==, 0x00);
+  g_assert_cmpint (color->green, ==, 0xff);
+  g_assert_cmpint (color->blue, ==, 0x00);
+  clutter_color_free (color);
+
+  /* the second look-up is answered from the match cache */
+  mx_style_get_cache_stats (style, NULL, NULL, &hits, &misses, NULL);
+  g_assert_cmpuint (misses, ==, 1);
+
+  mx_style_get (style, MX_STYLABLE (button), "color", &color, NULL);
+  clutter_color_free (color);
+
+  mx_style_get_cache_stats (style, NULL, NULL, &hits, &misses, NULL);
+  g_assert_cmpuint (hits, ==, 1);
+  g_assert_cmpuint (misses, ==, 1);
+
+  g_object_unref (button);
+  g_object_unref (style);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* skip the test if there is no display to create the widgets on */
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 77;
+
+  test_round_trip ();
+  test_style ();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* MxBoxLayout, MxGrid and MxTable only paint and pick the children that can
+ * be seen. Checks that picking still finds the right child in a scrolled box
+ * layout and grid, and in each cell of a table. */
+
+#include <mx/mx.h>
+#include <stdlib.h>
+
+#define N_CHILDREN 1000
+#define CHILD_SIZE 20
+#define N_COLUMNS 10
+
+static gboolean
+quit_cb (gpointer data)
+{
+  clutter_main_quit ();
+
+  return FALSE;
+}
+
+static void
+run_frames (void)
+{
+  clutter_threads_add_timeout (250, quit_cb, NULL);
+  clutter_main ();
+}
+
+static ClutterActor *
+make_child (gint index)
+{
+  ClutterActor *child;
+
+  child = clutter_rectangle_new ();
+  clutter_actor_set_size (child, CHILD_SIZE, CHILD_SIZE);
+  clutter_actor_set_reactive (child, TRUE);
+  g_object_set_data (G_OBJECT (child), "index", GINT_TO_POINTER (index));
+
+  return child;
+}
+
+static void
+check_pick (ClutterActor *stage,
+            gfloat        x,
+            gfloat        y,
+            gint          index)
+{
+  ClutterActor *actor;
+
+  actor = clutter_stage_get_actor_at_pos (CLUTTER_STAGE (stage),
+                                          CLUTTER_PICK_REACTIVE, x, y);
+  g_assert (actor != NULL);
+  g_assert (actor != stage);
+  g_assert_cmpint (GPOINTER_TO_INT (g_object_get_data (G_OBJECT (actor),
+                                                       "index")), ==, index);
+}
+
+static void
+scroll_to (ClutterActor *scrollable,
+           gdouble       value)
+{
+  MxAdjustment *hadjustment, *vadjustment;
+
+  mx_scrollable_get_adjustments (MX_SCROLLABLE (scrollable), &hadjustment,
+                                 &vadjustment);
+  mx_adjustment_set_value (vadjustment, value);
+  run_frames ();
+}
+
+static void
+test_box_layout (ClutterActor *stage)
+{
+  ClutterActor *scroll, *box;
+  gint i;
+
+  scroll = mx_scroll_view_new ();
+  clutter_actor_set_size (scroll, 300, 200);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), scroll);
+
+  box = mx_box_layout_new ();
+  mx_box_layout_set_orientation (MX_BOX_LAYOUT (box),
+                                 MX_ORIENTATION_VERTICAL);
+  clutter_container_add_actor (CLUTTER_CONTAINER (scroll), box);
+
+  for (i = 0; i < N_CHILDREN; i++)
+    clutter_container_add_actor (CLUTTER_CONTAINER (box), make_child (i));
+
+  run_frames ();
+  check_pick (stage, 5, 5, 0);
+  check_pick (stage, 5, 5 + 3 * CHILD_SIZE, 3);
+
+  scroll_to (box, 250 * CHILD_SIZE);
+  check_pick (stage, 5, 5, 250);
+  check_pick (stage, 5, 195, 259);
+
+  clutter_actor_destroy (scroll);
+}
+
+static void
+test_grid (ClutterActor *stage)
+{
+  ClutterActor *scroll, *grid;
+  gint i;
+
+  scroll = mx_scroll_view_new ();
+  clutter_actor_set_size (scroll, 300, 200);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), scroll);
+
+  grid = mx_grid_new ();
+  mx_grid_set_max_stride (MX_GRID (grid), N_COLUMNS);
+  clutter_container_add_actor (CLUTTER_CONTAINER (scroll), grid);
+
+  for (i = 0; i < N_CHILDREN; i++)
+    clutter_container_add_actor (CLUTTER_CONTAINER (grid), make_child (i));
+
+  run_frames ();
+  check_pick (stage, 5, 5, 0);
+  check_pick (stage, 5 + CHILD_SIZE, 5 + CHILD_SIZE, N_COLUMNS + 1);
+
+  scroll_to (grid, 50 * CHILD_SIZE);
+  check_pick (stage, 5, 5, 50 * N_COLUMNS);
+  check_pick (stage, 5 + 9 * CHILD_SIZE, 5 + CHILD_SIZE,
+              51 * N_COLUMNS + 9);
+
+  clutter_actor_destroy (scroll);
+}
+
+static void
+test_table (ClutterActor *stage)
+{
+  ClutterActor *table;
+  gint row, column;
+
+  table = mx_table_new ();
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), table);
+
+  for (row = 0; row < N_COLUMNS; row++)
+    for (column = 0; column < N_COLUMNS; column++)
+      mx_table_insert_actor (MX_TABLE (table),
+                             make_child (row * N_COLUMNS + column),
+                             row, column);
+
+  run_frames ();
+
+  for (row = 0; row < N_COLUMNS; row++)
+    for (column = 0; column < N_COLUMNS; column++)
+      check_pick (stage,
+                  column * CHILD_SIZE + CHILD_SIZE / 2,
+                  row * CHILD_SIZE + CHILD_SIZE / 2,
+                  row * N_COLUMNS + column);
+
+  clutter_actor_destroy (table);
+}
+
+int
+main (int argc, char *argv[])
+{
+  ClutterActor *stage;
+
+  /* skip the test if there is no display to create the stage on */
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 77;
+
+  stage = clutter_stage_new ();
+  clutter_actor_set_size (stage, 300, 200);
+  clutter_actor_show (stage);
+
+  test_box_layout (stage);
+  test_grid (stage);
+  test_table (stage);
+
+  clutter_actor_destroy (stage);
+
+  return EXIT_SUCCESS;
+}
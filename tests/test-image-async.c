@@ -0,0 +1,253 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Checks that cancelled and superseded asynchronous image loads never
+ * signal, that the others signal exactly once, and that an empty file is
+ * reported as an error. */
+
+#include <mx/mx.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_IMAGES 20
+
+typedef struct
+{
+  gint loaded;
+  gint errors;
+} LoadCounts;
+
+static gint total_loaded = 0;
+static gint total_errors = 0;
+
+static void
+image_loaded_cb (MxImage    *image,
+                 LoadCounts *counts)
+{
+  counts->loaded ++;
+  total_loaded ++;
+}
+
+static void
+image_load_error_cb (MxImage    *image,
+                     GError     *error,
+                     LoadCounts *counts)
+{
+  counts->errors ++;
+  total_errors ++;
+}
+
+static gboolean
+timeout_cb (gpointer data)
+{
+  *((gboolean *) data) = TRUE;
+
+  return FALSE;
+}
+
+/* runs the main loop until @count reaches @value, or a few seconds pass */
+static void
+wait_for (gint *count,
+          gint  value)
+{
+  gboolean timed_out = FALSE;
+  guint id;
+
+  id = g_timeout_add_seconds (5, timeout_cb, &timed_out);
+
+  while (*count < value && !timed_out)
+    g_main_context_iteration (NULL, TRUE);
+
+  if (!timed_out)
+    g_source_remove (id);
+}
+
+/* lets anything that is still pending finish */
+static void
+run_idle (void)
+{
+  gboolean timed_out = FALSE;
+
+  g_timeout_add (500, timeout_cb, &timed_out);
+
+  while (!timed_out)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static ClutterActor *
+make_image (ClutterActor *stage,
+            LoadCounts   *counts)
+{
+  ClutterActor *image;
+
+  image = mx_image_new ();
+  mx_image_set_load_async (MX_IMAGE (image), TRUE);
+  g_signal_connect (image, "image-loaded",
+                    G_CALLBACK (image_loaded_cb), counts);
+  g_signal_connect (image, "image-load-error",
+                    G_CALLBACK (image_load_error_cb), counts);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), image);
+
+  return image;
+}
+
+static void
+test_cancel (ClutterActor *stage,
+             const gchar  *filename)
+{
+  ClutterActor *images[N_IMAGES];
+  LoadCounts counts[N_IMAGES];
+  gint i;
+
+  total_loaded = total_errors = 0;
+  memset (counts, 0, sizeof (counts));
+
+  /* every image is loaded at a different size, so that none of them can be
+   * answered from the texture cache */
+  for (i = 0; i < N_IMAGES; i++)
+    {
+      images[i] = make_image (stage, &counts[i]);
+      g_assert (mx_image_set_from_file_at_size (MX_IMAGE (images[i]),
+                                                filename, 16 + i, 16 + i,
+                                                NULL));
+    }
+
+  /* clearing an image cancels its load, whether it is still queued or has
+   * already been taken by a thread */
+  for (i = 0; i < N_IMAGES; i += 2)
+    mx_image_clear (MX_IMAGE (images[i]));
+
+  wait_for (&total_loaded, N_IMAGES / 2);
+  run_idle ();
+
+  for (i = 0; i < N_IMAGES; i++)
+    {
+      g_assert_cmpint (counts[i].errors, ==, 0);
+      g_assert_cmpint (counts[i].loaded, ==, (i % 2) ? 1 : 0);
+      clutter_actor_destroy (images[i]);
+    }
+}
+
+static void
+test_supersede (ClutterActor *stage,
+                const gchar  *filename)
+{
+  gfloat width, height, reference_width, reference_height;
+  ClutterActor *image, *reference;
+  LoadCounts counts = { 0, };
+
+  total_loaded = total_errors = 0;
+
+  /* a second load replaces the first, which never signals */
+  image = make_image (stage, &counts);
+  mx_image_set_from_file_at_size (MX_IMAGE (image), filename, 48, 48, NULL);
+  mx_image_set_from_file_at_size (MX_IMAGE (image), filename, 50, 50, NULL);
+
+  wait_for (&counts.loaded, 1);
+  run_idle ();
+
+  g_assert_cmpint (counts.loaded, ==, 1);
+  g_assert_cmpint (counts.errors, ==, 0);
+
+  /* and the image is the one from the second load */
+  reference = mx_image_new ();
+  g_assert (mx_image_set_from_file_at_size (MX_IMAGE (reference), filename,
+                                            50, 50, NULL));
+  clutter_actor_get_preferred_size (reference, NULL, NULL,
+                                    &reference_width, &reference_height);
+  clutter_actor_destroy (g_object_ref_sink (reference));
+
+  clutter_actor_get_preferred_size (image, NULL, NULL, &width, &height);
+  g_assert_cmpfloat (width, ==, reference_width);
+  g_assert_cmpfloat (height, ==, reference_height);
+
+  /* destroying an image with a load in progress drops the load */
+  mx_image_set_from_file_at_size (MX_IMAGE (image), filename, 52, 52, NULL);
+  clutter_actor_destroy (image);
+  run_idle ();
+
+  g_assert_cmpint (total_loaded, ==, 1);
+  g_assert_cmpint (total_errors, ==, 0);
+}
+
+static void
+test_empty_file (ClutterActor *stage,
+                 const gchar  *filename)
+{
+  ClutterActor *image;
+  LoadCounts counts = { 0, };
+
+  g_assert (g_file_set_contents (filename, "", 0, NULL));
+
+  image = make_image (stage, &counts);
+  mx_image_set_from_file_at_size (MX_IMAGE (image), filename, 32, 32, NULL);
+
+  wait_for (&counts.errors, 1);
+
+  g_assert_cmpint (counts.loaded, ==, 0);
+  g_assert_cmpint (counts.errors, ==, 1);
+
+  clutter_actor_destroy (image);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *dirname, *filename, *empty_filename;
+  ClutterActor *stage;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  /* skip the test if there is no display to create the stage on */
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 77;
+
+  dirname = g_dir_make_tmp ("test-image-async-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  filename = g_build_filename (dirname, "image.png", NULL);
+  empty_filename = g_build_filename (dirname, "empty.png", NULL);
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+  gdk_pixbuf_fill (pixbuf, 0xff0000ff);
+  gdk_pixbuf_save (pixbuf, filename, "png", &error, NULL);
+  g_assert_no_error (error);
+  g_object_unref (pixbuf);
+
+  stage = clutter_stage_new ();
+  clutter_actor_show (stage);
+
+  test_cancel (stage, filename);
+  test_supersede (stage, filename);
+  test_empty_file (stage, empty_filename);
+
+  clutter_actor_destroy (stage);
+
+  g_unlink (filename);
+  g_unlink (empty_filename);
+  g_rmdir (dirname);
+
+  g_free (filename);
+  g_free (empty_filename);
+  g_free (dirname);
+
+  return EXIT_SUCCESS;
+}
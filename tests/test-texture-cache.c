@@ -0,0 +1,198 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Checks the texture cache's budget: that the least recently used textures
+ * are evicted, that evicted textures are only kept while something else
+ * holds a reference on them, and that look-ups are counted correctly. */
+
+#include <mx/mx.h>
+#include <stdlib.h>
+
+#define TEXTURE_SIZE 16
+#define TEXTURE_BYTES (TEXTURE_SIZE * TEXTURE_SIZE * 4)
+
+static CoglUserDataKey destroyed_key;
+
+static void
+texture_destroyed_cb (void *data)
+{
+  *((gboolean *) data) = TRUE;
+}
+
+static CoglHandle
+make_texture (gboolean *destroyed)
+{
+  CoglHandle texture;
+
+  texture = cogl_texture_new_with_size (TEXTURE_SIZE, TEXTURE_SIZE,
+                                        COGL_TEXTURE_NONE,
+                                        COGL_PIXEL_FORMAT_RGBA_8888_PRE);
+  g_assert (texture != COGL_INVALID_HANDLE);
+
+  *destroyed = FALSE;
+  cogl_object_set_user_data (texture, &destroyed_key, destroyed,
+                             texture_destroyed_cb);
+
+  return texture;
+}
+
+static void
+check_stats (MxTextureCache *cache,
+             guint           n_entries,
+             guint           hits,
+             guint           misses,
+             guint           evictions)
+{
+  guint cache_entries, cache_hits, cache_misses, cache_evictions;
+  gsize size;
+
+  mx_texture_cache_get_stats (cache, &cache_entries, &size, &cache_hits,
+                              &cache_misses, &cache_evictions);
+
+  g_assert_cmpuint (cache_entries, ==, n_entries);
+  g_assert_cmpuint (size, ==, n_entries * TEXTURE_BYTES);
+  g_assert_cmpuint (cache_hits, ==, hits);
+  g_assert_cmpuint (cache_misses, ==, misses);
+  g_assert_cmpuint (cache_evictions, ==, evictions);
+}
+
+static void
+test_budget (void)
+{
+  gboolean a_destroyed, b_destroyed, c_destroyed;
+  CoglHandle a, b, c, texture;
+  MxTextureCache *cache;
+
+  cache = g_object_new (MX_TYPE_TEXTURE_CACHE, NULL);
+
+  mx_texture_cache_set_budget (cache, 2 * TEXTURE_BYTES);
+  g_assert_cmpuint (mx_texture_cache_get_budget (cache), ==,
+                    2 * TEXTURE_BYTES);
+
+  /* the cache takes its own reference on inserted textures; keep ours on
+   * "a" only */
+  a = make_texture (&a_destroyed);
+  mx_texture_cache_insert (cache, "/mx-test/a.png", a);
+
+  b = make_texture (&b_destroyed);
+  mx_texture_cache_insert (cache, "/mx-test/b.png", b);
+  cogl_handle_unref (b);
+
+  check_stats (cache, 2, 0, 0, 0);
+  g_assert (!b_destroyed);
+
+  /* going over the budget evicts the least recently used texture; it stays
+   * in the cache while it is still referenced elsewhere */
+  c = make_texture (&c_destroyed);
+  mx_texture_cache_insert (cache, "/mx-test/c.png", c);
+  cogl_handle_unref (c);
+
+  check_stats (cache, 2, 0, 0, 1);
+  g_assert (!a_destroyed);
+  g_assert (mx_texture_cache_contains (cache, "/mx-test/a.png"));
+  g_assert_cmpint (mx_texture_cache_get_size (cache), ==, 3);
+
+  /* looking up the evicted texture returns the same texture, and evicts
+   * "b", which nothing else holds, so it is destroyed and removed */
+  texture = mx_texture_cache_get_cogl_texture (cache, "/mx-test/a.png");
+  g_assert (texture == a);
+  cogl_handle_unref (texture);
+
+  check_stats (cache, 2, 1, 0, 2);
+  g_assert (b_destroyed);
+  g_assert (!mx_texture_cache_contains (cache, "/mx-test/b.png"));
+  g_assert_cmpint (mx_texture_cache_get_size (cache), ==, 2);
+
+  /* checking for an image doesn't count as a look-up or use it */
+  g_assert (mx_texture_cache_contains (cache, "/mx-test/c.png"));
+  check_stats (cache, 2, 1, 0, 2);
+
+  /* "a" is now the most recently used, so "c" goes next */
+  cogl_handle_unref (a);
+  mx_texture_cache_set_budget (cache, TEXTURE_BYTES);
+
+  check_stats (cache, 1, 1, 0, 3);
+  g_assert (c_destroyed);
+  g_assert (!a_destroyed);
+  g_assert (!mx_texture_cache_contains (cache, "/mx-test/c.png"));
+
+  /* dropping the cache releases the last reference on "a" */
+  g_object_unref (cache);
+  g_assert (a_destroyed);
+}
+
+static void
+test_meta (void)
+{
+  gboolean a_destroyed, b_destroyed, meta_destroyed;
+  CoglHandle a, b, meta;
+  MxTextureCache *cache;
+  gpointer ident = &ident;
+  guint n_entries;
+  gsize size;
+
+  cache = g_object_new (MX_TYPE_TEXTURE_CACHE, NULL);
+
+  a = make_texture (&a_destroyed);
+  mx_texture_cache_insert (cache, "/mx-test/a.png", a);
+  cogl_handle_unref (a);
+
+  /* meta textures count towards their image's size */
+  meta = make_texture (&meta_destroyed);
+  mx_texture_cache_insert_meta (cache, "/mx-test/a.png", ident, meta, NULL);
+  cogl_handle_unref (meta);
+
+  g_assert (mx_texture_cache_contains_meta (cache, "/mx-test/a.png", ident));
+
+  mx_texture_cache_get_stats (cache, &n_entries, &size, NULL, NULL, NULL);
+  g_assert_cmpuint (n_entries, ==, 1);
+  g_assert_cmpuint (size, ==, 2 * TEXTURE_BYTES);
+
+  /* the most recently used image is kept even when it is over budget */
+  mx_texture_cache_set_budget (cache, TEXTURE_BYTES);
+  g_assert (!a_destroyed);
+  g_assert (!meta_destroyed);
+
+  /* an evicted image drops its meta textures with it */
+  b = make_texture (&b_destroyed);
+  mx_texture_cache_insert (cache, "/mx-test/b.png", b);
+  cogl_handle_unref (b);
+
+  g_assert (a_destroyed);
+  g_assert (meta_destroyed);
+  g_assert (!mx_texture_cache_contains_meta (cache, "/mx-test/a.png",
+                                             ident));
+  check_stats (cache, 1, 0, 0, 1);
+
+  g_object_unref (cache);
+  g_assert (b_destroyed);
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* skip the test if there is no display to create textures on */
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 77;
+
+  test_budget ();
+  test_meta ();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Checks that virtualized list and item views only create children for the
+ * visible part of a large model, that the children follow the scrolled
+ * area, and that re-creating the rows leaves other children alone. */
+
+#include <mx/mx.h>
+#include <stdlib.h>
+
+#define N_ROWS 10000
+
+/* a 200x200 view shows a few dozen rows or cells; anywhere near the number
+ * of rows in the model means the view isn't virtualized */
+#define MAX_CHILDREN 500
+
+static gboolean
+quit_cb (gpointer data)
+{
+  clutter_main_quit ();
+
+  return FALSE;
+}
+
+/* lets the views move their windows, which happens before a frame is
+ * painted */
+static void
+run_frames (void)
+{
+  clutter_threads_add_timeout (250, quit_cb, NULL);
+  clutter_main ();
+}
+
+static void
+count_children (ClutterActor *view,
+                gint         *n_children,
+                gint         *n_visible,
+                const gchar  *text,
+                gboolean     *found)
+{
+  ClutterActorIter iter;
+  ClutterActor *child;
+
+  *n_children = *n_visible = 0;
+  *found = FALSE;
+
+  clutter_actor_iter_init (&iter, view);
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      (*n_children) ++;
+
+      if (!CLUTTER_ACTOR_IS_VISIBLE (child))
+        continue;
+
+      (*n_visible) ++;
+
+      if (MX_IS_LABEL (child) &&
+          g_strcmp0 (mx_label_get_text (MX_LABEL (child)), text) == 0)
+        *found = TRUE;
+    }
+}
+
+static void
+test_view (ClutterActor *stage,
+           ClutterModel *model,
+           ClutterActor *view)
+{
+  MxAdjustment *hadjustment, *vadjustment;
+  ClutterActor *scroll, *foreign;
+  gint n_children, n_visible;
+  gdouble upper, page_size;
+  gboolean found;
+
+  g_object_set (view,
+                "virtualized", TRUE,
+                "item-type", MX_TYPE_LABEL,
+                "model", model,
+                NULL);
+
+  scroll = mx_scroll_view_new ();
+  clutter_actor_set_size (scroll, 200, 200);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), scroll);
+  clutter_container_add_actor (CLUTTER_CONTAINER (scroll), view);
+
+  run_frames ();
+
+  count_children (view, &n_children, &n_visible, "Row 0", &found);
+  g_assert_cmpint (n_visible, >, 0);
+  g_assert_cmpint (n_children, <, MAX_CHILDREN);
+  g_assert (found);
+
+  /* the scrolled area covers the whole model */
+  mx_scrollable_get_adjustments (MX_SCROLLABLE (view), &hadjustment,
+                                 &vadjustment);
+  mx_adjustment_get_values (vadjustment, NULL, NULL, &upper, NULL, NULL,
+                            &page_size);
+  g_assert_cmpfloat (upper, >, 20 * page_size);
+
+  /* scrolling to the end re-binds the children to the last rows */
+  mx_adjustment_set_value (vadjustment, upper - page_size);
+  run_frames ();
+
+  count_children (view, &n_children, &n_visible, "Row 9999", &found);
+  g_assert_cmpint (n_visible, >, 0);
+  g_assert_cmpint (n_children, <, MAX_CHILDREN);
+  g_assert (found);
+
+  /* changing the item type re-creates the rows, but not other children */
+  foreign = clutter_rectangle_new ();
+  clutter_actor_add_child (view, foreign);
+
+  g_object_set (view, "item-type", MX_TYPE_LABEL, NULL);
+  run_frames ();
+
+  g_assert (clutter_actor_get_parent (foreign) == view);
+  count_children (view, &n_children, &n_visible, "Row 9999", &found);
+  g_assert_cmpint (n_children, <, MAX_CHILDREN);
+  g_assert (found);
+
+  clutter_actor_destroy (scroll);
+}
+
+int
+main (int argc, char *argv[])
+{
+  ClutterActor *stage, *view;
+  ClutterModel *model;
+  gint i;
+
+  /* skip the test if there is no display to create the stage on */
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return 77;
+
+  model = clutter_list_model_new (1, G_TYPE_STRING, "text");
+  for (i = 0; i < N_ROWS; i++)
+    {
+      gchar *text = g_strdup_printf ("Row %d", i);
+
+      clutter_model_append (model, 0, text, -1);
+      g_free (text);
+    }
+
+  stage = clutter_stage_new ();
+  clutter_actor_set_size (stage, 200, 200);
+  clutter_actor_show (stage);
+
+  view = mx_list_view_new ();
+  mx_list_view_add_attribute (MX_LIST_VIEW (view), "text", 0);
+  test_view (stage, model, view);
+
+  view = mx_item_view_new ();
+  mx_item_view_add_attribute (MX_ITEM_VIEW (view), "text", 0);
+  test_view (stage, model, view);
+
+  clutter_actor_destroy (stage);
+  g_object_unref (model);
+
+  return EXIT_SUCCESS;
+}
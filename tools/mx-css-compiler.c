@@ -0,0 +1,81 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/* Compiles a CSS style sheet in to the binary format that MxStyle can load
+ * without parsing. The SHA-256 checksum of the source is recorded so that the
+ * compiled sheet is only used in place of an identical source.
+ */
+
+#include <mx/mx.h>
+#include <mx/mx-css.h>
+#include <stdlib.h>
+
+int
+main (int argc, char **argv)
+{
+  MxStyleSheet *sheet;
+  GError *error = NULL;
+  gchar *contents, *checksum;
+  gsize length;
+  GBytes *bytes;
+
+  if (argc != 3)
+    {
+      g_printerr ("Usage: %s INPUT.css OUTPUT.cssc\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+#if !GLIB_CHECK_VERSION (2, 35, 1)
+  g_type_init ();
+#endif
+
+  if (!g_file_get_contents (argv[1], &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  sheet = mx_style_sheet_new ();
+
+  if (!mx_style_sheet_add_from_data (sheet, argv[1], contents, NULL))
+    {
+      g_printerr ("Could not parse '%s'\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                          (const guchar *) contents, length);
+  bytes = mx_style_sheet_compile (sheet, checksum);
+  g_free (checksum);
+
+  if (!g_file_set_contents (argv[2], g_bytes_get_data (bytes, NULL),
+                            g_bytes_get_size (bytes), &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  g_bytes_unref (bytes);
+  mx_style_sheet_destroy (sheet);
+  g_free (contents);
+
+  return EXIT_SUCCESS;
+}